@@ -0,0 +1,127 @@
+#include "control_queue.h"
+
+typedef struct _ControlNode ControlNode;
+
+struct _ControlNode {
+    ControlNode *  next;
+    GstStructure * batch;
+};
+
+struct _ControlQueue {
+    GstPad *         pad;
+    gulong           probe_id;
+    ControlApplyFunc apply;
+    gpointer         user_data;
+
+    /* Only accessed atomically. Newest first, as producers only ever push on top and the consumer takes */
+    /* the whole list at once, which also keeps it free of the ABA problem.                              */
+    ControlNode * head;
+    gint          pending;
+    gint          applied;
+};
+
+static GstPadProbeReturn cb_frame_boundary(GstPad * pad, GstPadProbeInfo * info, gpointer user_data);
+static ControlNode *     take_all(ControlQueue * queue);
+static void              free_nodes(ControlNode * node);
+
+ControlQueue * control_queue_new(GstPad * pad, ControlApplyFunc apply, gpointer user_data)
+{
+    g_return_val_if_fail(pad != NULL && apply != NULL, NULL);
+
+    ControlQueue * queue = g_new0(ControlQueue, 1);
+    queue->pad           = gst_object_ref(pad);
+    queue->apply         = apply;
+    queue->user_data     = user_data;
+    queue->probe_id      = gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, cb_frame_boundary, queue, NULL);
+
+    return queue;
+}
+
+void control_queue_push(ControlQueue * queue, GstStructure * batch)
+{
+    g_return_if_fail(queue != NULL && batch != NULL);
+
+    ControlNode * node = g_new(ControlNode, 1);
+    node->batch        = batch;
+
+    g_atomic_int_inc(&queue->pending);
+    do {
+        node->next = g_atomic_pointer_get(&queue->head);
+    } while (!g_atomic_pointer_compare_and_exchange(&queue->head, node->next, node));
+}
+
+void control_queue_free(ControlQueue * queue)
+{
+    g_return_if_fail(queue != NULL);
+
+    gst_pad_remove_probe(queue->pad, queue->probe_id);
+    gst_object_unref(queue->pad);
+    free_nodes(take_all(queue));
+    g_free(queue);
+}
+
+void control_queue_fill_stats(ControlQueue * queue, GstStructure * stats)
+{
+    g_return_if_fail(queue != NULL && stats != NULL);
+
+    gst_structure_set(stats,
+                      "control-batches-pending",
+                      G_TYPE_UINT,
+                      (guint)g_atomic_int_get(&queue->pending),
+                      "control-batches-applied",
+                      G_TYPE_UINT,
+                      (guint)g_atomic_int_get(&queue->applied),
+                      NULL);
+}
+
+/* private functions' definitions */
+
+/* Runs once a frame is out, so that a batch applies to the whole next frame */
+static GstPadProbeReturn cb_frame_boundary(GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+    ControlQueue * queue  = user_data;
+    ControlNode *  newest = take_all(queue);
+    ControlNode *  oldest = NULL;
+    gint           count  = 0;
+
+    if (newest == NULL) { return GST_PAD_PROBE_OK; }
+
+    /* Reverse into submission order */
+    while (newest != NULL) {
+        ControlNode * next = newest->next;
+        newest->next       = oldest;
+        oldest             = newest;
+        newest             = next;
+    }
+    for (ControlNode * node = oldest; node != NULL; node = node->next) {
+        queue->apply(node->batch, queue->user_data);
+        count++;
+    }
+    free_nodes(oldest);
+
+    g_atomic_int_add(&queue->pending, -count);
+    g_atomic_int_add(&queue->applied, count);
+
+    return GST_PAD_PROBE_OK;
+}
+
+static ControlNode * take_all(ControlQueue * queue)
+{
+    ControlNode * head = g_atomic_pointer_get(&queue->head);
+
+    while (head != NULL && !g_atomic_pointer_compare_and_exchange(&queue->head, head, NULL)) {
+        head = g_atomic_pointer_get(&queue->head);
+    }
+
+    return head;
+}
+
+static void free_nodes(ControlNode * node)
+{
+    while (node != NULL) {
+        ControlNode * next = node->next;
+        gst_structure_free(node->batch);
+        g_free(node);
+        node = next;
+    }
+}
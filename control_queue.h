@@ -0,0 +1,28 @@
+#ifndef _CONTROL_QUEUE__H_
+#define _CONTROL_QUEUE__H_
+
+#include <gst/gst.h>
+
+/* Batches of changes handed over to the mixer thread, which applies each batch as a whole between two output */
+/* frames. Submitting never blocks: batches go through a lock-free list (many producers, one consumer), so   */
+/* neither the submitting threads nor the mixer wait on each other, and an idle frame costs one atomic read. */
+typedef struct _ControlQueue ControlQueue;
+
+/* Called on the streaming thread of the pad, for each batch in submission order */
+typedef void (*ControlApplyFunc)(const GstStructure * batch, gpointer user_data);
+
+/* Apply the batches after each buffer passing through @pad. Probes run in the order they were added, so  */
+/* create the queue before anything else watching @pad for changes to make (e.g. a VideoLayout), for them */
+/* to take effect on the same frame.                                                                      */
+ControlQueue * control_queue_new(GstPad * pad, ControlApplyFunc apply, gpointer user_data);
+
+/* Takes ownership of @batch. Safe to call from any thread. */
+void control_queue_push(ControlQueue * queue, GstStructure * batch);
+
+/* Batches not applied yet are dropped */
+void control_queue_free(ControlQueue * queue);
+
+/* Add the batch counts to @stats (fields prefixed with "control-") */
+void control_queue_fill_stats(ControlQueue * queue, GstStructure * stats);
+
+#endif /* _CONTROL_QUEUE__H_ */
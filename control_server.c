@@ -0,0 +1,386 @@
+#include "control_server.h"
+
+#include <gio/gio.h>
+#include <gio/gunixsocketaddress.h>
+#include <glib/gstdio.h>
+#include <json-glib/json-glib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define CONTROL_SERVER_MAX_LINE (64 * 1024) /* longer requests drop the client, rather than being buffered */
+
+struct _ControlServer {
+    ThreeVideoStream * stream;
+    gchar *            path;
+    GSocketService *   service;
+    GCancellable *     cancellable; /* of the I/O of all the clients */
+};
+
+/* A client only keeps the server's stream and cancellable, so that it can outlive the server */
+typedef struct {
+    ThreeVideoStream *  stream;
+    GSocketConnection * connection;
+    GDataInputStream *  input;
+    GCancellable *      cancellable;
+    gchar *             reply; /* being written */
+} ControlClient;
+
+static gboolean cb_incoming(GSocketService *    service,
+                            GSocketConnection * connection,
+                            GObject *           source_object,
+                            gpointer            user_data);
+static void     cb_input_filled(GObject * source, GAsyncResult * result, gpointer user_data);
+static void     cb_reply_written(GObject * source, GAsyncResult * result, gpointer user_data);
+static void     read_next_request(ControlClient * client);
+static void     serve_request(ControlClient * client);
+static void     free_client(ControlClient * client);
+
+static gchar *        handle_request(ThreeVideoStream * stream, const gchar * line);
+static gboolean       handle_command(ThreeVideoStream * stream,
+                                     JsonObject *       request,
+                                     JsonBuilder *      builder,
+                                     GError **          error);
+static GstStructure * json_to_changes(JsonObject * object, GError ** error);
+static void           add_structure(JsonBuilder * builder, const gchar * name, const GstStructure * structure);
+static JsonNode *     value_to_json(const GValue * value);
+
+ControlServer * control_server_new(ThreeVideoStream * stream, const gchar * path)
+{
+    g_return_val_if_fail(IS_THREE_VIDEO_STREAM(stream) && path != NULL, NULL);
+
+    GError *         error   = NULL;
+    GSocketService * service = g_socket_service_new();
+    GSocketAddress * address = g_unix_socket_address_new(path);
+    GStatBuf         status;
+
+    /* Never remove anything but a socket, e.g. if the path of a file was given by mistake */
+    if (g_lstat(path, &status) == 0 && S_ISSOCK(status.st_mode)) { g_unlink(path); }
+
+    gboolean listening = g_socket_listener_add_address(
+        G_SOCKET_LISTENER(service), address, G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT, NULL, NULL, &error);
+    g_object_unref(address);
+    if (!listening) {
+        g_printerr("Could not listen for control clients on '%s': %s\n", path, error->message);
+        g_error_free(error);
+        g_object_unref(service);
+        return NULL;
+    }
+
+    ControlServer * server = g_new0(ControlServer, 1);
+    server->stream         = g_object_ref(stream);
+    server->path           = g_strdup(path);
+    server->service        = service;
+    server->cancellable    = g_cancellable_new();
+
+    g_signal_connect(service, "incoming", G_CALLBACK(cb_incoming), server);
+    g_socket_service_start(service);
+
+    return server;
+}
+
+void control_server_free(ControlServer * server)
+{
+    g_return_if_fail(server != NULL);
+
+    g_socket_service_stop(server->service);
+    g_socket_listener_close(G_SOCKET_LISTENER(server->service));
+    g_object_unref(server->service);
+    /* The clients free themselves once their pending I/O is cancelled */
+    g_cancellable_cancel(server->cancellable);
+    g_object_unref(server->cancellable);
+    g_unlink(server->path);
+    g_free(server->path);
+    g_object_unref(server->stream);
+    g_free(server);
+}
+
+/* private functions' definitions */
+
+static gboolean cb_incoming(GSocketService *    service,
+                            GSocketConnection * connection,
+                            GObject *           source_object,
+                            gpointer            user_data)
+{
+    ControlServer * server = user_data;
+    ControlClient * client = g_new0(ControlClient, 1);
+
+    client->stream      = g_object_ref(server->stream);
+    client->connection  = g_object_ref(connection);
+    client->input       = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+    client->cancellable = g_object_ref(server->cancellable);
+    /* A request has to fit in the buffer, see read_next_request() */
+    g_buffered_input_stream_set_buffer_size(G_BUFFERED_INPUT_STREAM(client->input), CONTROL_SERVER_MAX_LINE);
+    g_data_input_stream_set_newline_type(client->input, G_DATA_STREAM_NEWLINE_TYPE_LF);
+    read_next_request(client);
+
+    return TRUE;
+}
+
+static void cb_input_filled(GObject * source, GAsyncResult * result, gpointer user_data)
+{
+    ControlClient * client = user_data;
+    GError *        error  = NULL;
+    gssize          filled = g_buffered_input_stream_fill_finish(G_BUFFERED_INPUT_STREAM(source), result, &error);
+
+    /* Disconnected, an unterminated last line is ignored */
+    if (filled <= 0) {
+        if (error != NULL && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            g_printerr("Dropping a control client: %s\n", error->message);
+        }
+        g_clear_error(&error);
+        free_client(client);
+        return;
+    }
+    read_next_request(client);
+}
+
+/* Called with a complete line in the buffer, i.e. reading it doesn't block */
+static void serve_request(ControlClient * client)
+{
+    GError * error = NULL;
+    gchar *  line  = g_data_input_stream_read_line_utf8(client->input, NULL, client->cancellable, &error);
+
+    /* Not even text */
+    if (line == NULL) {
+        if (error != NULL) { g_printerr("Dropping a control client: %s\n", error->message); }
+        g_clear_error(&error);
+        free_client(client);
+        return;
+    }
+    if (g_strstrip(line)[0] == '\0') {
+        g_free(line);
+        read_next_request(client);
+        return;
+    }
+
+    /* The next request is only read once the reply is out, so that replies stay in order */
+    client->reply = handle_request(client->stream, line);
+    g_free(line);
+    g_output_stream_write_all_async(g_io_stream_get_output_stream(G_IO_STREAM(client->connection)),
+                                    client->reply,
+                                    strlen(client->reply),
+                                    G_PRIORITY_DEFAULT,
+                                    client->cancellable,
+                                    cb_reply_written,
+                                    client);
+}
+
+static void cb_reply_written(GObject * source, GAsyncResult * result, gpointer user_data)
+{
+    ControlClient * client = user_data;
+    GError *        error  = NULL;
+
+    g_clear_pointer(&client->reply, g_free);
+    if (!g_output_stream_write_all_finish(G_OUTPUT_STREAM(source), result, NULL, &error)) {
+        g_clear_error(&error);
+        free_client(client);
+        return;
+    }
+    read_next_request(client);
+}
+
+/* Lines are only read once complete in the buffer: g_data_input_stream_read_line_async() would grow it without */
+/* limit, for a client sending an endless line                                                                    */
+static void read_next_request(ControlClient * client)
+{
+    GBufferedInputStream * buffered  = G_BUFFERED_INPUT_STREAM(client->input);
+    gsize                  available = 0;
+    const void *           buffer    = g_buffered_input_stream_peek_buffer(buffered, &available);
+
+    if (available > 0 && memchr(buffer, '\n', available) != NULL) {
+        serve_request(client);
+        return;
+    }
+    if (available >= CONTROL_SERVER_MAX_LINE) {
+        g_printerr("Dropping a control client: request longer than %d bytes.\n", CONTROL_SERVER_MAX_LINE);
+        free_client(client);
+        return;
+    }
+    g_buffered_input_stream_fill_async(
+        buffered, -1, G_PRIORITY_DEFAULT, client->cancellable, cb_input_filled, client);
+}
+
+static void free_client(ControlClient * client)
+{
+    g_io_stream_close(G_IO_STREAM(client->connection), NULL, NULL);
+    g_object_unref(client->input);
+    g_object_unref(client->connection);
+    g_object_unref(client->cancellable);
+    g_object_unref(client->stream);
+    g_free(client->reply);
+    g_free(client);
+}
+
+/* The reply to one request line, newline terminated */
+static gchar * handle_request(ThreeVideoStream * stream, const gchar * line)
+{
+    JsonParser *    parser    = json_parser_new();
+    JsonBuilder *   builder   = json_builder_new();
+    JsonGenerator * generator = json_generator_new();
+    JsonNode *      root      = NULL;
+    GError *        error     = NULL;
+
+    json_builder_begin_object(builder);
+    if (json_parser_load_from_data(parser, line, -1, &error)) {
+        root = json_parser_get_root(parser);
+        if (root != NULL && JSON_NODE_HOLDS_OBJECT(root)) {
+            JsonObject * request = json_node_get_object(root);
+            if (json_object_has_member(request, "id")) {
+                json_builder_set_member_name(builder, "id");
+                json_builder_add_value(builder, json_node_copy(json_object_get_member(request, "id")));
+            }
+            handle_command(stream, request, builder, &error);
+        }
+        else {
+            g_set_error(&error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Expected a JSON object");
+        }
+    }
+    json_builder_set_member_name(builder, "ok");
+    json_builder_add_boolean_value(builder, error == NULL);
+    if (error != NULL) {
+        json_builder_set_member_name(builder, "error");
+        json_builder_add_string_value(builder, error->message);
+        g_error_free(error);
+    }
+    json_builder_end_object(builder);
+
+    root = json_builder_get_root(builder);
+    json_generator_set_root(generator, root);
+    gchar * text  = json_generator_to_data(generator, NULL);
+    gchar * reply = g_strconcat(text, "\n", NULL);
+
+    g_free(text);
+    json_node_unref(root);
+    g_object_unref(generator);
+    g_object_unref(builder);
+    g_object_unref(parser);
+
+    return reply;
+}
+
+static gboolean handle_command(ThreeVideoStream * stream,
+                               JsonObject *       request,
+                               JsonBuilder *      builder,
+                               GError **          error)
+{
+    JsonNode *    command_node = json_object_get_member(request, "command");
+    const gchar * command      = NULL;
+
+    if (command_node != NULL && JSON_NODE_HOLDS_VALUE(command_node)) { command = json_node_get_string(command_node); }
+
+    if (g_strcmp0(command, "set") == 0) {
+        JsonNode * changes_node = json_object_get_member(request, "changes");
+        if (changes_node == NULL || !JSON_NODE_HOLDS_OBJECT(changes_node)) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Expected an object of \"changes\"");
+            return FALSE;
+        }
+
+        GstStructure * changes = json_to_changes(json_node_get_object(changes_node), error);
+        if (changes == NULL) { return FALSE; }
+        gboolean applied = three_video_stream_apply(stream, changes, error);
+        gst_structure_free(changes);
+        return applied;
+    }
+    if (g_strcmp0(command, "get") == 0) {
+        GstStructure * state = three_video_stream_get_state(stream);
+        add_structure(builder, "state", state);
+        gst_structure_free(state);
+        return TRUE;
+    }
+    if (g_strcmp0(command, "stats") == 0) {
+        GstStructure * stats = NULL;
+        g_object_get(stream, "stats", &stats, NULL);
+        add_structure(builder, "stats", stats);
+        gst_structure_free(stats);
+        return TRUE;
+    }
+
+    g_set_error(error,
+                G_IO_ERROR,
+                G_IO_ERROR_INVALID_DATA,
+                "Unknown command '%s' (expected 'set', 'get' or 'stats')",
+                command != NULL ? command : "");
+    return FALSE;
+}
+
+/* The members in their order, so that e.g. a "layout-transition" can precede the "layout" it applies to */
+static GstStructure * json_to_changes(JsonObject * object, GError ** error)
+{
+    GstStructure * changes = gst_structure_new_empty("changes");
+    GList *        members = json_object_get_members(object);
+
+    for (GList * member = members; member != NULL; member = member->next) {
+        JsonNode * node  = json_object_get_member(object, member->data);
+        GValue     value = G_VALUE_INIT;
+
+        if (!JSON_NODE_HOLDS_VALUE(node)) {
+            g_set_error(error,
+                        G_IO_ERROR,
+                        G_IO_ERROR_INVALID_DATA,
+                        "Expected a number, a string or a boolean for '%s'",
+                        (const gchar *)member->data);
+            gst_structure_free(changes);
+            g_list_free(members);
+            return NULL;
+        }
+        json_node_get_value(node, &value);
+        gst_structure_take_value(changes, member->data, &value);
+    }
+    g_list_free(members);
+
+    return changes;
+}
+
+static void add_structure(JsonBuilder * builder, const gchar * name, const GstStructure * structure)
+{
+    json_builder_set_member_name(builder, name);
+    json_builder_begin_object(builder);
+    for (gint i = 0; i < gst_structure_n_fields(structure); i++) {
+        const gchar * field = gst_structure_nth_field_name(structure, i);
+        json_builder_set_member_name(builder, field);
+        json_builder_add_value(builder, value_to_json(gst_structure_get_value(structure, field)));
+    }
+    json_builder_end_object(builder);
+}
+
+/* Enums by their nick, anything which isn't a number, a string or a boolean as its GStreamer serialization */
+static JsonNode * value_to_json(const GValue * value)
+{
+    JsonNode * node   = json_node_alloc();
+    GValue     number = G_VALUE_INIT;
+
+    if (G_VALUE_HOLDS_ENUM(value)) {
+        GEnumClass * enum_class = g_type_class_ref(G_VALUE_TYPE(value));
+        GEnumValue * enum_value = g_enum_get_value(enum_class, g_value_get_enum(value));
+        json_node_init_string(node, enum_value != NULL ? enum_value->value_nick : "");
+        g_type_class_unref(enum_class);
+    }
+    else if (G_VALUE_HOLDS_STRING(value)) {
+        if (g_value_get_string(value) != NULL) { json_node_init_string(node, g_value_get_string(value)); }
+        else {
+            json_node_init_null(node);
+        }
+    }
+    else if (G_VALUE_HOLDS_BOOLEAN(value)) { json_node_init_boolean(node, g_value_get_boolean(value)); }
+    else if (G_VALUE_HOLDS_FLOAT(value) || G_VALUE_HOLDS_DOUBLE(value)) {
+        g_value_init(&number, G_TYPE_DOUBLE);
+        g_value_transform(value, &number);
+        json_node_init_double(node, g_value_get_double(&number));
+    }
+    else if (g_value_type_transformable(G_VALUE_TYPE(value), G_TYPE_INT64)) {
+        g_value_init(&number, G_TYPE_INT64);
+        g_value_transform(value, &number);
+        json_node_init_int(node, g_value_get_int64(&number));
+    }
+    else {
+        gchar * text = gst_value_serialize(value);
+        if (text != NULL) { json_node_init_string(node, text); }
+        else {
+            json_node_init_null(node);
+        }
+        g_free(text);
+    }
+    if (G_IS_VALUE(&number)) { g_value_unset(&number); }
+
+    return node;
+}
@@ -0,0 +1,22 @@
+#ifndef _CONTROL_SERVER__H_
+#define _CONTROL_SERVER__H_
+
+#include "three_video_stream.h"
+
+/* Control of a ThreeVideoStream over a Unix domain socket, one JSON message per line:                    */
+/*   {"id": 1, "command": "set", "changes": {"layout": "columns", "video-bitrate": 2500}}                 */
+/*   {"id": 2, "command": "get"}     the value of every property                                          */
+/*   {"id": 3, "command": "stats"}   the runtime metrics                                                  */
+/* Each request is answered with a line echoing its "id", with "ok": true and the "state" or "stats", or  */
+/* "ok": false and an "error". The changes of a "set" are applied together, in the order given, between   */
+/* two frames of the mix (see three_video_stream_apply()). Clients are served from the default main loop, */
+/* a client sending a line longer than 64 KiB is disconnected.                                            */
+typedef struct _ControlServer ControlServer;
+
+/* Listen on @path, replacing a socket left there by a previous run. NULL on error. */
+ControlServer * control_server_new(ThreeVideoStream * stream, const gchar * path);
+
+/* Stop listening and disconnect the clients */
+void control_server_free(ControlServer * server);
+
+#endif /* _CONTROL_SERVER__H_ */
@@ -0,0 +1,289 @@
+#include "dvr_ring.h"
+
+#define EXPORT_TIMEOUT (30 * GST_SECOND)
+
+typedef struct _DvrEntry {
+    GstSample *  sample;
+    GstClockTime time; /* DTS, or PTS if there's none */
+    gsize        size;
+    gboolean     keyframe;
+} DvrEntry;
+
+struct _DvrRing {
+    GstElement * appsink;
+
+    GMutex       lock;
+    GQueue       entries;   /* DvrEntry *, oldest first */
+    GQueue       keyframes; /* GList * links of the keyframe entries, oldest first */
+    guint64      bytes;
+    guint64      max_bytes;
+    GstClockTime max_duration;
+
+    /* Metrics */
+    guint exports;
+};
+
+static GstFlowReturn cb_new_sample(GstElement * appsink, gpointer user_data);
+static void          evict_locked(DvrRing * dvr_ring);
+static GstClockTime  duration_locked(DvrRing * dvr_ring);
+static void          dvr_entry_free(DvrEntry * entry);
+
+DvrRing * dvr_ring_new(GstElement * appsink)
+{
+    g_return_val_if_fail(appsink != NULL, NULL);
+
+    DvrRing * dvr_ring     = g_new0(DvrRing, 1);
+    dvr_ring->appsink      = gst_object_ref(appsink);
+    dvr_ring->max_bytes    = 256 * 1024 * 1024;
+    dvr_ring->max_duration = 120 * GST_SECOND;
+    g_mutex_init(&dvr_ring->lock);
+    g_queue_init(&dvr_ring->entries);
+    g_queue_init(&dvr_ring->keyframes);
+
+    /* The DVR must never hold back the encoder */
+    g_object_set(appsink, "emit-signals", TRUE, "sync", FALSE, "max-buffers", 0, NULL);
+    g_signal_connect(appsink, "new-sample", G_CALLBACK(cb_new_sample), dvr_ring);
+
+    return dvr_ring;
+}
+
+void dvr_ring_set_limits(DvrRing * dvr_ring, guint64 max_bytes, GstClockTime max_duration)
+{
+    g_return_if_fail(dvr_ring != NULL);
+
+    g_mutex_lock(&dvr_ring->lock);
+    dvr_ring->max_bytes    = max_bytes;
+    dvr_ring->max_duration = max_duration;
+    evict_locked(dvr_ring);
+    g_mutex_unlock(&dvr_ring->lock);
+}
+
+gboolean dvr_ring_get_range(DvrRing * dvr_ring, GstClockTime * start, GstClockTime * end)
+{
+    g_return_val_if_fail(dvr_ring != NULL, FALSE);
+
+    g_mutex_lock(&dvr_ring->lock);
+    gboolean empty = g_queue_is_empty(&dvr_ring->entries);
+    if (!empty) {
+        if (start != NULL) { *start = ((DvrEntry *)g_queue_peek_head(&dvr_ring->entries))->time; }
+        if (end != NULL) { *end = ((DvrEntry *)g_queue_peek_tail(&dvr_ring->entries))->time; }
+    }
+    g_mutex_unlock(&dvr_ring->lock);
+
+    return !empty;
+}
+
+gboolean dvr_ring_export(DvrRing * dvr_ring, GstClockTime start, GstClockTime end, const gchar * path)
+{
+    g_return_val_if_fail(dvr_ring != NULL && path != NULL && start <= end, FALSE);
+
+    GPtrArray * clip = g_ptr_array_new_with_free_func((GDestroyNotify)gst_sample_unref);
+
+    /* Only take references under the lock, the remuxing happens outside of it */
+    g_mutex_lock(&dvr_ring->lock);
+    if (!g_queue_is_empty(&dvr_ring->keyframes)) {
+        GList * first = g_queue_peek_head(&dvr_ring->keyframes);
+        for (GList * l = dvr_ring->keyframes.head; l != NULL; l = l->next) {
+            GList * keyframe = l->data;
+            if (((DvrEntry *)keyframe->data)->time > start) { break; }
+            first = keyframe;
+        }
+        for (GList * l = first; l != NULL && ((DvrEntry *)l->data)->time <= end; l = l->next) {
+            g_ptr_array_add(clip, gst_sample_ref(((DvrEntry *)l->data)->sample));
+        }
+    }
+    g_mutex_unlock(&dvr_ring->lock);
+
+    if (clip->len == 0) {
+        g_printerr("Nothing to export, the replay buffer doesn't contain the requested range.\n");
+        g_ptr_array_unref(clip);
+        return FALSE;
+    }
+
+    GstElement * pipeline = gst_pipeline_new("dvr_export");
+    GstElement * src      = gst_element_factory_make("appsrc", "dvr_src");
+    GstElement * parse    = gst_element_factory_make("h264parse", "dvr_parse");
+    GstElement * mux      = gst_element_factory_make("mp4mux", "dvr_mux");
+    GstElement * sink     = gst_element_factory_make("filesink", "dvr_sink");
+    gboolean     ok       = FALSE;
+
+    if (!pipeline || !src || !parse || !mux || !sink) {
+        g_printerr("Not all replay export elements could be created.\n");
+        if (pipeline != NULL) { gst_object_unref(pipeline); }
+        if (src != NULL) { gst_object_unref(src); }
+        if (parse != NULL) { gst_object_unref(parse); }
+        if (mux != NULL) { gst_object_unref(mux); }
+        if (sink != NULL) { gst_object_unref(sink); }
+        g_ptr_array_unref(clip);
+        return FALSE;
+    }
+
+    g_object_set(src, "format", GST_FORMAT_TIME, "max-bytes", (guint64)0, NULL);
+    g_object_set(sink, "location", path, NULL);
+    gst_bin_add_many(GST_BIN(pipeline), src, parse, mux, sink, NULL);
+
+    if (gst_element_link_many(src, parse, mux, sink, NULL)
+        && gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE) {
+        /* The clip starts at zero */
+        GstBuffer *   first_buffer = gst_sample_get_buffer(g_ptr_array_index(clip, 0));
+        GstClockTime  base         = GST_BUFFER_PTS(first_buffer);
+        GstCaps *     caps         = NULL;
+        GstFlowReturn ret;
+
+        if (GST_BUFFER_DTS_IS_VALID(first_buffer)
+            && (!GST_CLOCK_TIME_IS_VALID(base) || GST_BUFFER_DTS(first_buffer) < base)) {
+            base = GST_BUFFER_DTS(first_buffer);
+        }
+        if (!GST_CLOCK_TIME_IS_VALID(base)) { base = 0; }
+
+        for (guint i = 0; i < clip->len; i++) {
+            GstSample * sample = g_ptr_array_index(clip, i);
+            GstBuffer * buffer = gst_buffer_copy(gst_sample_get_buffer(sample));
+
+            if (gst_sample_get_caps(sample) != caps) {
+                caps = gst_sample_get_caps(sample);
+                g_object_set(src, "caps", caps, NULL);
+            }
+            if (GST_BUFFER_PTS_IS_VALID(buffer)) { GST_BUFFER_PTS(buffer) -= MIN(base, GST_BUFFER_PTS(buffer)); }
+            if (GST_BUFFER_DTS_IS_VALID(buffer)) { GST_BUFFER_DTS(buffer) -= MIN(base, GST_BUFFER_DTS(buffer)); }
+
+            g_signal_emit_by_name(src, "push-buffer", buffer, &ret);
+            gst_buffer_unref(buffer);
+        }
+        g_signal_emit_by_name(src, "end-of-stream", &ret);
+
+        GstBus *     bus     = gst_element_get_bus(pipeline);
+        GstMessage * message = gst_bus_timed_pop_filtered(bus, EXPORT_TIMEOUT, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+        if (message != NULL && GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR) {
+            GError * err = NULL;
+            gst_message_parse_error(message, &err, NULL);
+            g_printerr("Replay export to %s failed: %s\n", path, err->message);
+            g_error_free(err);
+        }
+        else if (message == NULL) {
+            g_printerr("Replay export to %s timed out.\n", path);
+        }
+        ok = message != NULL && GST_MESSAGE_TYPE(message) == GST_MESSAGE_EOS;
+        if (message != NULL) { gst_message_unref(message); }
+        gst_object_unref(bus);
+    }
+    else {
+        g_printerr("Replay export pipeline could not be started.\n");
+    }
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    g_ptr_array_unref(clip);
+
+    /* Only the clips written */
+    if (ok) {
+        g_mutex_lock(&dvr_ring->lock);
+        dvr_ring->exports++;
+        g_mutex_unlock(&dvr_ring->lock);
+    }
+
+    return ok;
+}
+
+void dvr_ring_free(DvrRing * dvr_ring)
+{
+    g_return_if_fail(dvr_ring != NULL);
+
+    g_signal_handlers_disconnect_by_data(dvr_ring->appsink, dvr_ring);
+    g_queue_clear(&dvr_ring->keyframes);
+    g_queue_clear_full(&dvr_ring->entries, (GDestroyNotify)dvr_entry_free);
+    gst_object_unref(dvr_ring->appsink);
+    g_mutex_clear(&dvr_ring->lock);
+    g_free(dvr_ring);
+}
+
+void dvr_ring_fill_stats(DvrRing * dvr_ring, GstStructure * stats)
+{
+    g_return_if_fail(dvr_ring != NULL && stats != NULL);
+
+    g_mutex_lock(&dvr_ring->lock);
+    gst_structure_set(stats,
+                      "dvr-bytes",
+                      G_TYPE_UINT64,
+                      dvr_ring->bytes,
+                      "dvr-duration",
+                      G_TYPE_UINT64,
+                      duration_locked(dvr_ring),
+                      "dvr-keyframes",
+                      G_TYPE_UINT,
+                      g_queue_get_length(&dvr_ring->keyframes),
+                      "dvr-exports",
+                      G_TYPE_UINT,
+                      dvr_ring->exports,
+                      NULL);
+    g_mutex_unlock(&dvr_ring->lock);
+}
+
+/* private functions' definitions */
+
+static GstFlowReturn cb_new_sample(GstElement * appsink, gpointer user_data)
+{
+    DvrRing *   dvr_ring = user_data;
+    GstSample * sample   = NULL;
+
+    g_signal_emit_by_name(appsink, "pull-sample", &sample);
+    if (sample == NULL) { return GST_FLOW_EOS; }
+
+    GstBuffer * buffer = gst_sample_get_buffer(sample);
+    if (buffer == NULL) {
+        gst_sample_unref(sample);
+        return GST_FLOW_OK;
+    }
+
+    DvrEntry * entry = g_new0(DvrEntry, 1);
+    entry->sample    = sample;
+    entry->time      = GST_BUFFER_DTS_IS_VALID(buffer) ? GST_BUFFER_DTS(buffer) : GST_BUFFER_PTS(buffer);
+    entry->size      = gst_buffer_get_size(buffer);
+    entry->keyframe  = !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+    g_mutex_lock(&dvr_ring->lock);
+    /* The ring always starts on a keyframe, so that any part of it can be decoded */
+    if (!GST_CLOCK_TIME_IS_VALID(entry->time) || (g_queue_is_empty(&dvr_ring->entries) && !entry->keyframe)) {
+        dvr_entry_free(entry);
+    }
+    else {
+        g_queue_push_tail(&dvr_ring->entries, entry);
+        if (entry->keyframe) { g_queue_push_tail(&dvr_ring->keyframes, g_queue_peek_tail_link(&dvr_ring->entries)); }
+        dvr_ring->bytes += entry->size;
+        evict_locked(dvr_ring);
+    }
+    g_mutex_unlock(&dvr_ring->lock);
+
+    return GST_FLOW_OK;
+}
+
+/* Evict whole GOPs from the front, while over one of the limits */
+static void evict_locked(DvrRing * dvr_ring)
+{
+    while (g_queue_get_length(&dvr_ring->keyframes) > 1
+           && (dvr_ring->bytes > dvr_ring->max_bytes || duration_locked(dvr_ring) > dvr_ring->max_duration)) {
+        GList * next_gop = g_queue_peek_nth(&dvr_ring->keyframes, 1);
+
+        while (dvr_ring->entries.head != next_gop) {
+            DvrEntry * entry = g_queue_pop_head(&dvr_ring->entries);
+            dvr_ring->bytes -= entry->size;
+            dvr_entry_free(entry);
+        }
+        g_queue_pop_head(&dvr_ring->keyframes);
+    }
+}
+
+static GstClockTime duration_locked(DvrRing * dvr_ring)
+{
+    if (g_queue_is_empty(&dvr_ring->entries)) { return 0; }
+
+    DvrEntry * first = g_queue_peek_head(&dvr_ring->entries);
+    DvrEntry * last  = g_queue_peek_tail(&dvr_ring->entries);
+    return last->time > first->time ? last->time - first->time : 0;
+}
+
+static void dvr_entry_free(DvrEntry * entry)
+{
+    gst_sample_unref(entry->sample);
+    g_free(entry);
+}
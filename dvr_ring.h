@@ -0,0 +1,31 @@
+#ifndef _DVR_RING__H_
+#define _DVR_RING__H_
+
+#include <gst/gst.h>
+
+/* In-memory DVR of the already encoded video.                                     */
+/* The encoded access units (and their caps) are pulled from an appsink into a    */
+/* time-indexed ring, bounded by bytes and duration. The ring always starts on a  */
+/* keyframe, so any time range in it can be exported to MP4 by remuxing only.     */
+/* All times are running times of the main pipeline (i.e. the encoded timestamps). */
+typedef struct _DvrRing DvrRing;
+
+/* @appsink is fed by a branch of the encoded stream, it gets configured here */
+DvrRing * dvr_ring_new(GstElement * appsink);
+
+void dvr_ring_set_limits(DvrRing * dvr_ring, guint64 max_bytes, GstClockTime max_duration);
+
+/* Time range currently available. Returns FALSE if the ring is empty. */
+gboolean dvr_ring_get_range(DvrRing * dvr_ring, GstClockTime * start, GstClockTime * end);
+
+/* Remux the range [@start, @end] into an MP4 file at @path. Blocks until the file is written (or  */
+/* for up to 30 s), i.e. not to be called from the main loop. The clip starts on the last keyframe */
+/* before @start.                                                                                  */
+gboolean dvr_ring_export(DvrRing * dvr_ring, GstClockTime start, GstClockTime end, const gchar * path);
+
+void dvr_ring_free(DvrRing * dvr_ring);
+
+/* Add the DVR metrics to @stats (fields prefixed with "dvr-") */
+void dvr_ring_fill_stats(DvrRing * dvr_ring, GstStructure * stats);
+
+#endif /* _DVR_RING__H_ */
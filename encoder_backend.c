@@ -0,0 +1,136 @@
+#include "encoder_backend.h"
+
+#include <string.h>
+
+static const gchar * preset_names[ENCODER_PRESET_COUNT] = {"low-latency", "quality"};
+
+/* x264 low-latency are the settings the stream has always used */
+static const EncoderBackend backends[] = {
+    {"x264",
+     "x264enc",
+     "bitrate",
+     1,
+     "key-int-max",
+     {"threads=0 tune=zerolatency", "threads=0 speed-preset=slow bframes=3 b-adapt=true"},
+     TRUE,
+     NULL},
+    {"openh264",
+     "openh264enc",
+     "bitrate",
+     1000,
+     "gop-size",
+     {"rate-control=bitrate complexity=low", "rate-control=bitrate complexity=high"},
+     TRUE,
+     "h264parse"}, /* outputs byte-stream only, FLV needs avc */
+    {"x265",
+     "x265enc",
+     "bitrate",
+     1,
+     "key-int-max",
+     {"tune=zerolatency speed-preset=veryfast", "speed-preset=slow"},
+     FALSE,
+     NULL},
+    {"vp9",
+     "vp9enc",
+     "target-bitrate",
+     1000,
+     "keyframe-max-dist",
+     {"deadline=1 cpu-used=8 lag-in-frames=0 row-mt=true end-usage=cbr", "deadline=0 cpu-used=2 row-mt=true"},
+     FALSE,
+     NULL},
+    {"svt-av1", "svtav1enc", "target-bitrate", 1, "intra-period-length", {"preset=12", "preset=6"}, FALSE, NULL},
+};
+
+static void apply_settings(GstElement * encoder, const gchar * settings);
+
+const EncoderBackend * encoder_backend_get(guint index)
+{
+    return index < G_N_ELEMENTS(backends) ? &backends[index] : NULL;
+}
+
+const EncoderBackend * encoder_backend_find(const gchar * name)
+{
+    g_return_val_if_fail(name != NULL, NULL);
+
+    for (guint i = 0; i < G_N_ELEMENTS(backends); i++) {
+        if (strcmp(backends[i].name, name) == 0) { return &backends[i]; }
+    }
+
+    return NULL;
+}
+
+gboolean encoder_backend_is_available(const EncoderBackend * backend)
+{
+    g_return_val_if_fail(backend != NULL, FALSE);
+
+    GstElementFactory * factory = gst_element_factory_find(backend->factory);
+    if (factory == NULL) { return FALSE; }
+    gst_object_unref(factory);
+
+    return TRUE;
+}
+
+GstElement * encoder_backend_create(const EncoderBackend * backend,
+                                    EncoderPreset          preset,
+                                    guint                  bitrate,
+                                    guint                  keyframe_interval,
+                                    const gchar *          name)
+{
+    g_return_val_if_fail(backend != NULL && preset < ENCODER_PRESET_COUNT, NULL);
+
+    GstElement * encoder = gst_element_factory_make(backend->factory, name);
+    if (encoder == NULL) { return NULL; }
+
+    g_object_set(encoder, backend->keyframe_property, keyframe_interval, NULL);
+    encoder_backend_set_bitrate(backend, encoder, bitrate);
+    apply_settings(encoder, backend->presets[preset]);
+
+    return encoder;
+}
+
+void encoder_backend_set_bitrate(const EncoderBackend * backend, GstElement * encoder, guint bitrate)
+{
+    g_return_if_fail(backend != NULL && encoder != NULL);
+
+    g_object_set(encoder, backend->bitrate_property, bitrate * backend->bitrate_scale, NULL);
+}
+
+gboolean encoder_preset_from_name(const gchar * name, EncoderPreset * preset)
+{
+    g_return_val_if_fail(preset != NULL, FALSE);
+
+    for (guint i = 0; i < ENCODER_PRESET_COUNT; i++) {
+        if (g_strcmp0(name, preset_names[i]) == 0) {
+            *preset = i;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+const gchar * encoder_preset_get_name(EncoderPreset preset)
+{
+    g_return_val_if_fail(preset < ENCODER_PRESET_COUNT, NULL);
+    return preset_names[preset];
+}
+
+/* private functions' definitions */
+
+/* Settings the installed version of the encoder doesn't know are skipped */
+static void apply_settings(GstElement * encoder, const gchar * settings)
+{
+    gchar ** pairs = g_strsplit(settings, " ", -1);
+
+    for (guint i = 0; pairs[i] != NULL; i++) {
+        gchar ** pair = g_strsplit(pairs[i], "=", 2);
+        if (g_object_class_find_property(G_OBJECT_GET_CLASS(encoder), pair[0]) != NULL) {
+            gst_util_set_object_arg(G_OBJECT(encoder), pair[0], pair[1]);
+        }
+        else {
+            g_printerr("The installed %s has no '%s' property, ignoring it.\n", G_OBJECT_TYPE_NAME(encoder), pair[0]);
+        }
+        g_strfreev(pair);
+    }
+    g_strfreev(pairs);
+}
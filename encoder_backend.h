@@ -0,0 +1,50 @@
+#ifndef _ENCODER_BACKEND__H_
+#define _ENCODER_BACKEND__H_
+
+#include <gst/gst.h>
+
+/* Software video encoders the mix can be encoded with, each with a low-latency and a quality preset. */
+/* Which of them are usable depends on the GStreamer plugins installed, see encoder_backend_is_available(). */
+
+typedef enum {
+    ENCODER_PRESET_LOW_LATENCY, /* fast settings without lookahead, for live streaming */
+    ENCODER_PRESET_QUALITY,     /* slower settings with lookahead, for a better quality per bit */
+    ENCODER_PRESET_COUNT,
+} EncoderPreset;
+
+typedef struct {
+    const gchar * name;    /* e.g. "x264" */
+    const gchar * factory; /* of the encoder element */
+    const gchar * bitrate_property;
+    guint         bitrate_scale; /* units of the bitrate property per kbit/s */
+    const gchar * keyframe_property;
+    /* Space separated "property=value" settings of each preset */
+    const gchar * presets[ENCODER_PRESET_COUNT];
+    gboolean      flv;    /* can be muxed into FLV, i.e. streamed to Twitch */
+    const gchar * parser; /* needed between the encoder and the FLV muxer, if any */
+} EncoderBackend;
+
+/* Backend by index, NULL past the last one */
+const EncoderBackend * encoder_backend_get(guint index);
+
+/* NULL if there is no backend called @name */
+const EncoderBackend * encoder_backend_find(const gchar * name);
+
+gboolean encoder_backend_is_available(const EncoderBackend * backend);
+
+/* Create an encoder of @backend for @preset, @bitrate (in kbit/s) and a keyframe every @keyframe_interval frames. */
+/* NULL if the backend isn't available. */
+GstElement * encoder_backend_create(const EncoderBackend * backend,
+                                    EncoderPreset          preset,
+                                    guint                  bitrate,
+                                    guint                  keyframe_interval,
+                                    const gchar *          name);
+
+/* Change the bitrate (in kbit/s) of an encoder created by @backend, also while encoding */
+void encoder_backend_set_bitrate(const EncoderBackend * backend, GstElement * encoder, guint bitrate);
+
+/* "low-latency" or "quality". FALSE if @name is neither. */
+gboolean      encoder_preset_from_name(const gchar * name, EncoderPreset * preset);
+const gchar * encoder_preset_get_name(EncoderPreset preset);
+
+#endif /* _ENCODER_BACKEND__H_ */
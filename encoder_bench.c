@@ -0,0 +1,453 @@
+#include "encoder_backend.h"
+
+#include <glib.h>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+/* Encodes a reference mix with each encoder backend, and reports the bitrate needed to reach a given quality */
+/* (PSNR of the decoded video against the mix), with the encoding speed & CPU time at that bitrate.           */
+
+#define BENCH_FRAMERATE 25
+#define BENCH_KEYFRAME_INTERVAL 30 /* as for the stream */
+#define BENCH_MIN_BITRATE 100      /* kbit/s */
+#define BENCH_MAX_BITRATE 20000
+#define BENCH_SEARCH_STEPS 6
+#define BENCH_MAX_PSNR 100.0 /* for identical frames */
+#define BENCH_POLL_INTERVAL (100 * GST_MSECOND)
+
+typedef struct {
+    gdouble bitrate; /* as measured, in kbit/s */
+    gdouble psnr;
+    gdouble fps;
+    gdouble cpu_seconds;
+} BenchResult;
+
+/* Input parameters */
+static int     width       = 1280;
+static int     height      = 720;
+static int     frames      = 250;
+static gchar * encoders    = "";
+static gchar * preset_name = "";
+static double  target_psnr = 38.0;
+static int     bitrate     = 0;
+
+static GOptionEntry entries[] = {
+    {"width", 'w', 0, G_OPTION_ARG_INT, &width, "Width of the reference mix", NULL},
+    {"height", 'h', 0, G_OPTION_ARG_INT, &height, "Height of the reference mix", NULL},
+    {"frames", 'n', 0, G_OPTION_ARG_INT, &frames, "Length of the reference mix, in frames", NULL},
+    {"encoders",
+     'e',
+     0,
+     G_OPTION_ARG_STRING,
+     &encoders,
+     "Comma separated backends to measure (x264, openh264, x265, vp9, svt-av1), all by default",
+     NULL},
+    {"preset", 'p', 0, G_OPTION_ARG_STRING, &preset_name, "low-latency or quality, both by default", NULL},
+    {"psnr", 'q', 0, G_OPTION_ARG_DOUBLE, &target_psnr, "Quality to reach, in dB", NULL},
+    {"bitrate",
+     'b',
+     0,
+     G_OPTION_ARG_INT,
+     &bitrate,
+     "Measure at this bitrate (kbit/s) instead of searching for the target quality",
+     NULL},
+    {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL},
+};
+
+static GstCaps *    raw_caps(gint mix_width, gint mix_height);
+static GstElement * add_reference_mix(GstElement * pipeline);
+static gboolean     run_to_eos(GstElement * pipeline);
+static gboolean     pop_error(GstElement * pipeline);
+static gdouble      cpu_time(void);
+
+static gboolean measure_speed(const EncoderBackend * backend, EncoderPreset preset, guint kbps, BenchResult * result);
+static gboolean measure_quality(const EncoderBackend * backend, EncoderPreset preset, guint kbps, BenchResult * result);
+static void     bench_backend(const EncoderBackend * backend, EncoderPreset preset, const BenchResult * baseline);
+
+static GstPadProbeReturn cb_count_bytes(GstPad * pad, GstPadProbeInfo * info, gpointer user_data);
+static void              cb_decoded_pad_added(GstElement * decodebin, GstPad * new_pad, GstElement * convert);
+
+static void add_frame_error(GstSample * reference, GstSample * decoded, guint64 * error, guint64 * samples);
+
+int main(int argc, char * argv[])
+{
+    GError *         error       = NULL;
+    GOptionContext * context     = g_option_context_new(" Measure the video encoders on a reference mix");
+    BenchResult      baseline;
+    EncoderPreset    only_preset = ENCODER_PRESET_COUNT;
+
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("option parsing failed: %s\n", error->message);
+        exit(1);
+    }
+    g_option_context_free(context);
+    if (strlen(preset_name) != 0 && !encoder_preset_from_name(preset_name, &only_preset)) {
+        g_printerr("Unknown preset '%s'. Rerun with '--help'.\n", preset_name);
+        exit(1);
+    }
+    if (width <= 0 || height <= 0 || frames <= 0) {
+        g_printerr("The size & length of the reference mix must be positive.\n");
+        exit(1);
+    }
+
+    gst_init(&argc, &argv);
+
+    /* What generating the mix costs by itself, included in the speed of each encoder */
+    if (!measure_speed(NULL, ENCODER_PRESET_LOW_LATENCY, 0, &baseline)) { exit(1); }
+    g_print("Reference mix: %dx%d, %d frames at %d fps, generated at %.1f fps using %.2f CPU-s\n",
+            width,
+            height,
+            frames,
+            BENCH_FRAMERATE,
+            baseline.fps,
+            baseline.cpu_seconds);
+    if (bitrate == 0) { g_print("Lowest bitrate reaching a PSNR of %.1f dB:\n", target_psnr); }
+    g_print("%-10s %-12s %12s %10s %10s %10s\n", "encoder", "preset", "kbit/s", "PSNR (dB)", "fps", "CPU-s");
+
+    gchar ** names = g_strsplit(encoders, ",", -1);
+    for (guint i = 0; encoder_backend_get(i) != NULL; i++) {
+        const EncoderBackend * backend = encoder_backend_get(i);
+        if (names[0] != NULL && !g_strv_contains((const gchar * const *)names, backend->name)) { continue; }
+
+        if (!encoder_backend_is_available(backend)) {
+            g_print("%-10s not available (%s is not installed)\n", backend->name, backend->factory);
+            continue;
+        }
+        for (guint preset = 0; preset < ENCODER_PRESET_COUNT; preset++) {
+            if (only_preset == ENCODER_PRESET_COUNT || only_preset == preset) {
+                bench_backend(backend, preset, &baseline);
+            }
+        }
+    }
+    g_strfreev(names);
+
+    gst_deinit();
+    return 0;
+}
+
+static void bench_backend(const EncoderBackend * backend, EncoderPreset preset, const BenchResult * baseline)
+{
+    BenchResult result;
+    BenchResult attempt;
+    guint       kbps = bitrate != 0 ? (guint)bitrate : BENCH_MAX_BITRATE;
+
+    if (!measure_quality(backend, preset, kbps, &result)) { return; }
+
+    /* Bisect (on a log scale) for the lowest bitrate which still reaches the target */
+    if (bitrate == 0 && result.psnr >= target_psnr) {
+        gdouble low  = BENCH_MIN_BITRATE;
+        gdouble high = BENCH_MAX_BITRATE;
+        for (guint step = 0; step < BENCH_SEARCH_STEPS; step++) {
+            guint middle = (guint)sqrt(low * high);
+            if (!measure_quality(backend, preset, middle, &attempt)) { return; }
+            if (attempt.psnr >= target_psnr) {
+                high   = middle;
+                kbps   = middle;
+                result = attempt;
+            }
+            else {
+                low = middle;
+            }
+        }
+    }
+
+    if (!measure_speed(backend, preset, kbps, &attempt)) { return; }
+    result.fps         = attempt.fps;
+    result.cpu_seconds = MAX(attempt.cpu_seconds - baseline->cpu_seconds, 0.0);
+
+    g_print("%-10s %-12s %12.0f %10.2f %10.1f %10.2f%s\n",
+            backend->name,
+            encoder_preset_get_name(preset),
+            result.bitrate,
+            result.psnr,
+            result.fps,
+            result.cpu_seconds,
+            bitrate == 0 && result.psnr < target_psnr ? "  (target not reached)" : "");
+}
+
+/* Encode the mix as fast as possible, without a backend only generate it */
+static gboolean measure_speed(const EncoderBackend * backend, EncoderPreset preset, guint kbps, BenchResult * result)
+{
+    GstElement * pipeline = gst_pipeline_new("speed");
+    GstElement * mix      = add_reference_mix(pipeline);
+    GstElement * queue    = gst_element_factory_make("queue", NULL);
+    GstElement * encoder  = NULL;
+    GstElement * sink     = gst_element_factory_make("fakesink", NULL);
+    gboolean     success  = FALSE;
+
+    g_object_set(sink, "sync", FALSE, NULL);
+    gst_bin_add_many(GST_BIN(pipeline), queue, sink, NULL);
+    if (backend != NULL) {
+        encoder = encoder_backend_create(backend, preset, kbps, BENCH_KEYFRAME_INTERVAL, NULL);
+        gst_bin_add(GST_BIN(pipeline), encoder);
+    }
+
+    if (!gst_element_link_many(mix, queue, NULL)
+        || !(encoder != NULL ? gst_element_link_many(queue, encoder, sink, NULL) : gst_element_link(queue, sink))) {
+        g_printerr("Could not link the %s encoder.\n", backend != NULL ? backend->name : "reference");
+    }
+    else {
+        gint64  started   = g_get_monotonic_time();
+        gdouble cpu_start = cpu_time();
+
+        success             = run_to_eos(pipeline);
+        result->fps         = frames / ((g_get_monotonic_time() - started) / (gdouble)G_USEC_PER_SEC);
+        result->cpu_seconds = cpu_time() - cpu_start;
+    }
+
+    gst_object_unref(pipeline);
+    return success;
+}
+
+/* Encode the mix at @kbps & decode it again, comparing each decoded frame with the original one */
+static gboolean measure_quality(const EncoderBackend * backend, EncoderPreset preset, guint kbps, BenchResult * result)
+{
+    GstElement * pipeline        = gst_pipeline_new("quality");
+    GstElement * mix             = add_reference_mix(pipeline);
+    GstElement * tee             = gst_element_factory_make("tee", NULL);
+    GstElement * queue_reference = gst_element_factory_make("queue", NULL);
+    GstElement * sink_reference  = gst_element_factory_make("appsink", NULL);
+    GstElement * queue_encoder   = gst_element_factory_make("queue", NULL);
+    GstElement * encoder         = encoder_backend_create(backend, preset, kbps, BENCH_KEYFRAME_INTERVAL, NULL);
+    GstElement * decodebin       = gst_element_factory_make("decodebin", NULL);
+    GstElement * convert         = gst_element_factory_make("videoconvert", NULL);
+    GstElement * capsfilter      = gst_element_factory_make("capsfilter", NULL);
+    GstElement * sink_decoded    = gst_element_factory_make("appsink", NULL);
+    GstCaps *    caps            = raw_caps(width, height);
+    guint64      encoded_bytes   = 0;
+    guint64      error           = 0;
+    guint64      samples         = 0;
+    gboolean     failed          = FALSE;
+
+    /* The encoder lags behind by its lookahead, so the reference frames must never block the mix */
+    g_object_set(queue_reference, "max-size-buffers", 0, "max-size-bytes", 0, "max-size-time", (guint64)0, NULL);
+    g_object_set(sink_reference, "sync", FALSE, NULL);
+    g_object_set(sink_decoded, "sync", FALSE, NULL);
+    g_object_set(capsfilter, "caps", caps, NULL);
+    gst_caps_unref(caps);
+
+    gst_bin_add_many(GST_BIN(pipeline),
+                     tee,
+                     queue_reference,
+                     sink_reference,
+                     queue_encoder,
+                     encoder,
+                     decodebin,
+                     convert,
+                     capsfilter,
+                     sink_decoded,
+                     NULL);
+    if (!gst_element_link_many(mix, tee, queue_reference, sink_reference, NULL)
+        || !gst_element_link_many(tee, queue_encoder, encoder, decodebin, NULL)
+        || !gst_element_link_many(convert, capsfilter, sink_decoded, NULL)) {
+        g_printerr("Could not link the %s encoder.\n", backend->name);
+        gst_object_unref(pipeline);
+        return FALSE;
+    }
+    g_signal_connect(decodebin, "pad-added", G_CALLBACK(cb_decoded_pad_added), convert);
+
+    GstPad * encoded_pad = gst_element_get_static_pad(encoder, "src");
+    gst_pad_add_probe(encoded_pad, GST_PAD_PROBE_TYPE_BUFFER, cb_count_bytes, &encoded_bytes, NULL);
+    gst_object_unref(encoded_pad);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    while (!failed) {
+        GstSample * decoded   = NULL;
+        GstSample * reference = NULL;
+        gboolean    eos       = FALSE;
+
+        g_signal_emit_by_name(sink_decoded, "try-pull-sample", BENCH_POLL_INTERVAL, &decoded);
+        if (decoded == NULL) {
+            g_object_get(sink_decoded, "eos", &eos, NULL);
+            if (eos) { break; }
+            failed = pop_error(pipeline);
+            continue;
+        }
+
+        /* Decoders output every frame they are given, in order */
+        g_signal_emit_by_name(sink_reference, "pull-sample", &reference);
+        if (reference != NULL) {
+            add_frame_error(reference, decoded, &error, &samples);
+            gst_sample_unref(reference);
+        }
+        gst_sample_unref(decoded);
+    }
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    if (failed || samples == 0) {
+        g_printerr("Measuring %s at %u kbit/s failed.\n", backend->name, kbps);
+        return FALSE;
+    }
+
+    result->bitrate = encoded_bytes * 8.0 / 1000.0 / ((gdouble)frames / BENCH_FRAMERATE);
+    result->psnr    = error == 0 ? BENCH_MAX_PSNR : 10.0 * log10(255.0 * 255.0 / ((gdouble)error / samples));
+    result->psnr    = MIN(result->psnr, BENCH_MAX_PSNR);
+
+    return TRUE;
+}
+
+static GstCaps * raw_caps(gint mix_width, gint mix_height)
+{
+    return gst_caps_new_simple("video/x-raw",
+                               "format",
+                               G_TYPE_STRING,
+                               "I420",
+                               "framerate",
+                               GST_TYPE_FRACTION,
+                               BENCH_FRAMERATE,
+                               1,
+                               "pixel-aspect-ratio",
+                               GST_TYPE_FRACTION,
+                               1,
+                               1,
+                               "width",
+                               G_TYPE_INT,
+                               mix_width,
+                               "height",
+                               G_TYPE_INT,
+                               mix_height,
+                               NULL);
+}
+
+/* Three moving test patterns in the default layout, as a stand-in for the real inputs. Returns the last element. */
+static GstElement * add_reference_mix(GstElement * pipeline)
+{
+    const gchar * patterns[3]     = {"smpte", "ball", "circular"};
+    const gint    positions[3][2] = {{0, height / 4}, {width / 2, 0}, {width / 2, height / 2}};
+    GstElement *  mixer           = gst_element_factory_make("compositor", NULL);
+    GstElement *  capsfilter      = gst_element_factory_make("capsfilter", NULL);
+    GstCaps *     caps            = raw_caps(width, height);
+
+    g_object_set(mixer, "background", 1 /* black */, NULL);
+    g_object_set(capsfilter, "caps", caps, NULL);
+    gst_caps_unref(caps);
+    gst_bin_add_many(GST_BIN(pipeline), mixer, capsfilter, NULL);
+    gst_element_link(mixer, capsfilter);
+
+    caps = raw_caps(width / 2, height / 2);
+    for (guint i = 0; i < 3; i++) {
+        GstElement * source = gst_element_factory_make("videotestsrc", NULL);
+        GstElement * filter = gst_element_factory_make("capsfilter", NULL);
+
+        gst_util_set_object_arg(G_OBJECT(source), "pattern", patterns[i]);
+        g_object_set(source, "num-buffers", frames, "horizontal-speed", (gint)(i + 1) * 2, NULL);
+        g_object_set(filter, "caps", caps, NULL);
+        gst_bin_add_many(GST_BIN(pipeline), source, filter, NULL);
+        gst_element_link_many(source, filter, mixer, NULL);
+
+        GstPad * pad  = gst_element_get_static_pad(filter, "src");
+        GstPad * peer = gst_pad_get_peer(pad);
+        g_object_set(peer, "xpos", positions[i][0], "ypos", positions[i][1], NULL);
+        gst_object_unref(peer);
+        gst_object_unref(pad);
+    }
+    gst_caps_unref(caps);
+
+    return capsfilter;
+}
+
+static gboolean run_to_eos(GstElement * pipeline)
+{
+    GstBus *     bus     = gst_element_get_bus(pipeline);
+    GstMessage * message = NULL;
+    gboolean     success = FALSE;
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    message = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+    success = GST_MESSAGE_TYPE(message) == GST_MESSAGE_EOS;
+    gst_message_unref(message);
+    gst_object_unref(bus);
+    if (!success) { pop_error(pipeline); }
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+
+    return success;
+}
+
+/* Print the pending error of @pipeline, if any */
+static gboolean pop_error(GstElement * pipeline)
+{
+    GstBus *     bus     = gst_element_get_bus(pipeline);
+    GstMessage * message = gst_bus_pop_filtered(bus, GST_MESSAGE_ERROR);
+    gst_object_unref(bus);
+    if (message == NULL) { return FALSE; }
+
+    GError * err  = NULL;
+    gchar *  name = gst_object_get_path_string(GST_MESSAGE_SRC(message));
+    gst_message_parse_error(message, &err, NULL);
+    g_printerr("ERROR: from element %s: %s\n", name, err->message);
+    g_error_free(err);
+    g_free(name);
+    gst_message_unref(message);
+
+    return TRUE;
+}
+
+/* User & system CPU time of the whole process (i.e. all the streaming threads), in seconds */
+static gdouble cpu_time(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+           + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / (gdouble)G_USEC_PER_SEC;
+}
+
+static GstPadProbeReturn cb_count_bytes(GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+    guint64 * bytes = user_data;
+    *bytes += gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info));
+    return GST_PAD_PROBE_OK;
+}
+
+static void cb_decoded_pad_added(GstElement * decodebin, GstPad * new_pad, GstElement * convert)
+{
+    GstPad * sink_pad = gst_element_get_static_pad(convert, "sink");
+    if (!gst_pad_is_linked(sink_pad) && gst_pad_link(new_pad, sink_pad) != GST_PAD_LINK_OK) {
+        g_printerr("Could not link the decoder.\n");
+    }
+    gst_object_unref(sink_pad);
+}
+
+/* Sum of the squared differences over all the planes (i.e. Y, U & V weighted by their size) */
+static void add_frame_error(GstSample * reference, GstSample * decoded, guint64 * error, guint64 * samples)
+{
+    GstVideoInfo  reference_info;
+    GstVideoInfo  decoded_info;
+    GstVideoFrame reference_frame;
+    GstVideoFrame decoded_frame;
+
+    /* Same format & size, the strides may differ though */
+    if (!gst_video_info_from_caps(&reference_info, gst_sample_get_caps(reference))
+        || !gst_video_info_from_caps(&decoded_info, gst_sample_get_caps(decoded))) {
+        return;
+    }
+    if (!gst_video_frame_map(&reference_frame, &reference_info, gst_sample_get_buffer(reference), GST_MAP_READ)) {
+        return;
+    }
+    if (!gst_video_frame_map(&decoded_frame, &decoded_info, gst_sample_get_buffer(decoded), GST_MAP_READ)) {
+        gst_video_frame_unmap(&reference_frame);
+        return;
+    }
+
+    for (guint component = 0; component < GST_VIDEO_INFO_N_COMPONENTS(&reference_info); component++) {
+        for (gint y = 0; y < GST_VIDEO_FRAME_COMP_HEIGHT(&reference_frame, component); y++) {
+            const guint8 * a = GST_VIDEO_FRAME_COMP_DATA(&reference_frame, component)
+                               + y * GST_VIDEO_FRAME_COMP_STRIDE(&reference_frame, component);
+            const guint8 * b = GST_VIDEO_FRAME_COMP_DATA(&decoded_frame, component)
+                               + y * GST_VIDEO_FRAME_COMP_STRIDE(&decoded_frame, component);
+            for (gint x = 0; x < GST_VIDEO_FRAME_COMP_WIDTH(&reference_frame, component); x++) {
+                gint difference = a[x] - b[x];
+                *error += difference * difference;
+            }
+            *samples += GST_VIDEO_FRAME_COMP_WIDTH(&reference_frame, component);
+        }
+    }
+
+    gst_video_frame_unmap(&decoded_frame);
+    gst_video_frame_unmap(&reference_frame);
+}
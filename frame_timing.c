@@ -0,0 +1,112 @@
+#include "frame_timing.h"
+
+#include <string.h>
+
+#define FRAME_TIMING_BUCKET_WIDTH (100 * GST_USECOND)
+#define FRAME_TIMING_BUCKETS 2000 /* up to 200 ms, longer frame times all land in the last bucket */
+
+struct _FrameTiming {
+    GstPad * pad;
+    gulong   probe_id;
+
+    GMutex       lock;
+    gint64       last_frame; /* monotonic time, in us */
+    guint64      count;
+    GstClockTime max;
+    guint64      buckets[FRAME_TIMING_BUCKETS];
+};
+
+static GstPadProbeReturn cb_frame_probe(GstPad * pad, GstPadProbeInfo * info, gpointer user_data);
+static GstClockTime      percentile(FrameTiming * timing, guint percent);
+
+FrameTiming * frame_timing_new(GstPad * pad)
+{
+    g_return_val_if_fail(pad != NULL, NULL);
+
+    FrameTiming * timing = g_new0(FrameTiming, 1);
+    timing->pad          = gst_object_ref(pad);
+    g_mutex_init(&timing->lock);
+    timing->probe_id = gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, cb_frame_probe, timing, NULL);
+
+    return timing;
+}
+
+void frame_timing_reset(FrameTiming * timing)
+{
+    g_return_if_fail(timing != NULL);
+
+    g_mutex_lock(&timing->lock);
+    timing->last_frame = 0;
+    timing->count      = 0;
+    timing->max        = 0;
+    memset(timing->buckets, 0, sizeof(timing->buckets));
+    g_mutex_unlock(&timing->lock);
+}
+
+void frame_timing_free(FrameTiming * timing)
+{
+    g_return_if_fail(timing != NULL);
+
+    gst_pad_remove_probe(timing->pad, timing->probe_id);
+    gst_object_unref(timing->pad);
+    g_mutex_clear(&timing->lock);
+    g_free(timing);
+}
+
+void frame_timing_fill_stats(FrameTiming * timing, GstStructure * stats)
+{
+    g_return_if_fail(timing != NULL && stats != NULL);
+
+    g_mutex_lock(&timing->lock);
+    gst_structure_set(stats,
+                      "frame-time-count",
+                      G_TYPE_UINT64,
+                      timing->count,
+                      "frame-time-p50",
+                      G_TYPE_UINT64,
+                      percentile(timing, 50),
+                      "frame-time-p99",
+                      G_TYPE_UINT64,
+                      percentile(timing, 99),
+                      "frame-time-max",
+                      G_TYPE_UINT64,
+                      timing->max,
+                      NULL);
+    g_mutex_unlock(&timing->lock);
+}
+
+/* private functions' definitions */
+
+static GstPadProbeReturn cb_frame_probe(GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+    FrameTiming * timing = user_data;
+    gint64        now    = g_get_monotonic_time();
+
+    g_mutex_lock(&timing->lock);
+    if (timing->last_frame != 0) {
+        GstClockTime frame_time = (now - timing->last_frame) * GST_USECOND;
+        guint        bucket     = MIN(frame_time / FRAME_TIMING_BUCKET_WIDTH, FRAME_TIMING_BUCKETS - 1);
+        timing->buckets[bucket]++;
+        timing->count++;
+        timing->max = MAX(timing->max, frame_time);
+    }
+    timing->last_frame = now;
+    g_mutex_unlock(&timing->lock);
+
+    return GST_PAD_PROBE_OK;
+}
+
+/* Upper bound of the bucket holding the percentile, called with the lock held */
+static GstClockTime percentile(FrameTiming * timing, guint percent)
+{
+    guint64 rank = (timing->count * percent + 99) / 100;
+    guint64 seen = 0;
+
+    if (timing->count == 0) { return 0; }
+    for (guint bucket = 0; bucket < FRAME_TIMING_BUCKETS; bucket++) {
+        seen += timing->buckets[bucket];
+        if (seen >= rank) { return MIN((bucket + 1) * FRAME_TIMING_BUCKET_WIDTH, timing->max); }
+    }
+
+    return timing->max;
+}
@@ -0,0 +1,21 @@
+#ifndef _FRAME_TIMING__H_
+#define _FRAME_TIMING__H_
+
+#include <gst/gst.h>
+
+/* Distribution of the frame times at a pad, i.e. the wall clock time between */
+/* consecutive buffers. Spikes show up in the high percentiles.               */
+typedef struct _FrameTiming FrameTiming;
+
+/* Start measuring the buffers passing through @pad */
+FrameTiming * frame_timing_new(GstPad * pad);
+
+/* Forget the frames measured so far, e.g. once warmed up */
+void frame_timing_reset(FrameTiming * timing);
+
+void frame_timing_free(FrameTiming * timing);
+
+/* Add the frame time percentiles to @stats (fields prefixed with "frame-time-", in ns) */
+void frame_timing_fill_stats(FrameTiming * timing, GstStructure * stats);
+
+#endif /* _FRAME_TIMING__H_ */
@@ -1,7 +1,17 @@
 #include "gst_helpers.h"
 
-void scale_input_videos(GstreamerData * data, int output_width, int output_height);
-void setup_video_mixer_pads(GstreamerData * data, int output_width, int output_height);
+#include <string.h>
+
+#define STREAMING_KEYFRAME_INTERVAL 30 /* frames, where the replay buffer & catching up can cut the stream */
+
+void setup_video_mixer_pads(GstreamerData * data);
+
+static gboolean          create_input_audio(GstreamerData * data, guint index);
+static void              update_audio_bypass(GstreamerData * data);
+static GstPadProbeReturn cb_audio_caps(GstPad * pad, GstPadProbeInfo * info, gpointer user_data);
+static GstPadProbeReturn cb_route_input_audio(GstPad * pad, GstPadProbeInfo * info, gpointer user_data);
+static GstPadProbeReturn cb_end_audio_bed(GstPad * pad, GstPadProbeInfo * info, gpointer user_data);
+static gint              find_audio_input(GstreamerData * data, GstPad * pad);
 
 /* Manually clean unused Gst Elements if not streaming to Twitch */
 /* TODO Create them on-demand instead of eagerly*/
@@ -11,16 +21,47 @@ GstreamerData create_data()
 {
     GstreamerData data;
     /* Create the elements */
-    data.decodebin1         = gst_element_factory_make("uridecodebin3", "decodebin1");
-    data.decodebin2         = gst_element_factory_make("uridecodebin3", "decodebin2");
-    data.decodebin3         = gst_element_factory_make("uridecodebin3", "decodebin3");
-    data.videoscale1        = gst_element_factory_make("videoscale", "videobox1");
-    data.videoscale2        = gst_element_factory_make("videoscale", "videobox2");
-    data.videoscale3        = gst_element_factory_make("videoscale", "videobox3");
-    data.video_scaled_caps1 = gst_element_factory_make("capsfilter", "video_scaled_capsfilter1");
-    data.video_scaled_caps2 = gst_element_factory_make("capsfilter", "video_scaled_capsfilter2");
-    data.video_scaled_caps3 = gst_element_factory_make("capsfilter", "video_scaled_capsfilter3");
-    data.video_mixer        = gst_element_factory_make("videomixer", "videomixer");
+    data.decodebin1       = gst_element_factory_make("uridecodebin3", "decodebin1");
+    data.decodebin2       = gst_element_factory_make("uridecodebin3", "decodebin2");
+    data.decodebin3       = gst_element_factory_make("uridecodebin3", "decodebin3");
+    data.queue_jitter1    = gst_element_factory_make("queue", "queue_jitter1");
+    data.queue_jitter2    = gst_element_factory_make("queue", "queue_jitter2");
+    data.queue_jitter3    = gst_element_factory_make("queue", "queue_jitter3");
+    /* compositor (unlike videomixer) can time out on late live inputs, see setup_input_buffering(), */
+    /* and scales the inputs itself                                                                  */
+    data.video_mixer      = gst_element_factory_make("compositor", "videomixer");
+    data.video_mixer_caps = gst_element_factory_make("capsfilter", "video_mixer_capsfilter");
+    data.video_mixer_pad1 = NULL;
+    data.video_mixer_pad2 = NULL;
+    data.video_mixer_pad3 = NULL;
+
+    /* Audio mixing, see create_audio_elements() */
+    for (guint i = 0; i < 3; i++) {
+        data.queue_audio_jitter[i]  = NULL;
+        data.audioconvert[i]        = NULL;
+        data.audioresample[i]       = NULL;
+        data.audio_mixer_pads[i]    = NULL;
+        data.audio_selector_pads[i] = NULL;
+        data.audio_volumes[i]       = 1.0;
+        data.audio_mutes[i]         = FALSE;
+    }
+    data.audio_bypass            = -1;
+    data.audio_bed               = NULL;
+    data.audio_mixer             = NULL;
+    data.audio_mixer_caps        = NULL;
+    data.audio_selector          = NULL;
+    data.audio_selector_mix_pad  = NULL;
+    data.audio_tee               = NULL;
+    data.queue_audio_preview     = NULL;
+    data.sink_audio_preview      = NULL;
+    data.queue_audio_streaming   = NULL;
+    data.audio_convert_streaming = NULL;
+    data.audio_encoder_streaming = NULL;
+    data.queue_audio_encoded     = NULL;
+
+    data.input_recoveries[0] = NULL;
+    data.input_recoveries[1] = NULL;
+    data.input_recoveries[2] = NULL;
 
     data.tee = gst_element_factory_make("tee", "tee");
 
@@ -29,31 +70,89 @@ GstreamerData create_data()
     data.convert_preview = gst_element_factory_make("videoconvert", "convert_preview");
     data.sink_preview    = gst_element_factory_make("autovideosink", "sink_preview");
 
+    /* Snapshots */
+    data.queue_snapshot = gst_element_factory_make("queue", "queue_snapshot");
+    data.sink_snapshot  = gst_element_factory_make("appsink", "sink_snapshot");
+
     /* Twitch streaming */
     data.queue_streaming         = gst_element_factory_make("queue", "queue_streaming");
-    data.video_encoder_streaming = gst_element_factory_make("x264enc", "encoder_streaming");
+    data.video_encoder_streaming = NULL; /* depends on the chosen backend, see create_video_encoder() */
+    data.video_parser_streaming  = NULL;
     data.queue_encoded           = gst_element_factory_make("queue", "queue_encoded");
     data.muxer_streaming         = gst_element_factory_make("flvmux", "muxer_streaming");
     data.queue_muxed             = gst_element_factory_make("queue", "queue_muxed");
-    data.sink_rtmp               = gst_element_factory_make("rtmpsink", "sink_streaming");
+    data.sink_streaming          = gst_element_factory_make("appsink", "sink_streaming");
+    data.encoded_tee             = gst_element_factory_make("tee", "encoded_tee");
+    data.queue_dvr               = gst_element_factory_make("queue", "queue_dvr");
+    data.sink_dvr                = gst_element_factory_make("appsink", "sink_dvr");
 
     data.pipeline = gst_pipeline_new("pipeline");
 
     if (!data.pipeline || !data.decodebin1 || !data.decodebin2 || !data.decodebin3 //
-        || !data.videoscale1 || !data.videoscale2 || !data.videoscale3 || !data.video_scaled_caps1
-        || !data.video_scaled_caps2 || !data.video_scaled_caps3 || !data.video_mixer || !data.tee //
-        || !data.convert_preview || !data.queue_preview || !data.sink_preview ||                  //
-        !data.queue_streaming || !data.video_encoder_streaming || !data.queue_encoded || !data.muxer_streaming
-        || !data.queue_muxed || !data.sink_rtmp) {
+        || !data.video_mixer || !data.video_mixer_caps || !data.tee                //
+        || !data.convert_preview || !data.queue_preview || !data.sink_preview ||   //
+        !data.queue_streaming || !data.queue_encoded || !data.muxer_streaming || !data.queue_muxed
+        || !data.sink_streaming || !data.encoded_tee || !data.queue_dvr || !data.sink_dvr || !data.queue_snapshot
+        || !data.sink_snapshot || !data.queue_jitter1 || !data.queue_jitter2 || !data.queue_jitter3) {
         g_printerr("Not all elements could be created.\n");
         exit(1);
     }
+    /* Owned by the ThreeVideoStream (references handed out through its "gst-pipeline" property are extra ones) */
+    gst_object_ref_sink(data.pipeline);
 
     return data;
 }
 
+void create_audio_elements(GstreamerData * data, gboolean with_twitch)
+{
+    g_return_if_fail(data != NULL);
+
+    data->audio_bed           = gst_element_factory_make("audiotestsrc", "audio_bed");
+    data->audio_mixer         = gst_element_factory_make("audiomixer", "audiomixer");
+    data->audio_mixer_caps    = gst_element_factory_make("capsfilter", "audio_mixer_capsfilter");
+    data->audio_selector      = gst_element_factory_make("input-selector", "audio_selector");
+    data->queue_audio_preview = gst_element_factory_make("queue", "queue_audio_preview");
+    data->sink_audio_preview  = gst_element_factory_make("autoaudiosink", "sink_audio_preview");
+    if (with_twitch) {
+        data->audio_tee               = gst_element_factory_make("tee", "audio_tee");
+        data->queue_audio_streaming   = gst_element_factory_make("queue", "queue_audio_streaming");
+        data->audio_convert_streaming = gst_element_factory_make("audioconvert", "audio_convert_streaming");
+        data->audio_encoder_streaming = gst_element_factory_make("avenc_aac", "audio_encoder_streaming");
+        data->queue_audio_encoded     = gst_element_factory_make("queue", "queue_audio_encoded");
+    }
+
+    if (!data->audio_bed || !data->audio_mixer || !data->audio_mixer_caps || !data->audio_selector
+        || !data->queue_audio_preview || !data->sink_audio_preview
+        || (with_twitch
+            && (!data->audio_tee || !data->queue_audio_streaming || !data->audio_convert_streaming
+                || !data->audio_encoder_streaming || !data->queue_audio_encoded))) {
+        g_printerr("Not all audio elements could be created (is gst-libav installed?), try without audio.\n");
+        exit(1);
+    }
+
+    /* Fix the mixing format, so that only the inputs which differ from it get converted */
+    GstCaps * audio_mix_caps = gst_caps_new_simple("audio/x-raw",
+                                                   "format",
+                                                   G_TYPE_STRING,
+                                                   "F32LE",
+                                                   "rate",
+                                                   G_TYPE_INT,
+                                                   48000,
+                                                   "channels",
+                                                   G_TYPE_INT,
+                                                   2,
+                                                   "layout",
+                                                   G_TYPE_STRING,
+                                                   "interleaved",
+                                                   NULL);
+    g_object_set(data->audio_mixer_caps, "caps", audio_mix_caps, NULL);
+    gst_caps_unref(audio_mix_caps);
+
+    /* Marked as gap, so the mixer skips it */
+    g_object_set(data->audio_bed, "wave", 4 /* silence */, NULL);
+}
 
-void link_pipeline_elements(GstreamerData * data, gboolean with_twitch)
+void link_pipeline_elements(GstreamerData * data, gboolean with_twitch, gboolean with_audio)
 {
     g_return_if_fail(data != NULL);
 
@@ -66,59 +165,118 @@ void link_pipeline_elements(GstreamerData * data, gboolean with_twitch)
                      data->decodebin1,
                      data->decodebin2,
                      data->decodebin3,
-                     data->videoscale1,
-                     data->videoscale2,
-                     data->videoscale3,
-                     data->video_scaled_caps1,
-                     data->video_scaled_caps2,
-                     data->video_scaled_caps3,
+                     data->queue_jitter1,
+                     data->queue_jitter2,
+                     data->queue_jitter3,
                      data->video_mixer,
+                     data->video_mixer_caps,
+                     data->tee,
+                     data->queue_preview,
                      data->convert_preview,
                      data->sink_preview,
+                     data->queue_snapshot,
+                     data->sink_snapshot,
                      NULL);
 
-    if (!gst_element_link(data->videoscale1, data->video_scaled_caps1)
-        || !gst_element_link(data->videoscale2, data->video_scaled_caps2)
-        || !gst_element_link(data->videoscale3, data->video_scaled_caps3)) {
+    if (!gst_element_link_many(data->video_mixer, data->video_mixer_caps, data->tee, NULL)
+        || !gst_element_link_many(data->tee, data->queue_preview, data->convert_preview, data->sink_preview, NULL)
+        || !gst_element_link_many(data->tee, data->queue_snapshot, data->sink_snapshot, NULL)) {
         error = TRUE;
     }
 
     if (with_twitch) {
         gst_bin_add_many(GST_BIN(data->pipeline),
-                         data->tee,
-                         data->queue_preview,
                          data->queue_streaming,
                          data->video_encoder_streaming,
+                         data->encoded_tee,
                          data->queue_encoded,
                          data->muxer_streaming,
                          data->queue_muxed,
-                         data->sink_rtmp,
+                         data->sink_streaming,
+                         data->queue_dvr,
+                         data->sink_dvr,
                          NULL);
 
+        /* Some encoders need their output converted for the muxer */
+        GstElement * encoded = data->video_encoder_streaming;
+        if (data->video_parser_streaming != NULL) {
+            gst_bin_add(GST_BIN(data->pipeline), data->video_parser_streaming);
+            if (!gst_element_link(encoded, data->video_parser_streaming)) { error = TRUE; }
+            encoded = data->video_parser_streaming;
+        }
+
         g_print("Linking GStreamer elements for live preview and Twitch streaming .\n");
-        if (!gst_element_link_many(data->video_mixer, data->tee, NULL)
-            || !gst_element_link_many(data->tee,
-                                      data->queue_streaming,
-                                      data->video_encoder_streaming,
+        if (!gst_element_link_many(data->tee, data->queue_streaming, data->video_encoder_streaming, NULL)
+            || !gst_element_link_many(encoded,
+                                      data->encoded_tee,
                                       data->queue_encoded,
                                       data->muxer_streaming,
                                       data->queue_muxed,
-                                      data->sink_rtmp,
+                                      data->sink_streaming,
                                       NULL)
-            || !gst_element_link_many(data->tee,
-                                      data->queue_preview,
-                                      data->convert_preview,
-                                      data->sink_preview,
-                                      NULL)) {
+            || !gst_element_link_many(data->encoded_tee, data->queue_dvr, data->sink_dvr, NULL)) {
             error = TRUE;
         }
     }
     else {
         g_print("Linking the elements without Twitch streaming part.\n");
-        if (!gst_element_link_many(data->video_mixer, data->convert_preview, data->sink_preview, NULL)) {
+    }
+
+    if (with_audio) {
+        gst_bin_add_many(GST_BIN(data->pipeline),
+                         data->audio_bed,
+                         data->audio_mixer,
+                         data->audio_mixer_caps,
+                         data->audio_selector,
+                         data->queue_audio_preview,
+                         data->sink_audio_preview,
+                         NULL);
+
+        /* The inputs are linked to the mixer as they expose audio, see get_input_audio_sink() */
+        GstCaps * audio_mix_caps = NULL;
+        g_object_get(data->audio_mixer_caps, "caps", &audio_mix_caps, NULL);
+        data->audio_selector_mix_pad = gst_element_get_request_pad(data->audio_selector, "sink_%u");
+        GstPad * mix_pad             = gst_element_get_static_pad(data->audio_mixer_caps, "src");
+        if (!gst_element_link_filtered(data->audio_bed, data->audio_mixer, audio_mix_caps)
+            || !gst_element_link(data->audio_mixer, data->audio_mixer_caps)
+            || gst_pad_link(mix_pad, data->audio_selector_mix_pad) != GST_PAD_LINK_OK) {
             error = TRUE;
         }
+        g_object_set(data->audio_selector, "active-pad", data->audio_selector_mix_pad, NULL);
+        gst_object_unref(mix_pad);
+        gst_caps_unref(audio_mix_caps);
+
+        if (with_twitch) {
+            gst_bin_add_many(GST_BIN(data->pipeline),
+                             data->audio_tee,
+                             data->queue_audio_streaming,
+                             data->audio_convert_streaming,
+                             data->audio_encoder_streaming,
+                             data->queue_audio_encoded,
+                             NULL);
+
+            g_print("Linking GStreamer elements for audio preview and streaming.\n");
+            if (!gst_element_link_many(data->audio_selector, data->audio_tee, NULL)
+                || !gst_element_link_many(data->audio_tee,
+                                          data->queue_audio_streaming,
+                                          data->audio_convert_streaming,
+                                          data->audio_encoder_streaming,
+                                          data->queue_audio_encoded,
+                                          data->muxer_streaming,
+                                          NULL)
+                || !gst_element_link_many(data->audio_tee, data->queue_audio_preview, data->sink_audio_preview, NULL)) {
+                error = TRUE;
+            }
+        }
+        else {
+            g_print("Linking GStreamer elements for audio preview.\n");
+            if (!gst_element_link_many(
+                    data->audio_selector, data->queue_audio_preview, data->sink_audio_preview, NULL)) {
+                error = TRUE;
+            }
+        }
     }
+
     if (error) {
         g_printerr("Elements could not be linked.\n");
         gst_object_unref(data->pipeline);
@@ -132,55 +290,302 @@ void setup_video_placement(GstreamerData * data, int output_width, int output_he
 
     g_object_set(data->video_mixer, "background", 1, NULL); /* set black background beneath */
 
-    scale_input_videos(data, output_width, output_height);
-    setup_video_mixer_pads(data, output_width, output_height);
+    /* Fixed regardless of the inputs & the layout, so nothing downstream ever renegotiates */
+    GstCaps * mix_caps = gst_caps_new_simple("video/x-raw",
+                                             "format",
+                                             G_TYPE_STRING,
+                                             "I420",
+                                             "framerate",
+                                             GST_TYPE_FRACTION,
+                                             25,
+                                             1,
+                                             "pixel-aspect-ratio",
+                                             GST_TYPE_FRACTION,
+                                             1,
+                                             1,
+                                             "width",
+                                             G_TYPE_INT,
+                                             output_width,
+                                             "height",
+                                             G_TYPE_INT,
+                                             output_height,
+                                             NULL);
+    g_object_set(data->video_mixer_caps, "caps", mix_caps, NULL);
+    gst_caps_unref(mix_caps);
+
+    setup_video_mixer_pads(data);
+}
+
+void setup_audio_mixing(GstreamerData * data)
+{
+    g_return_if_fail(data != NULL && data->audio_bed != NULL);
+
+    /* The bed would keep the audio, and so the pipeline, running forever otherwise */
+    GstPad * mix_pad = gst_element_get_static_pad(data->video_mixer, "src");
+    gst_pad_add_probe(mix_pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, cb_end_audio_bed, data, NULL);
+    gst_object_unref(mix_pad);
+}
+
+void setup_audio_mix(GstreamerData * data, const gdouble volumes[3], const gboolean mutes[3])
+{
+    g_return_if_fail(data != NULL);
+
+    g_mutex_lock(&data->audio_lock);
+    for (guint i = 0; i < 3; i++) {
+        data->audio_volumes[i] = volumes[i];
+        data->audio_mutes[i]   = mutes[i];
+        if (data->audio_mixer_pads[i] != NULL) {
+            g_object_set(data->audio_mixer_pads[i], "volume", volumes[i], "mute", mutes[i], NULL);
+        }
+    }
+    g_mutex_unlock(&data->audio_lock);
+
+    update_audio_bypass(data);
 }
 
-void setup_file_sources(GstreamerData * data, gchar * file_path1, gchar * file_path2, gchar * filepath3)
+void setup_input_buffering(GstreamerData * data, const guint jitter[3], guint mixer_timeout)
 {
     g_return_if_fail(data != NULL);
-    g_return_if_fail(file_path1 != NULL || file_path2 != NULL || filepath3 != NULL);
-
-    gchar * uri1 = g_strjoin("", "file://", file_path1, NULL);
-    gchar * uri2 = g_strjoin("", "file://", file_path2, NULL);
-    gchar * uri3 = g_strjoin("", "file://", filepath3, NULL);
-    g_object_set(data->decodebin1, "uri", uri1, NULL);
-    g_object_set(data->decodebin2, "uri", uri2, NULL);
-    g_object_set(data->decodebin3, "uri", uri3, NULL);
-    g_free(uri1);
-    g_free(uri2);
-    g_free(uri3);
+
+    g_mutex_lock(&data->audio_lock);
+    for (guint i = 0; i < 3; i++) {
+        /* The queue holds back min-threshold-time worth of data, and adds it to the min latency it reports */
+        guint64 threshold = jitter[i] * GST_MSECOND;
+        g_object_set(get_input_video_queue(data, i),
+                     "min-threshold-time",
+                     threshold,
+                     "max-size-time",
+                     threshold + GST_SECOND,
+                     "max-size-buffers",
+                     0,
+                     "max-size-bytes",
+                     0,
+                     NULL);
+        /* Audio is delayed by the same amount to keep the input in sync, see create_input_audio() too */
+        if (data->queue_audio_jitter[i] != NULL) {
+            g_object_set(data->queue_audio_jitter[i],
+                         "min-threshold-time",
+                         threshold,
+                         "max-size-time",
+                         threshold + GST_SECOND,
+                         "max-size-buffers",
+                         0,
+                         "max-size-bytes",
+                         0,
+                         NULL);
+        }
+    }
+    g_mutex_unlock(&data->audio_lock);
+
+    /* Only applies to live inputs: once the deadline passes, the mix is output using the last frame of the late */
+    /* inputs (and silence for their audio) */
+    g_object_set(data->video_mixer, "latency", mixer_timeout * GST_MSECOND, NULL);
+    if (data->audio_mixer != NULL) { g_object_set(data->audio_mixer, "latency", mixer_timeout * GST_MSECOND, NULL); }
+
+    /* Have the sinks pick up the new latency if already running. Recalculated by the application from the main */
+    /* loop (GST_MESSAGE_LATENCY), as this may run between two frames of the mix.                               */
+    gst_element_post_message(data->pipeline, gst_message_new_latency(GST_OBJECT(data->pipeline)));
 }
 
-void setup_twitch_streaming(GstreamerData * data, gchar * twitch_api_key, gchar * twitch_server)
+void setup_input_sources(GstreamerData * data, gchar * location1, gchar * location2, gchar * location3)
 {
     g_return_if_fail(data != NULL);
-    g_return_if_fail(twitch_api_key != NULL || twitch_server != NULL);
+    g_return_if_fail(location1 != NULL && location2 != NULL && location3 != NULL);
+
+    gchar * locations[3] = {location1, location2, location3};
+    for (guint i = 0; i < 3; i++) {
+        gchar * uri = get_input_uri(locations[i]);
+        if (uri == NULL) { continue; }
+
+        g_object_set(*get_input_decodebin(data, i), "uri", uri, NULL);
+        g_free(uri);
+    }
+}
+
+gchar * get_input_uri(const gchar * location)
+{
+    g_return_val_if_fail(location != NULL, NULL);
+
+    GError * error = NULL;
+    gchar *  uri   = NULL;
+
+    if (gst_uri_is_valid(location)) { uri = g_strdup(location); }
+    else {
+        uri = gst_filename_to_uri(location, &error);
+    }
+    if (uri == NULL) {
+        g_printerr("Invalid input '%s': %s\n", location, error->message);
+        g_error_free(error);
+    }
+
+    return uri;
+}
+
+void setup_input_source(GstreamerData * data, GstElement * source, gchar * const caps[3], const guint jitter[3])
+{
+    g_return_if_fail(data != NULL && source != NULL);
 
-    /* Set the parameters for the Twitch stream */
-    g_object_set(data->video_encoder_streaming, "threads", 0, NULL);
-    g_object_set(data->video_encoder_streaming, "bitrate", 400, NULL);
-    g_object_set(data->video_encoder_streaming, "tune", 4, NULL);
-    g_object_set(data->video_encoder_streaming, "key-int-max", 30, NULL);
+    GstElementFactory * factory = gst_element_get_factory(source);
+    const gchar *       name    = factory != NULL ? GST_OBJECT_NAME(factory) : "";
+    GstObject *         parent  = gst_object_get_parent(GST_OBJECT(source));
+    gint                index   = -1;
 
+    if (strcmp(name, "udpsrc") != 0 && strcmp(name, "rtpsrc") != 0) {
+        if (parent != NULL) { gst_object_unref(parent); }
+        return;
+    }
+
+    /* The udpsrc of an rtpsrc is configured by the rtpsrc */
+    factory = parent != NULL && GST_IS_ELEMENT(parent) ? gst_element_get_factory(GST_ELEMENT(parent)) : NULL;
+    if (factory != NULL && strcmp(GST_OBJECT_NAME(factory), "rtpsrc") == 0) {
+        gst_object_unref(parent);
+        return;
+    }
+
+    for (GstObject * object = parent; object != NULL;) {
+        for (guint i = 0; i < 3; i++) {
+            if (object == (GstObject *)*get_input_decodebin(data, i)) { index = i; }
+        }
+        GstObject * next = gst_object_get_parent(object);
+        gst_object_unref(object);
+        object = next;
+    }
+    if (index < 0 || caps[index] == NULL) { return; }
+
+    GstCaps * hint = gst_caps_from_string(caps[index]);
+    if (hint == NULL) { return; }
+    if (g_object_class_find_property(G_OBJECT_GET_CLASS(source), "caps") != NULL) {
+        g_object_set(source, "caps", hint, NULL);
+    }
+    else if (gst_caps_get_size(hint) > 0) {
+        /* Older rtpsrc only take the encoding name, and derive the caps from it */
+        const gchar * encoding_name = gst_structure_get_string(gst_caps_get_structure(hint, 0), "encoding-name");
+        if (encoding_name != NULL) { g_object_set(source, "encoding-name", encoding_name, NULL); }
+    }
+    if (strcmp(name, "rtpsrc") == 0 && jitter[index] > 0) { g_object_set(source, "latency", jitter[index], NULL); }
+    gst_caps_unref(hint);
+}
+
+void setup_twitch_streaming(GstreamerData * data)
+{
+    g_return_if_fail(data != NULL);
+
+    /* Set the parameters for the Twitch stream, the video encoder is set up by create_video_encoder() */
     g_object_set(data->muxer_streaming, "streamable", TRUE, NULL);
 
-    gchar * location = g_strjoin("", twitch_server, twitch_api_key, NULL);
-    g_object_set(data->sink_rtmp, "location", location, NULL);
-    g_free(location);
+    /* The replay buffer must never hold back the streaming branch */
+    g_object_set(data->queue_dvr, "leaky", 2 /* downstream */, NULL);
+
+    /* Keep the audio queues bounded by time only, the same amount as the (default) video queues */
+    if (data->audio_encoder_streaming != NULL) {
+        g_object_set(data->queue_audio_streaming, "max-size-buffers", 0, "max-size-bytes", 0, NULL);
+        g_object_set(data->queue_audio_encoded, "max-size-buffers", 0, "max-size-bytes", 0, NULL);
+        g_object_set(data->audio_encoder_streaming, "bitrate", 128000, NULL);
+    }
+}
+
+void create_video_encoder(GstreamerData * data, const EncoderBackend * backend, EncoderPreset preset, guint bitrate)
+{
+    g_return_if_fail(data != NULL && backend != NULL);
+
+    data->video_encoder_streaming
+        = encoder_backend_create(backend, preset, bitrate, STREAMING_KEYFRAME_INTERVAL, "encoder_streaming");
+    if (backend->parser != NULL) {
+        data->video_parser_streaming = gst_element_factory_make(backend->parser, "parser_streaming");
+    }
+
+    if (data->video_encoder_streaming == NULL || (backend->parser != NULL && data->video_parser_streaming == NULL)) {
+        g_printerr("The %s encoder could not be created, is its GStreamer plugin installed?\n", backend->name);
+        exit(1);
+    }
 }
 
 void clean_unused_streaming_gst_elements(GstreamerData * data)
 {
     g_return_if_fail(data != NULL);
-    gst_object_unref(data->tee);
-    gst_object_unref(data->queue_preview);
     gst_object_unref(data->queue_streaming);
-    gst_object_unref(data->video_encoder_streaming);
+    if (data->video_encoder_streaming != NULL) { gst_object_unref(data->video_encoder_streaming); }
+    if (data->video_parser_streaming != NULL) { gst_object_unref(data->video_parser_streaming); }
     gst_object_unref(data->queue_encoded);
     gst_object_unref(data->muxer_streaming);
     gst_object_unref(data->queue_muxed);
-    gst_object_unref(data->sink_rtmp);
+    gst_object_unref(data->sink_streaming);
+    gst_object_unref(data->encoded_tee);
+    gst_object_unref(data->queue_dvr);
+    gst_object_unref(data->sink_dvr);
+}
+
+GstElement ** get_input_decodebin(GstreamerData * data, guint index)
+{
+    g_return_val_if_fail(data != NULL && index < 3, NULL);
+    GstElement ** decodebins[3] = {&data->decodebin1, &data->decodebin2, &data->decodebin3};
+    return decodebins[index];
+}
+
+GstElement * get_input_video_queue(GstreamerData * data, guint index)
+{
+    g_return_val_if_fail(data != NULL && index < 3, NULL);
+    GstElement * queues[3] = {data->queue_jitter1, data->queue_jitter2, data->queue_jitter3};
+    return queues[index];
+}
+
+GstPad * get_input_audio_sink(GstreamerData * data, guint index)
+{
+    g_return_val_if_fail(data != NULL && index < 3, NULL);
+
+    if (data->audio_mixer == NULL) { return NULL; }
+
+    g_mutex_lock(&data->audio_lock);
+    gboolean created = data->queue_audio_jitter[index] != NULL || create_input_audio(data, index);
+    GstPad * sink    = created ? gst_element_get_static_pad(data->queue_audio_jitter[index], "sink") : NULL;
+    g_mutex_unlock(&data->audio_lock);
+
+    return sink;
+}
+
+void remove_input_audio(GstreamerData * data, guint index)
+{
+    g_return_if_fail(data != NULL && index < 3);
+
+    GstElement * chain[3]     = {NULL, NULL, NULL};
+    GstPad *     mixer_pad    = NULL;
+    GstPad *     selector_pad = NULL;
+
+    g_mutex_lock(&data->audio_lock);
+    chain[0]                         = data->queue_audio_jitter[index];
+    chain[1]                         = data->audioconvert[index];
+    chain[2]                         = data->audioresample[index];
+    mixer_pad                        = data->audio_mixer_pads[index];
+    selector_pad                     = data->audio_selector_pads[index];
+    data->queue_audio_jitter[index]  = NULL;
+    data->audioconvert[index]        = NULL;
+    data->audioresample[index]       = NULL;
+    data->audio_mixer_pads[index]    = NULL;
+    data->audio_selector_pads[index] = NULL;
+    if (data->audio_bypass == (gint)index) {
+        data->audio_bypass = -1;
+        g_object_set(data->audio_selector, "active-pad", data->audio_selector_mix_pad, NULL);
+    }
+    g_mutex_unlock(&data->audio_lock);
+
+    if (chain[0] == NULL) { return; }
+
+    /* Removing them from the pipeline unlinks their pads */
+    for (guint i = 0; i < 3; i++) {
+        gst_element_set_state(chain[i], GST_STATE_NULL);
+        gst_bin_remove(GST_BIN(data->pipeline), chain[i]);
+    }
+    if (mixer_pad != NULL) {
+        gst_element_release_request_pad(data->audio_mixer, mixer_pad);
+        gst_object_unref(mixer_pad);
+    }
+    if (selector_pad != NULL) {
+        gst_element_release_request_pad(data->audio_selector, selector_pad);
+        gst_object_unref(selector_pad);
+    }
+
+    /* Another input may be the only one heard now */
+    update_audio_bypass(data);
 }
 
 void try_change_pipeline_state(GstElement * pipeline, GstState state)
@@ -195,69 +600,223 @@ void try_change_pipeline_state(GstElement * pipeline, GstState state)
 
 /* private functions' definitions */
 
-void scale_input_videos(GstreamerData * data, int output_width, int output_height)
+void setup_video_mixer_pads(GstreamerData * data)
 {
-    GstCaps * videocaps_half = gst_caps_new_simple("video/x-raw",
-                                                   "format",
-                                                   G_TYPE_STRING,
-                                                   "I420",
-                                                   "framerate",
-                                                   GST_TYPE_FRACTION,
-                                                   25,
-                                                   1,
-                                                   "pixel-aspect-ratio",
-                                                   GST_TYPE_FRACTION,
-                                                   1,
-                                                   1,
-                                                   "width",
-                                                   G_TYPE_INT,
-                                                   output_width / 2,
-                                                   "height",
-                                                   G_TYPE_INT,
-                                                   output_height / 2,
-                                                   NULL);
+    /* Manually link the mixer, which has "Request" pads */
+    GstPad *video1_pad, *video2_pad, *video3_pad = NULL;
 
+    data->video_mixer_pad1 = gst_element_get_request_pad(data->video_mixer, "sink_%u");
+    data->video_mixer_pad2 = gst_element_get_request_pad(data->video_mixer, "sink_%u");
+    data->video_mixer_pad3 = gst_element_get_request_pad(data->video_mixer, "sink_%u");
 
-    g_object_set(data->video_scaled_caps1, "caps", videocaps_half, NULL);
-    g_object_set(data->video_scaled_caps2, "caps", videocaps_half, NULL);
-    g_object_set(data->video_scaled_caps3, "caps", videocaps_half, NULL);
-    gst_caps_unref(videocaps_half);
-}
+    video1_pad = gst_element_get_static_pad(data->queue_jitter1, "src");
+    video2_pad = gst_element_get_static_pad(data->queue_jitter2, "src");
+    video3_pad = gst_element_get_static_pad(data->queue_jitter3, "src");
 
-void setup_video_mixer_pads(GstreamerData * data, int output_width, int output_height)
-{
-    /* Manually link the videomixer, which has "Request" pads */
-    GstPad *videomixer_pad1, *video1_pad = NULL;
-    GstPad *videomixer_pad2, *video2_pad = NULL;
-    GstPad *videomixer_pad3, *video3_pad = NULL;
-
-    videomixer_pad1 = gst_element_get_request_pad(data->video_mixer, "sink_%u");
-    videomixer_pad2 = gst_element_get_request_pad(data->video_mixer, "sink_%u");
-    videomixer_pad3 = gst_element_get_request_pad(data->video_mixer, "sink_%u");
-
-    video1_pad = gst_element_get_static_pad(data->video_scaled_caps1, "src");
-    video2_pad = gst_element_get_static_pad(data->video_scaled_caps2, "src");
-    video3_pad = gst_element_get_static_pad(data->video_scaled_caps3, "src");
-
-    if (gst_pad_link(video1_pad, videomixer_pad1) != GST_PAD_LINK_OK
-        || gst_pad_link(video2_pad, videomixer_pad2) != GST_PAD_LINK_OK
-        || gst_pad_link(video3_pad, videomixer_pad3) != GST_PAD_LINK_OK) {
+    if (gst_pad_link(video1_pad, data->video_mixer_pad1) != GST_PAD_LINK_OK
+        || gst_pad_link(video2_pad, data->video_mixer_pad2) != GST_PAD_LINK_OK
+        || gst_pad_link(video3_pad, data->video_mixer_pad3) != GST_PAD_LINK_OK) {
         g_printerr("Videomixer could not be linked.\n");
         gst_object_unref(data->pipeline);
         exit(1);
     }
 
-    g_object_set(videomixer_pad1, "xpos", 0, NULL);
-    g_object_set(videomixer_pad1, "ypos", output_height / 4, NULL);
-    g_object_set(videomixer_pad2, "xpos", output_width / 2, NULL);
-    g_object_set(videomixer_pad2, "ypos", 0, NULL);
-    g_object_set(videomixer_pad3, "xpos", output_width / 2, NULL);
-    g_object_set(videomixer_pad3, "ypos", output_height / 2, NULL);
-
-    gst_object_unref(videomixer_pad1);
-    gst_object_unref(videomixer_pad2);
-    gst_object_unref(videomixer_pad3);
     gst_object_unref(video1_pad);
     gst_object_unref(video2_pad);
     gst_object_unref(video3_pad);
 }
+
+/* With the audio lock held */
+static gboolean create_input_audio(GstreamerData * data, guint index)
+{
+    gchar *      queue_name    = g_strdup_printf("queue_audio_jitter%u", index + 1);
+    gchar *      convert_name  = g_strdup_printf("audioconvert%u", index + 1);
+    gchar *      resample_name = g_strdup_printf("audioresample%u", index + 1);
+    GstElement * queue         = gst_element_factory_make("queue", queue_name);
+    GstElement * convert       = gst_element_factory_make("audioconvert", convert_name);
+    GstElement * resample      = gst_element_factory_make("audioresample", resample_name);
+
+    g_free(queue_name);
+    g_free(convert_name);
+    g_free(resample_name);
+    if (queue == NULL || convert == NULL || resample == NULL) {
+        g_printerr("The audio of input %u could not be set up, ignoring it.\n", index + 1);
+        if (queue != NULL) { gst_object_unref(queue); }
+        if (convert != NULL) { gst_object_unref(convert); }
+        if (resample != NULL) { gst_object_unref(resample); }
+        return FALSE;
+    }
+
+    /* Delayed by as much as the video of the input, see setup_input_buffering() */
+    guint64 threshold = 0;
+    g_object_get(get_input_video_queue(data, index), "min-threshold-time", &threshold, NULL);
+    g_object_set(queue,
+                 "min-threshold-time",
+                 threshold,
+                 "max-size-time",
+                 threshold + GST_SECOND,
+                 "max-size-buffers",
+                 0,
+                 "max-size-bytes",
+                 0,
+                 NULL);
+
+    /* Conversion only happens if the decoded format differs from the mixer's, */
+    /* otherwise audioconvert & audioresample work in passthrough mode */
+    gst_bin_add_many(GST_BIN(data->pipeline), queue, convert, resample, NULL);
+    data->audio_mixer_pads[index] = gst_element_get_request_pad(data->audio_mixer, "sink_%u");
+    GstPad * resample_pad         = gst_element_get_static_pad(resample, "src");
+    if (!gst_element_link_many(queue, convert, resample, NULL)
+        || gst_pad_link(resample_pad, data->audio_mixer_pads[index]) != GST_PAD_LINK_OK) {
+        g_printerr("The audio of input %u could not be linked to the audiomixer.\n", index + 1);
+    }
+    g_object_set(data->audio_mixer_pads[index],
+                 "volume",
+                 data->audio_volumes[index],
+                 "mute",
+                 data->audio_mutes[index],
+                 NULL);
+
+    /* Whether it can bypass the mixer is only known once its format is */
+    gst_pad_add_probe(resample_pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, cb_audio_caps, data, NULL);
+    gst_object_unref(resample_pad);
+
+    data->queue_audio_jitter[index] = queue;
+    data->audioconvert[index]       = convert;
+    data->audioresample[index]      = resample;
+
+    gst_element_sync_state_with_parent(resample);
+    gst_element_sync_state_with_parent(convert);
+    gst_element_sync_state_with_parent(queue);
+
+    return TRUE;
+}
+
+/* A single input heard at unity gain, already in the mixing format, goes around the mixer: its buffers reach */
+/* the encoder untouched. The mixer keeps running (on the silent bed and the muted inputs), but unused.       */
+static void update_audio_bypass(GstreamerData * data)
+{
+    gint      bypass      = -1;
+    guint     heard       = 0;
+    GstCaps * mix_caps    = NULL;
+    GstPad *  rerouted[2] = {NULL, NULL};
+
+    if (data->audio_mixer == NULL) { return; }
+
+    g_object_get(data->audio_mixer_caps, "caps", &mix_caps, NULL);
+
+    g_mutex_lock(&data->audio_lock);
+    for (guint i = 0; i < 3; i++) {
+        if (data->audioresample[i] == NULL || data->audio_mutes[i]) { continue; }
+        heard++;
+
+        GstPad *  pad  = gst_element_get_static_pad(data->audioresample[i], "src");
+        GstCaps * caps = gst_pad_get_current_caps(pad);
+        if (data->audio_volumes[i] == 1.0 && caps != NULL && gst_caps_is_subset(caps, mix_caps)) { bypass = i; }
+        if (caps != NULL) { gst_caps_unref(caps); }
+        gst_object_unref(pad);
+    }
+    if (heard != 1) { bypass = -1; }
+
+    gint previous      = data->audio_bypass;
+    data->audio_bypass = bypass;
+    if (bypass != previous) {
+        if (previous >= 0 && data->audioresample[previous] != NULL) {
+            rerouted[0] = gst_element_get_static_pad(data->audioresample[previous], "src");
+        }
+        if (bypass >= 0) { rerouted[1] = gst_element_get_static_pad(data->audioresample[bypass], "src"); }
+    }
+    g_mutex_unlock(&data->audio_lock);
+
+    gst_caps_unref(mix_caps);
+
+    /* Relinked once no data flows, which may be right away (on this thread) */
+    for (guint i = 0; i < 2; i++) {
+        if (rerouted[i] == NULL) { continue; }
+        gst_pad_add_probe(rerouted[i], GST_PAD_PROBE_TYPE_IDLE, cb_route_input_audio, data, NULL);
+        gst_object_unref(rerouted[i]);
+    }
+}
+
+static GstPadProbeReturn cb_audio_caps(GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+    if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) == GST_EVENT_CAPS) { update_audio_bypass(user_data); }
+
+    return GST_PAD_PROBE_OK;
+}
+
+/* Link the audio chain of an input to the mixer or around it, whichever is wanted by now */
+static GstPadProbeReturn cb_route_input_audio(GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+    GstreamerData * data = user_data;
+
+    g_mutex_lock(&data->audio_lock);
+    gint index = find_audio_input(data, pad);
+    if (index < 0) {
+        /* Removed meanwhile */
+        g_mutex_unlock(&data->audio_lock);
+        return GST_PAD_PROBE_REMOVE;
+    }
+
+    GstPad * peer = gst_pad_get_peer(pad);
+    if (data->audio_bypass == index && data->audio_selector_pads[index] == NULL) {
+        if (peer != NULL) { gst_pad_unlink(pad, peer); }
+        gst_element_release_request_pad(data->audio_mixer, data->audio_mixer_pads[index]);
+        gst_object_unref(data->audio_mixer_pads[index]);
+        data->audio_mixer_pads[index] = NULL;
+
+        data->audio_selector_pads[index] = gst_element_get_request_pad(data->audio_selector, "sink_%u");
+        if (gst_pad_link(pad, data->audio_selector_pads[index]) != GST_PAD_LINK_OK) {
+            g_printerr("The audio of input %u could not bypass the audiomixer.\n", index + 1);
+        }
+        g_object_set(data->audio_selector, "active-pad", data->audio_selector_pads[index], NULL);
+        g_print("Input %u is the only one heard, bypassing the audiomixer.\n", index + 1);
+    }
+    else if (data->audio_bypass != index && data->audio_mixer_pads[index] == NULL) {
+        g_object_set(data->audio_selector, "active-pad", data->audio_selector_mix_pad, NULL);
+        if (peer != NULL) { gst_pad_unlink(pad, peer); }
+        gst_element_release_request_pad(data->audio_selector, data->audio_selector_pads[index]);
+        gst_object_unref(data->audio_selector_pads[index]);
+        data->audio_selector_pads[index] = NULL;
+
+        data->audio_mixer_pads[index] = gst_element_get_request_pad(data->audio_mixer, "sink_%u");
+        g_object_set(data->audio_mixer_pads[index],
+                     "volume",
+                     data->audio_volumes[index],
+                     "mute",
+                     data->audio_mutes[index],
+                     NULL);
+        if (gst_pad_link(pad, data->audio_mixer_pads[index]) != GST_PAD_LINK_OK) {
+            g_printerr("The audio of input %u could not be linked back to the audiomixer.\n", index + 1);
+        }
+    }
+    if (peer != NULL) { gst_object_unref(peer); }
+    g_mutex_unlock(&data->audio_lock);
+
+    return GST_PAD_PROBE_REMOVE;
+}
+
+static GstPadProbeReturn cb_end_audio_bed(GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+    GstreamerData * data = user_data;
+
+    if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) == GST_EVENT_EOS) {
+        gst_element_send_event(data->audio_bed, gst_event_new_eos());
+    }
+
+    return GST_PAD_PROBE_OK;
+}
+
+/* With the audio lock held. Index of the input whose audio chain ends with @pad, -1 if none does */
+static gint find_audio_input(GstreamerData * data, GstPad * pad)
+{
+    GstObject * parent = gst_pad_get_parent(pad);
+    gint        index  = -1;
+
+    for (guint i = 0; i < 3 && parent != NULL; i++) {
+        if ((GstObject *)data->audioresample[i] == parent) { index = i; }
+    }
+    if (parent != NULL) { gst_object_unref(parent); }
+
+    return index;
+}
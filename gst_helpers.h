@@ -1,48 +1,127 @@
 #ifndef _GST_HELPERS__H_
 #define _GST_HELPERS__H_
 
+#include "encoder_backend.h"
+
 #include <gst/gst.h>
 
+typedef struct _InputRecovery InputRecovery;
+
 /* Structure to contain all our information, so we can pass it to callbacks */
 typedef struct _GstreamerData {
     GstElement * pipeline;
     GstElement * decodebin1;
     GstElement * decodebin2;
     GstElement * decodebin3;
-    GstElement * videoscale1;
-    GstElement * videoscale2;
-    GstElement * videoscale3;
-    GstElement * video_scaled_caps1;
-    GstElement * video_scaled_caps2;
-    GstElement * video_scaled_caps3;
+    /* Per-input jitter buffers, decoupling the inputs from the mixers */
+    GstElement * queue_jitter1;
+    GstElement * queue_jitter2;
+    GstElement * queue_jitter3;
+    /* The inputs are scaled & positioned by the mixer itself, see video_layout.h */
     GstElement * video_mixer;
+    GstElement * video_mixer_caps;
+    GstPad *     video_mixer_pad1;
+    GstPad *     video_mixer_pad2;
+    GstPad *     video_mixer_pad3;
     GstElement * convert_preview;
     GstElement * sink_preview;
-    // XXX Do not call the following if Twitch is not setup
     GstElement * tee;
     GstElement * queue_preview;
+    GstElement * queue_snapshot;
+    GstElement * sink_snapshot; /* appsink, sampled for thumbnails */
+    /* Audio mixing - only created if enabled, see create_audio_elements(). The chain of an input (jitter queue, */
+    /* audioconvert & audioresample) is only created once the input exposes audio, see get_input_audio_sink().  */
+    GMutex       audio_lock;
+    GstElement * queue_audio_jitter[3];
+    GstElement * audioconvert[3];
+    GstElement * audioresample[3];
+    GstPad *     audio_mixer_pads[3];    /* NULL while the input has no audio, or bypasses the mixer */
+    GstPad *     audio_selector_pads[3]; /* set while the input bypasses the mixer */
+    gint         audio_bypass;           /* index of the input bypassing the mixer, -1 if none */
+    gdouble      audio_volumes[3];
+    gboolean     audio_mutes[3];
+    GstElement * audio_bed; /* silence, so that the mix runs whether the inputs have audio or not */
+    GstElement * audio_mixer;
+    GstElement * audio_mixer_caps;
+    GstElement * audio_selector; /* the mix, or the single input heard when it bypasses the mixer */
+    GstPad *     audio_selector_mix_pad;
+    GstElement * audio_tee;
+    GstElement * queue_audio_preview;
+    GstElement * sink_audio_preview;
+    // XXX Do not call the following if Twitch is not setup
     GstElement * queue_streaming;
     GstElement * video_encoder_streaming;
+    GstElement * video_parser_streaming; /* only for some encoders, see EncoderBackend */
     GstElement * queue_encoded;
     GstElement * muxer_streaming;
     GstElement * queue_muxed;
-    GstElement * sink_rtmp;
+    GstElement * sink_streaming; /* appsink, feeding the store-and-forward output stage */
+    GstElement * queue_audio_streaming;
+    GstElement * audio_convert_streaming;
+    GstElement * audio_encoder_streaming;
+    GstElement * queue_audio_encoded;
+    GstElement * encoded_tee;
+    GstElement * queue_dvr;
+    GstElement * sink_dvr; /* appsink, feeding the replay buffer */
+    /* Per-input fault isolation, see input_recovery.h */
+    InputRecovery * input_recoveries[3];
 } GstreamerData;
 
 /* A factory function that creates all necessary GstElements, struct */
 /* Exits on error. */
 GstreamerData create_data();
 
-void link_pipeline_elements(GstreamerData * data, gboolean with_twitch);
+/* Create the audio mixing (and encoding, if @with_twitch) elements, before linking the pipeline. Exits on error. */
+void create_audio_elements(GstreamerData * data, gboolean with_twitch);
 
+void link_pipeline_elements(GstreamerData * data, gboolean with_twitch, gboolean with_audio);
+
+/* Fix the output format of the mix, and link the inputs to the mixer */
 void setup_video_placement(GstreamerData * data, int output_width, int output_height);
 
-void setup_file_sources(GstreamerData * data, gchar * filepath1, gchar * filepath2, gchar * filepath3);
+/* End the silent bed of the audio mix along with the video, once linked */
+void setup_audio_mixing(GstreamerData * data);
+
+/* Apply per-input gain & mute on the audiomixer pads. A single input heard at unity gain, in the format of the */
+/* mix already, bypasses the mixer. Safe to call at runtime, and before the audio chains exist.                 */
+void setup_audio_mix(GstreamerData * data, const gdouble volumes[3], const gboolean mutes[3]);
+
+/* Apply the jitter buffering of each input (in ms) and how long the mixers wait for late live inputs before */
+/* outputting without them (in ms). The added latency is reported in the latency query. Safe to call at runtime, */
+/* only setting properties: a latency message is posted, for the application to recalculate the latency.        */
+void setup_input_buffering(GstreamerData * data, const guint jitter[3], guint mixer_timeout);
 
-void setup_twitch_streaming(GstreamerData * data, gchar * twitch_api_key, gchar * twich_server);
+/* Each location is either a URI (e.g. udp://127.0.0.1:5000) or a file path */
+void setup_input_sources(GstreamerData * data, gchar * location1, gchar * location2, gchar * location3);
+
+/* URI of an input location (see above), NULL if it is invalid */
+gchar * get_input_uri(const gchar * location);
+
+/* Apply the caps hint of its input (@caps, NULL entries for none) to a network source created by a decodebin. */
+/* Some streams can't be typefound, RTP over UDP in particular: for "udp://" locations the hint goes to udpsrc,  */
+/* "rtp://" ones use an rtpsrc, i.e. a jitter buffer in front of the depayloader, with @jitter (in ms) as latency. */
+void setup_input_source(GstreamerData * data, GstElement * source, gchar * const caps[3], const guint jitter[3]);
+
+/* Create the video encoder of the stream, before linking the pipeline. Exits on error. */
+void create_video_encoder(GstreamerData * data, const EncoderBackend * backend, EncoderPreset preset, guint bitrate);
+
+void setup_twitch_streaming(GstreamerData * data);
 
 void clean_unused_streaming_gst_elements(GstreamerData * data);
 
+/* Index based access to the per-input elements (index in range 0..2). The video of an input (or its slate) */
+/* enters the jitter queue through its sink pad, which feeds the mixer from its src pad.                    */
+GstElement ** get_input_decodebin(GstreamerData * data, guint index);
+GstElement *  get_input_video_queue(GstreamerData * data, guint index);
+
+/* Sink pad of the audio chain of the input at @index, creating the chain and linking it to the mixer on first */
+/* use. NULL if audio mixing is disabled. Called from the streaming thread exposing the audio of the input.     */
+GstPad * get_input_audio_sink(GstreamerData * data, guint index);
+
+/* Remove the audio chain of the input at @index, if any, e.g. along with its decodebin (its mixer pad would */
+/* hold the mix back otherwise). From the main loop.                                                          */
+void remove_input_audio(GstreamerData * data, guint index);
+
 /* Try to change pipeline state to desired state */
 /* Exits the program if request cannot be fulfilled */
 void try_change_pipeline_state(GstElement * pipeline, GstState state);
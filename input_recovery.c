@@ -0,0 +1,475 @@
+#include "input_recovery.h"
+
+#define RETRY_INITIAL_DELAY_MS 500
+#define RETRY_MAX_DELAY_MS 30000
+
+struct _InputRecovery {
+    GstreamerData * data;
+    guint           index;
+    GCallback       pad_added_cb;
+
+    /* Set from the bus sync handler, cleared once the decodebin is re-created */
+    gint isolation_pending;
+
+    GMutex       lock;
+    GstBuffer *  last_frame;
+    GstElement * slate;
+    gchar *      uri;
+    gchar *      swap_uri; /* set until the main loop switches the input to it */
+    guint        retry_source_id;
+    guint        retry_delay_ms;
+    GstClockTime resume_offset;
+
+    /* Metrics */
+    gboolean     in_outage;
+    guint        outage_count;
+    GstClockTime outage_started;
+    GstClockTime outage_total;
+    guint        slate_errors; /* of a slate being shown, e.g. the caps of the frozen frame were refused */
+};
+
+static GstPadProbeReturn cb_remember_last_frame(GstPad * pad, GstPadProbeInfo * info, gpointer user_data);
+static gboolean          isolate_input(gpointer user_data);
+static gboolean          retry_input(gpointer user_data);
+static gboolean          swap_input(gpointer user_data);
+static void              remove_decodebin(InputRecovery * recovery);
+static void              show_slate(InputRecovery * recovery);
+static void              create_decodebin(InputRecovery * recovery);
+static gboolean          remove_slate(gpointer user_data);
+static GstElement *      create_slate(InputRecovery * recovery, GstBuffer * last_frame);
+static void              link_slate(InputRecovery * recovery, GstElement * slate);
+static gint              find_input_index(GstObject * src, gboolean * from_slate);
+static GstClockTime      monotonic_time();
+
+InputRecovery * input_recovery_new(GstreamerData * data, guint index, GCallback pad_added_cb)
+{
+    g_return_val_if_fail(data != NULL && index < 3, NULL);
+
+    InputRecovery * recovery = g_new0(InputRecovery, 1);
+    recovery->data           = data;
+    recovery->index          = index;
+    recovery->pad_added_cb   = pad_added_cb;
+    recovery->retry_delay_ms = RETRY_INITIAL_DELAY_MS;
+    recovery->resume_offset  = 0;
+    recovery->outage_started = GST_CLOCK_TIME_NONE;
+    recovery->outage_total   = 0;
+    g_mutex_init(&recovery->lock);
+
+    /* Keep a reference to the latest frame, to freeze it if the input fails */
+    GstPad * queue_pad = gst_element_get_static_pad(get_input_video_queue(data, index), "src");
+    gst_pad_add_probe(queue_pad, GST_PAD_PROBE_TYPE_BUFFER, cb_remember_last_frame, recovery, NULL);
+    gst_object_unref(queue_pad);
+
+    return recovery;
+}
+
+void input_recovery_free(InputRecovery * recovery)
+{
+    g_return_if_fail(recovery != NULL);
+
+    if (recovery->retry_source_id != 0) { g_source_remove(recovery->retry_source_id); }
+    /* A pending isolation or swap */
+    while (g_idle_remove_by_data(recovery)) {}
+    gst_buffer_replace(&recovery->last_frame, NULL);
+    g_free(recovery->uri);
+    g_free(recovery->swap_uri);
+    g_mutex_clear(&recovery->lock);
+    g_free(recovery);
+}
+
+GstBusSyncReply input_recovery_bus_sync_handler(GstBus * bus, GstMessage * message, gpointer user_data)
+{
+    GstreamerData * data       = user_data;
+    gboolean        from_slate = FALSE;
+    gint            index      = -1;
+
+    if (GST_MESSAGE_TYPE(message) != GST_MESSAGE_ERROR) { return GST_BUS_PASS; }
+
+    index = find_input_index(GST_MESSAGE_SRC(message), &from_slate);
+    if (index < 0 || data->input_recoveries[index] == NULL) { return GST_BUS_PASS; }
+
+    InputRecovery * recovery = data->input_recoveries[index];
+    GError *        err      = NULL;
+    gchar *         debug    = NULL;
+
+    if (from_slate) {
+        /* A slate being detached reports 'not-linked', that's expected. Otherwise the tile stays frozen/black. */
+        g_mutex_lock(&recovery->lock);
+        gboolean showing = recovery->slate != NULL;
+        if (showing) { recovery->slate_errors++; }
+        g_mutex_unlock(&recovery->lock);
+
+        if (showing) {
+            gst_message_parse_error(message, &err, &debug);
+            g_printerr("The slate of input %u failed: %s (%s)\n", recovery->index + 1, err->message, debug);
+            g_error_free(err);
+            g_free(debug);
+        }
+        return GST_BUS_DROP;
+    }
+
+    /* Downgrade to a warning, so that the application doesn't stop the whole pipeline */
+    gst_message_parse_error(message, &err, &debug);
+    gst_bus_post(bus, gst_message_new_warning(GST_MESSAGE_SRC(message), err, debug));
+    g_error_free(err);
+    g_free(debug);
+
+    /* Only the first error of a failing decodebin triggers the isolation */
+    if (g_atomic_int_compare_and_exchange(&recovery->isolation_pending, 0, 1)) { g_idle_add(isolate_input, recovery); }
+
+    return GST_BUS_DROP;
+}
+
+GstClockTime input_recovery_release_slate(InputRecovery * recovery)
+{
+    g_return_val_if_fail(recovery != NULL, 0);
+
+    GstElement * slate = NULL;
+
+    g_mutex_lock(&recovery->lock);
+    slate           = recovery->slate;
+    recovery->slate = NULL;
+    if (slate != NULL) {
+        /* The recovered input starts playing from the current position of the mix */
+        recovery->resume_offset  = gst_element_get_current_running_time(recovery->data->pipeline);
+        recovery->retry_delay_ms = RETRY_INITIAL_DELAY_MS;
+        if (recovery->in_outage) {
+            recovery->outage_total += monotonic_time() - recovery->outage_started;
+            recovery->in_outage = FALSE;
+        }
+    }
+    GstClockTime resume_offset = recovery->resume_offset;
+    g_mutex_unlock(&recovery->lock);
+
+    if (slate != NULL) {
+        GstPad * slate_pad = gst_element_get_static_pad(slate, "video_src");
+        GstPad * peer      = gst_pad_get_peer(slate_pad);
+        if (peer != NULL) {
+            gst_pad_unlink(slate_pad, peer);
+            gst_object_unref(peer);
+        }
+        gst_object_unref(slate_pad);
+        g_print("Input %u recovered, removing the slate.\n", recovery->index + 1);
+        /* The slate may outlive the pipeline until then */
+        g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, remove_slate, gst_object_ref(slate), gst_object_unref);
+    }
+
+    return GST_CLOCK_TIME_IS_VALID(resume_offset) ? resume_offset : 0;
+}
+
+void input_recovery_swap(InputRecovery * recovery, const gchar * uri)
+{
+    g_return_if_fail(recovery != NULL && uri != NULL);
+
+    g_mutex_lock(&recovery->lock);
+    gboolean scheduled = recovery->swap_uri != NULL;
+    g_free(recovery->swap_uri);
+    recovery->swap_uri = g_strdup(uri);
+    g_mutex_unlock(&recovery->lock);
+
+    /* Several swaps before the main loop gets to it only switch to the last one */
+    if (!scheduled) { g_idle_add(swap_input, recovery); }
+}
+
+void input_recovery_fill_stats(InputRecovery * recovery, GstStructure * stats)
+{
+    g_return_if_fail(recovery != NULL && stats != NULL);
+
+    gchar * outages_name   = g_strdup_printf("input%u-outages", recovery->index + 1);
+    gchar * time_name      = g_strdup_printf("input%u-outage-time", recovery->index + 1);
+    gchar * in_outage_name = g_strdup_printf("input%u-in-outage", recovery->index + 1);
+    gchar * slate_name     = g_strdup_printf("input%u-slate-errors", recovery->index + 1);
+
+    g_mutex_lock(&recovery->lock);
+    GstClockTime outage_time = recovery->outage_total;
+    if (recovery->in_outage) { outage_time += monotonic_time() - recovery->outage_started; }
+    gst_structure_set(stats,
+                      outages_name,
+                      G_TYPE_UINT,
+                      recovery->outage_count,
+                      time_name,
+                      G_TYPE_UINT64,
+                      outage_time,
+                      in_outage_name,
+                      G_TYPE_BOOLEAN,
+                      recovery->in_outage,
+                      slate_name,
+                      G_TYPE_UINT,
+                      recovery->slate_errors,
+                      NULL);
+    g_mutex_unlock(&recovery->lock);
+
+    g_free(outages_name);
+    g_free(time_name);
+    g_free(in_outage_name);
+    g_free(slate_name);
+}
+
+/* private functions' definitions */
+
+static GstPadProbeReturn cb_remember_last_frame(GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+    InputRecovery * recovery = user_data;
+
+    g_mutex_lock(&recovery->lock);
+    gst_buffer_replace(&recovery->last_frame, GST_PAD_PROBE_INFO_BUFFER(info));
+    g_mutex_unlock(&recovery->lock);
+
+    return GST_PAD_PROBE_OK;
+}
+
+static gboolean isolate_input(gpointer user_data)
+{
+    InputRecovery * recovery  = user_data;
+    GstElement **   decodebin = get_input_decodebin(recovery->data, recovery->index);
+
+    g_printerr("Input %u failed, isolating it from the mix.\n", recovery->index + 1);
+
+    if (*decodebin != NULL) {
+        g_mutex_lock(&recovery->lock);
+        g_free(recovery->uri);
+        g_object_get(*decodebin, "uri", &recovery->uri, NULL);
+        g_mutex_unlock(&recovery->lock);
+
+        remove_decodebin(recovery);
+    }
+
+    g_mutex_lock(&recovery->lock);
+    if (!recovery->in_outage) {
+        recovery->in_outage      = TRUE;
+        recovery->outage_started = monotonic_time();
+        recovery->outage_count++;
+    }
+    g_mutex_unlock(&recovery->lock);
+
+    show_slate(recovery);
+
+    g_print("Retrying input %u in %u ms.\n", recovery->index + 1, recovery->retry_delay_ms);
+    recovery->retry_source_id = g_timeout_add(recovery->retry_delay_ms, retry_input, recovery);
+    recovery->retry_delay_ms  = MIN(recovery->retry_delay_ms * 2, RETRY_MAX_DELAY_MS);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean retry_input(gpointer user_data)
+{
+    InputRecovery * recovery = user_data;
+
+    recovery->retry_source_id = 0;
+
+    g_print("Retrying input %u.\n", recovery->index + 1);
+    create_decodebin(recovery);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Same as an isolation followed by an immediate retry, with the new URI */
+static gboolean swap_input(gpointer user_data)
+{
+    InputRecovery * recovery = user_data;
+
+    g_mutex_lock(&recovery->lock);
+    g_free(recovery->uri);
+    recovery->uri      = recovery->swap_uri;
+    recovery->swap_uri = NULL;
+    g_print("Switching input %u to %s.\n", recovery->index + 1, recovery->uri);
+    g_mutex_unlock(&recovery->lock);
+
+    /* A pending retry would use the new URI anyway */
+    if (recovery->retry_source_id != 0) {
+        g_source_remove(recovery->retry_source_id);
+        recovery->retry_source_id = 0;
+    }
+    if (*get_input_decodebin(recovery->data, recovery->index) != NULL) { remove_decodebin(recovery); }
+    show_slate(recovery);
+    create_decodebin(recovery);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void remove_decodebin(InputRecovery * recovery)
+{
+    GstElement ** decodebin = get_input_decodebin(recovery->data, recovery->index);
+
+    /* Removing it from the pipeline unlinks its pads from the rest of the branch */
+    gst_element_set_state(*decodebin, GST_STATE_NULL);
+    gst_bin_remove(GST_BIN(recovery->data->pipeline), *decodebin);
+    *decodebin = NULL;
+
+    /* Meanwhile the silent bed of the mix stands in for its audio, and the next decodebin may have none */
+    remove_input_audio(recovery->data, recovery->index);
+}
+
+/* Link the slate to the input branch, unless it is already showing */
+static void show_slate(InputRecovery * recovery)
+{
+    GstElement * slate      = NULL;
+    GstBuffer *  last_frame = NULL;
+
+    g_mutex_lock(&recovery->lock);
+    if (recovery->slate == NULL && recovery->last_frame != NULL) { last_frame = gst_buffer_ref(recovery->last_frame); }
+    gboolean needs_slate = recovery->slate == NULL;
+    g_mutex_unlock(&recovery->lock);
+
+    if (needs_slate) {
+        slate = create_slate(recovery, last_frame);
+        link_slate(recovery, slate);
+
+        g_mutex_lock(&recovery->lock);
+        recovery->slate = slate;
+        g_mutex_unlock(&recovery->lock);
+    }
+    if (last_frame != NULL) { gst_buffer_unref(last_frame); }
+}
+
+static void create_decodebin(InputRecovery * recovery)
+{
+    GstreamerData * data      = recovery->data;
+    GstElement **   decodebin = get_input_decodebin(data, recovery->index);
+    gchar *         name      = g_strdup_printf("decodebin%u", recovery->index + 1);
+
+    *decodebin = gst_element_factory_make("uridecodebin3", name);
+    g_free(name);
+    if (*decodebin == NULL) {
+        g_printerr("Could not re-create the decodebin of input %u.\n", recovery->index + 1);
+        return;
+    }
+
+    g_mutex_lock(&recovery->lock);
+    g_object_set(*decodebin, "uri", recovery->uri, NULL);
+    g_mutex_unlock(&recovery->lock);
+    g_signal_connect(*decodebin, "pad-added", recovery->pad_added_cb, data);
+
+    gst_bin_add(GST_BIN(data->pipeline), *decodebin);
+    g_atomic_int_set(&recovery->isolation_pending, 0);
+    gst_element_sync_state_with_parent(*decodebin);
+}
+
+static gboolean remove_slate(gpointer user_data)
+{
+    GstElement * slate    = user_data;
+    GstObject *  pipeline = gst_object_get_parent(GST_OBJECT(slate));
+
+    gst_element_set_state(slate, GST_STATE_NULL);
+    if (pipeline != NULL) {
+        gst_bin_remove(GST_BIN(pipeline), slate);
+        gst_object_unref(pipeline);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+/* The slate is pre-rendered once and repeated by imagefreeze, so it costs next to nothing */
+static GstElement * create_slate(InputRecovery * recovery, GstBuffer * last_frame)
+{
+    GstreamerData * data       = recovery->data;
+    gchar *         name       = g_strdup_printf("slate%u", recovery->index + 1);
+    GstElement *    slate      = gst_bin_new(name);
+    GstElement *    source     = NULL;
+    GstElement *    capsfilter = gst_element_factory_make("capsfilter", NULL);
+    GstElement *    freeze     = gst_element_factory_make("imagefreeze", NULL);
+    GstCaps *       caps       = NULL;
+    GstPad *        pad        = NULL;
+
+    g_free(name);
+
+    /* The caps of the last frame, the mixer scales the slate like the input itself */
+    pad  = gst_element_get_static_pad(get_input_video_queue(data, recovery->index), "src");
+    caps = gst_pad_get_current_caps(pad);
+    gst_object_unref(pad);
+    if (caps == NULL) { last_frame = NULL; }
+
+    if (last_frame != NULL) {
+        source = gst_element_factory_make("appsrc", NULL);
+        g_object_set(source, "caps", caps, "format", GST_FORMAT_TIME, NULL);
+    }
+    else {
+        source = gst_element_factory_make("videotestsrc", NULL);
+        g_object_set(source, "num-buffers", 1, "pattern", 0 /* SMPTE bars */, NULL);
+    }
+    if (caps != NULL) {
+        g_object_set(capsfilter, "caps", caps, NULL);
+        gst_caps_unref(caps);
+    }
+
+    gst_bin_add_many(GST_BIN(slate), source, capsfilter, freeze, NULL);
+    if (!gst_element_link_many(source, capsfilter, freeze, NULL)) {
+        g_printerr("Slate for input %u could not be linked.\n", recovery->index + 1);
+    }
+
+    pad = gst_element_get_static_pad(freeze, "src");
+    gst_element_add_pad(slate, gst_ghost_pad_new("video_src", pad));
+    gst_object_unref(pad);
+
+    if (last_frame != NULL) {
+        /* imagefreeze does its own timestamping */
+        GstBuffer *   frame = gst_buffer_copy(last_frame);
+        GstFlowReturn ret;
+        GST_BUFFER_PTS(frame) = GST_CLOCK_TIME_NONE;
+        GST_BUFFER_DTS(frame) = GST_CLOCK_TIME_NONE;
+        g_signal_emit_by_name(source, "push-buffer", frame, &ret);
+        g_signal_emit_by_name(source, "end-of-stream", &ret);
+        gst_buffer_unref(frame);
+    }
+
+    return slate;
+}
+
+static void link_slate(InputRecovery * recovery, GstElement * slate)
+{
+    GstreamerData * data          = recovery->data;
+    gint64          running_time  = gst_element_get_current_running_time(data->pipeline);
+    GstPad *        video_src_pad = gst_element_get_static_pad(slate, "video_src");
+    GstPad *        video_sink    = gst_element_get_static_pad(get_input_video_queue(data, recovery->index), "sink");
+
+    gst_bin_add(GST_BIN(data->pipeline), slate);
+
+    /* The slate starts at zero, shift it to the current position of the mix */
+    if (!GST_CLOCK_TIME_IS_VALID(running_time)) { running_time = 0; }
+    gst_pad_set_offset(video_src_pad, running_time);
+    if (gst_pad_link(video_src_pad, video_sink) != GST_PAD_LINK_OK) {
+        g_printerr("Slate for input %u could not be linked.\n", recovery->index + 1);
+    }
+
+    gst_element_sync_state_with_parent(slate);
+
+    gst_object_unref(video_src_pad);
+    gst_object_unref(video_sink);
+}
+
+/* Walk up from @src to the top-level element of an input branch ("decodebinN" or "slateN") */
+static gint find_input_index(GstObject * src, gboolean * from_slate)
+{
+    const gchar * prefixes[2] = {"decodebin", "slate"};
+    gint          index       = -1;
+    GstObject *   object      = gst_object_ref(src);
+
+    while (object != NULL && index < 0) {
+        GstObject * parent = gst_object_get_parent(object);
+
+        /* Only consider direct children of the pipeline (or ones which were already removed from it) */
+        if (parent == NULL || GST_IS_PIPELINE(parent)) {
+            for (guint i = 0; i < 2 && index < 0; i++) {
+                const gchar * name = GST_OBJECT_NAME(object);
+                if (g_str_has_prefix(name, prefixes[i]) && strlen(name) == strlen(prefixes[i]) + 1) {
+                    gint digit = name[strlen(prefixes[i])] - '1';
+                    if (digit >= 0 && digit < 3) {
+                        index       = digit;
+                        *from_slate = (i == 1);
+                    }
+                }
+            }
+        }
+
+        gst_object_unref(object);
+        object = parent;
+    }
+    if (object != NULL) { gst_object_unref(object); }
+
+    return index;
+}
+
+static GstClockTime monotonic_time()
+{
+    return g_get_monotonic_time() * GST_USECOND;
+}
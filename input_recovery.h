@@ -0,0 +1,34 @@
+#ifndef _INPUT_RECOVERY__H_
+#define _INPUT_RECOVERY__H_
+
+#include "gst_helpers.h"
+
+#include <gst/gst.h>
+
+/* Fault isolation of a single input branch.                                    */
+/* An error raised from within the input's decodebin doesn't stop the pipeline: */
+/* the decodebin is removed and its place is taken by a slate (the last good    */
+/* frame if there was one, a test pattern otherwise) until a retry succeeds.    */
+
+/* Create the recovery state for the input at @index and start tracking its last good frame. */
+/* @pad_added_cb is connected to the "pad-added" signal of any re-created decodebin.         */
+InputRecovery * input_recovery_new(GstreamerData * data, guint index, GCallback pad_added_cb);
+
+void input_recovery_free(InputRecovery * recovery);
+
+/* Bus sync handler - drops the errors scoped to an input and schedules its isolation instead. */
+/* @user_data is the GstreamerData.                                                             */
+GstBusSyncReply input_recovery_bus_sync_handler(GstBus * bus, GstMessage * message, gpointer user_data);
+
+/* Detach the slate (if any) from the input branch, called before linking a decoded pad. */
+/* Returns the running time at which the new pad data should start.                       */
+GstClockTime input_recovery_release_slate(InputRecovery * recovery);
+
+/* Switch the input to @uri, from the main loop. The last frame is shown until the new input is decoded, */
+/* like during an outage (but not counted as one). Safe to call from any thread.                        */
+void input_recovery_swap(InputRecovery * recovery, const gchar * uri);
+
+/* Add the outage metrics of the input to @stats (fields prefixed with "input<N>-") */
+void input_recovery_fill_stats(InputRecovery * recovery, GstStructure * stats);
+
+#endif /* _INPUT_RECOVERY__H_ */
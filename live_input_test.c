@@ -0,0 +1,210 @@
+#include "three_video_stream.h"
+
+#include <glib.h>
+#include <gst/gst.h>
+#include <stdlib.h>
+
+/* Mixes live RTP streams sent over UDP on localhost (payloaded test patterns), which can't be typefound, given */
+/* their caps: the first & third input through "rtp://" (with a jitter buffer), the second through "udp://".     */
+/* Fails unless each input delivered about as many frames as were sent, without an outage.                      */
+
+#define LIVE_INPUT_WIDTH 320
+#define LIVE_INPUT_HEIGHT 240
+#define LIVE_INPUT_FRAMERATE 30
+#define LIVE_INPUT_CAPS "application/x-rtp,media=video,clock-rate=90000,encoding-name=JPEG,payload=26"
+
+/* Input parameters */
+static int duration    = 10;
+static int base_port   = 5600;
+static int jitter      = 100;
+static int min_percent = 80;
+
+static GOptionEntry entries[] = {
+    {"duration", 'd', 0, G_OPTION_ARG_INT, &duration, "How long to run, in seconds", NULL},
+    {"port", 'p', 0, G_OPTION_ARG_INT, &base_port, "First UDP port, 3 inputs use every other port from it", NULL},
+    {"jitter", 'j', 0, G_OPTION_ARG_INT, &jitter, "Jitter buffer of each input, in ms", NULL},
+    {"min-frames",
+     0,
+     0,
+     G_OPTION_ARG_INT,
+     &min_percent,
+     "Share of the frames sent which has to reach the mixer, in percent",
+     NULL},
+    {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL},
+};
+
+static GMainLoop * loop;
+static gboolean    failed;
+static guint       frames[3];
+
+static GstElement *      create_sender(guint index);
+static GstPadProbeReturn cb_count_frame(GstPad * pad, GstPadProbeInfo * info, gpointer user_data);
+static gboolean          cb_bus_message(GstBus * bus, GstMessage * message, gpointer user_data);
+static gboolean          cb_end(gpointer user_data);
+
+int main(int argc, char * argv[])
+{
+    GError *         error        = NULL;
+    GOptionContext * context      = g_option_context_new(" Mix live RTP/UDP inputs which need a caps hint");
+    GstElement *     senders[3]   = {NULL};
+    gchar *          locations[3] = {NULL};
+    GstElement *     pipeline     = NULL;
+    GstStructure *   stats        = NULL;
+
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("option parsing failed: %s\n", error->message);
+        exit(1);
+    }
+    g_option_context_free(context);
+    if (duration < 2 || base_port <= 0 || base_port > 65530) {
+        g_printerr("The test runs for at least 2 seconds, on valid ports.\n");
+        exit(1);
+    }
+
+    gst_init(&argc, &argv);
+    loop = g_main_loop_new(NULL, FALSE);
+
+    /* RTCP goes to the port after each */
+    for (guint i = 0; i < 3; i++) {
+        locations[i] = g_strdup_printf("%s://127.0.0.1:%d", i == 1 ? "udp" : "rtp", base_port + 2 * i);
+        senders[i]   = create_sender(i);
+        if (senders[i] == NULL) { exit(1); }
+    }
+
+    ThreeVideoStream * stream = three_video_stream_new(locations[0], locations[1], locations[2], "");
+    g_object_set(stream,
+                 "audio-enabled",
+                 FALSE,
+                 "caps-input1",
+                 LIVE_INPUT_CAPS,
+                 "caps-input2",
+                 LIVE_INPUT_CAPS,
+                 "caps-input3",
+                 LIVE_INPUT_CAPS,
+                 "input-jitter1",
+                 jitter,
+                 "input-jitter2",
+                 jitter,
+                 "input-jitter3",
+                 jitter,
+                 NULL);
+    g_object_set(stream, "ready-to-play", TRUE, NULL);
+    g_object_get(stream, "gst-pipeline", &pipeline, NULL);
+
+    /* What leaves the jitter queues goes to the mixer */
+    for (guint i = 0; i < 3; i++) {
+        gchar *      name  = g_strdup_printf("queue_jitter%u", i + 1);
+        GstElement * queue = gst_bin_get_by_name(GST_BIN(pipeline), name);
+        GstPad *     src   = gst_element_get_static_pad(queue, "src");
+        gst_pad_add_probe(src, GST_PAD_PROBE_TYPE_BUFFER, cb_count_frame, &frames[i], NULL);
+        gst_object_unref(src);
+        gst_object_unref(queue);
+        g_free(name);
+    }
+
+    GstBus * bus      = gst_element_get_bus(pipeline);
+    guint    watch_id = gst_bus_add_watch(bus, cb_bus_message, pipeline);
+    gst_object_unref(bus);
+
+    for (guint i = 0; i < 3; i++) { gst_element_set_state(senders[i], GST_STATE_PLAYING); }
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    g_timeout_add_seconds(duration, cb_end, NULL);
+    g_main_loop_run(loop);
+
+    g_object_get(stream, "stats", &stats, NULL);
+    g_print("%5s %-24s %8s %8s\n", "input", "location", "frames", "outages");
+    for (guint i = 0; i < 3; i++) {
+        gchar * outages_name = g_strdup_printf("input%u-outages", i + 1);
+        guint   outages      = 0;
+        gst_structure_get_uint(stats, outages_name, &outages);
+        g_print("%5u %-24s %8u %8u\n", i + 1, locations[i], frames[i], outages);
+
+        /* The first frames are only sent once the stream listens */
+        if (frames[i] < (guint)(duration - 1) * LIVE_INPUT_FRAMERATE * min_percent / 100 || outages > 0) {
+            failed = TRUE;
+        }
+        g_free(outages_name);
+    }
+    gst_structure_free(stats);
+    g_print(failed ? "Live input test failed.\n" : "Live input test passed.\n");
+
+    g_source_remove(watch_id);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    three_video_stream_free(stream);
+    for (guint i = 0; i < 3; i++) {
+        gst_element_set_state(senders[i], GST_STATE_NULL);
+        gst_object_unref(senders[i]);
+        g_free(locations[i]);
+    }
+    g_main_loop_unref(loop);
+
+    gst_deinit();
+    return failed ? 1 : 0;
+}
+
+/* private functions' definitions */
+
+/* A live test pattern, as RTP/JPEG over UDP */
+static GstElement * create_sender(guint index)
+{
+    const gchar * patterns[3] = {"smpte", "ball", "pinwheel"};
+    GError *      error       = NULL;
+    gchar *       description = g_strdup_printf(
+        "videotestsrc is-live=true pattern=%s ! video/x-raw,width=%d,height=%d,framerate=%d/1 ! jpegenc ! "
+        "rtpjpegpay ! udpsink host=127.0.0.1 port=%d",
+        patterns[index],
+        LIVE_INPUT_WIDTH,
+        LIVE_INPUT_HEIGHT,
+        LIVE_INPUT_FRAMERATE,
+        base_port + 2 * index);
+    GstElement * sender = gst_parse_launch(description, &error);
+
+    g_free(description);
+    if (sender == NULL) {
+        g_printerr("Could not create the sender of input %u: %s\n", index + 1, error->message);
+        g_error_free(error);
+    }
+
+    return sender;
+}
+
+static GstPadProbeReturn cb_count_frame(GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+    guint * count = user_data;
+
+    g_atomic_int_inc(count);
+    return GST_PAD_PROBE_OK;
+}
+
+static gboolean cb_bus_message(GstBus * bus, GstMessage * message, gpointer user_data)
+{
+    GstElement * pipeline = user_data;
+
+    switch (GST_MESSAGE_TYPE(message)) {
+    case GST_MESSAGE_ERROR: {
+        GError * err  = NULL;
+        gchar *  name = gst_object_get_path_string(message->src);
+
+        gst_message_parse_error(message, &err, NULL);
+        g_printerr("Error from %s: %s\n", name, err->message);
+        g_error_free(err);
+        g_free(name);
+
+        failed = TRUE;
+        g_main_loop_quit(loop);
+        break;
+    }
+    case GST_MESSAGE_LATENCY: gst_bin_recalculate_latency(GST_BIN(pipeline)); break;
+    default: break;
+    }
+
+    return TRUE;
+}
+
+static gboolean cb_end(gpointer user_data)
+{
+    g_main_loop_quit(loop);
+    return G_SOURCE_REMOVE;
+}
@@ -1,3 +1,4 @@
+#include "control_server.h"
 #include "gst_helpers.h"
 #include "three_video_stream.h"
 
@@ -8,15 +9,31 @@
 #include <stdlib.h>
 
 /* Input parameters */
-static gchar * twitch_api_key  = "";
-static gchar * twitch_server   = "";
-static gchar * video1_filename = "";
-static gchar * video2_filename = "";
-static gchar * video3_filename = "";
-static int     output_width    = 1920;
-static int     output_height   = 1080;
-
-static GOptionEntry entries[7] = {
+static gchar *  twitch_api_key    = "";
+static gchar *  twitch_server     = "";
+static gchar *  video1_filename   = "";
+static gchar *  video2_filename   = "";
+static gchar *  video3_filename   = "";
+static int      output_width      = 1920;
+static int      output_height     = 1080;
+static gboolean no_audio          = FALSE;
+static int      input_jitter      = 0;
+static int      mixer_timeout     = 0;
+static gchar *  trace_filename    = "";
+static gchar ** input_caps        = NULL;
+static gchar ** thread_cpus       = NULL;
+static gchar ** thread_priority   = NULL;
+static int      stats_interval    = 0;
+static gchar *  layout            = "left-and-stacked";
+static int      layout_transition = 0;
+static gchar *  video_encoder     = "x264";
+static gchar *  encoder_preset    = "low-latency";
+static int      video_bitrate     = 400;
+static int      read_ahead        = 0;
+static int      read_throttle     = 0;
+static gchar *  control_socket    = "";
+
+static GOptionEntry entries[] = {
     {"twitch-api-key",
      'k',
      0,
@@ -31,17 +48,113 @@ static GOptionEntry entries[7] = {
      &twitch_server,
      "Choose preferred Twitch ingest server (optional)",
      NULL},
-    {"video-a", 'a', 0, G_OPTION_ARG_FILENAME, &video1_filename, "First video (left half of the screen)", NULL},
-    {"video-b", 'b', 0, G_OPTION_ARG_FILENAME, &video2_filename, "Second video (top right of the screen)", NULL},
-    {"video-c", 'c', 0, G_OPTION_ARG_FILENAME, &video3_filename, "Third video (bottom right of the screen)", NULL},
+    {"video-a",
+     'a',
+     0,
+     G_OPTION_ARG_FILENAME,
+     &video1_filename,
+     "First video, path or URI (left half of the screen)",
+     NULL},
+    {"video-b",
+     'b',
+     0,
+     G_OPTION_ARG_FILENAME,
+     &video2_filename,
+     "Second video, path or URI (top right of the screen)",
+     NULL},
+    {"video-c",
+     'c',
+     0,
+     G_OPTION_ARG_FILENAME,
+     &video3_filename,
+     "Third video, path or URI (bottom right of the screen)",
+     NULL},
     {"width", 'w', 0, G_OPTION_ARG_INT, &output_width, "Output video width", NULL},
     {"height", 'h', 0, G_OPTION_ARG_INT, &output_height, "Output video height", NULL},
+    {"no-audio", 'n', 0, G_OPTION_ARG_NONE, &no_audio, "Ignore the audio of the videos (no gst-libav needed)", NULL},
+    {"jitter", 'j', 0, G_OPTION_ARG_INT, &input_jitter, "Jitter buffer of each live input, in ms", NULL},
+    {"caps",
+     0,
+     0,
+     G_OPTION_ARG_STRING_ARRAY,
+     &input_caps,
+     "Caps of a UDP/RTP input, e.g. 'input1=application/x-rtp,media=video,encoding-name=H264' (repeatable)",
+     NULL},
+    {"mixer-timeout",
+     't',
+     0,
+     G_OPTION_ARG_INT,
+     &mixer_timeout,
+     "How long to wait for late live inputs before mixing without them, in ms",
+     NULL},
+    {"trace",
+     'T',
+     0,
+     G_OPTION_ARG_FILENAME,
+     &trace_filename,
+     "Trace the pipeline, written in the Chrome trace format to this file on exit",
+     NULL},
+    {"cpus",
+     0,
+     0,
+     G_OPTION_ARG_STRING_ARRAY,
+     &thread_cpus,
+     "Pin the threads of a branch (input1..3, mixer, encoder, output) to CPUs, e.g. 'mixer=4-5' (repeatable)",
+     NULL},
+    {"priority",
+     0,
+     0,
+     G_OPTION_ARG_STRING_ARRAY,
+     &thread_priority,
+     "Priority of the mixer or encoder threads, e.g. 'encoder=10' for SCHED_FIFO (repeatable)",
+     NULL},
+    {"layout",
+     'l',
+     0,
+     G_OPTION_ARG_STRING,
+     &layout,
+     "Arrangement of the videos: left-and-stacked, columns, main-and-insets or fullscreen1..3",
+     NULL},
+    {"layout-transition", 0, 0, G_OPTION_ARG_INT, &layout_transition, "How long layout changes take, in ms", NULL},
+    {"encoder", 'e', 0, G_OPTION_ARG_STRING, &video_encoder, "Video encoder of the stream: x264 or openh264", NULL},
+    {"encoder-preset",
+     0,
+     0,
+     G_OPTION_ARG_STRING,
+     &encoder_preset,
+     "Settings of the video encoder: low-latency or quality",
+     NULL},
+    {"bitrate", 0, 0, G_OPTION_ARG_INT, &video_bitrate, "Bitrate of the streamed video, in kbit/s", NULL},
+    {"read-ahead",
+     0,
+     0,
+     G_OPTION_ARG_INT,
+     &read_ahead,
+     "Read the input files up to N MiB ahead in a separate thread, for slow or shared storage",
+     NULL},
+    {"read-throttle",
+     0,
+     0,
+     G_OPTION_ARG_INT,
+     &read_throttle,
+     "Limit the reads of each input file to N KiB/s, to emulate slow storage",
+     NULL},
+    {"control-socket",
+     0,
+     0,
+     G_OPTION_ARG_FILENAME,
+     &control_socket,
+     "Accept control commands (JSON, one per line) on this Unix socket",
+     NULL},
+    {"print-stats", 'S', 0, G_OPTION_ARG_INT, &stats_interval, "Print the runtime stats every N seconds", NULL},
+    {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL},
 };
 
 static GMainLoop *        loop;
 static GstElement *       pipeline;
 static ThreeVideoStream * three_video_stream;
 static GstBus *           bus;
+static ControlServer *    control_server;
 
 void sig_int_handler(int unused);
 
@@ -51,6 +164,10 @@ void verify_parsed_arguments();
 
 static void cleanup();
 
+/* Set the "<prefix>-<branch>" property for each "<branch>=<value>" setting */
+static void set_branch_properties(const gchar * prefix, gchar ** settings);
+static gboolean cb_print_stats(gpointer user_data);
+
 /* Handler for the GStreamer pipeline bus message */
 static gboolean cb_on_bus_message(GstBus * bus, GstMessage * message, gpointer user_data);
 
@@ -71,6 +188,54 @@ int main(int argc, char * argv[])
     }
     g_object_set(three_video_stream, "output-width", output_width, NULL);
     g_object_set(three_video_stream, "output-height", output_height, NULL);
+    g_object_set(three_video_stream, "audio-enabled", !no_audio, NULL);
+    g_object_set(three_video_stream,
+                 "input-jitter1",
+                 input_jitter,
+                 "input-jitter2",
+                 input_jitter,
+                 "input-jitter3",
+                 input_jitter,
+                 "mixer-timeout",
+                 mixer_timeout,
+                 NULL);
+    set_branch_properties("caps", input_caps);
+    set_branch_properties("cpus", thread_cpus);
+    set_branch_properties("priority", thread_priority);
+    g_object_set(three_video_stream, "layout-transition", layout_transition, NULL);
+    g_object_set(three_video_stream,
+                 "video-encoder",
+                 video_encoder,
+                 "video-encoder-preset",
+                 encoder_preset,
+                 "video-bitrate",
+                 video_bitrate,
+                 NULL);
+    /* A rejected encoder or preset keeps the previous one, which must not go unnoticed */
+    gchar * chosen_encoder = NULL;
+    gchar * chosen_preset  = NULL;
+    g_object_get(three_video_stream, "video-encoder", &chosen_encoder, "video-encoder-preset", &chosen_preset, NULL);
+    gboolean encoder_accepted =
+        g_strcmp0(chosen_encoder, video_encoder) == 0 && g_strcmp0(chosen_preset, encoder_preset) == 0;
+    g_free(chosen_encoder);
+    g_free(chosen_preset);
+    if (!encoder_accepted) {
+        g_printerr("Could not use the video encoder '%s' with the preset '%s'.\n", video_encoder, encoder_preset);
+        cleanup();
+        exit(1);
+    }
+    g_object_set(three_video_stream, "input-read-ahead", read_ahead, "input-read-throttle", read_throttle, NULL);
+    /* gst_util_set_object_arg() ignores unknown values, keeping the default layout */
+    GEnumClass * layouts      = g_type_class_ref(THREE_VIDEO_STREAM_TYPE_LAYOUT);
+    gboolean     layout_known = g_enum_get_value_by_nick(layouts, layout) != NULL;
+    g_type_class_unref(layouts);
+    if (!layout_known) {
+        g_printerr("Unknown layout '%s'.\n", layout);
+        cleanup();
+        exit(1);
+    }
+    gst_util_set_object_arg(G_OBJECT(three_video_stream), "layout", layout);
+    if (strlen(trace_filename) != 0) { g_object_set(three_video_stream, "trace-file", trace_filename, NULL); }
     /* Everything has been configured, signal it by setting the 'ready-to-play' property  */
     g_object_set(three_video_stream, "ready-to-play", TRUE, NULL);
 
@@ -84,9 +249,20 @@ int main(int argc, char * argv[])
     g_signal_connect(G_OBJECT(bus), "message", G_CALLBACK(cb_on_bus_message), NULL);
     gst_object_unref(GST_OBJECT(bus));
 
+    /* Before the pipeline starts, failing without having to stop it */
+    if (strlen(control_socket) != 0) {
+        control_server = control_server_new(three_video_stream, control_socket);
+        if (control_server == NULL) {
+            cleanup();
+            exit(1);
+        }
+    }
+
     /* Kick-off the pipeline - in paused state, as it requires pre-rolling first */
     try_change_pipeline_state(pipeline, GST_STATE_PAUSED);
 
+    if (stats_interval > 0) { g_timeout_add_seconds(stats_interval, cb_print_stats, NULL); }
+
     g_print("Starting the mainloop\n");
     g_main_loop_run(loop);
 
@@ -153,10 +329,58 @@ void sig_int_handler(int unused)
     }
 }
 
+static void set_branch_properties(const gchar * prefix, gchar ** settings)
+{
+    for (guint i = 0; settings != NULL && settings[i] != NULL; i++) {
+        gchar **     setting = g_strsplit(settings[i], "=", 2);
+        gchar *      name    = g_strdup_printf("%s-%s", prefix, setting[0]);
+        GParamSpec * pspec   = g_object_class_find_property(G_OBJECT_GET_CLASS(three_video_stream), name);
+
+        if (setting[1] == NULL || pspec == NULL) {
+            g_printerr("Ignoring the invalid '--%s %s' option.\n", prefix, settings[i]);
+        }
+        else {
+            GValue value = G_VALUE_INIT;
+            g_value_init(&value, pspec->value_type);
+            if (pspec->value_type == G_TYPE_INT) { g_value_set_int(&value, atoi(setting[1])); }
+            else {
+                g_value_set_string(&value, setting[1]);
+            }
+            g_object_set_property(G_OBJECT(three_video_stream), name, &value);
+            g_value_unset(&value);
+        }
+
+        g_free(name);
+        g_strfreev(setting);
+    }
+}
+
+static gboolean cb_print_stats(gpointer user_data)
+{
+    GstStructure * stats = NULL;
+    g_object_get(three_video_stream, "stats", &stats, NULL);
+
+    gchar * text = gst_structure_to_string(stats);
+    g_print("%s\n", text);
+    g_free(text);
+    gst_structure_free(stats);
+
+    return G_SOURCE_CONTINUE;
+}
+
 static void cleanup()
 {
+    if (control_server != NULL) { control_server_free(control_server); }
+    /* The signal watch is added along with the loop */
+    if (pipeline != NULL && loop != NULL) {
+        bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+        gst_bus_remove_signal_watch(bus);
+        gst_object_unref(bus);
+    }
     if (three_video_stream != NULL) { g_object_unref(three_video_stream); }
+    /* The reference obtained from the "gst-pipeline" property, the stream only released its own */
     if (pipeline != NULL) { gst_object_unref(pipeline); }
+    if (loop != NULL) { g_main_loop_unref(loop); }
 }
 
 static gboolean cb_on_bus_message(GstBus * bus, GstMessage * message, gpointer user_data)
@@ -191,6 +415,11 @@ static gboolean cb_on_bus_message(GstBus * bus, GstMessage * message, gpointer u
         }
         break;
     }
+    case GST_MESSAGE_LATENCY: {
+        /* e.g. a jitter buffer or the mixer timeout changed */
+        gst_bin_recalculate_latency(GST_BIN(pipeline));
+        break;
+    }
     case GST_MESSAGE_WARNING: {
         GError * err = NULL;
         gchar *  name, *debug = NULL;
@@ -210,7 +439,6 @@ static gboolean cb_on_bus_message(GstBus * bus, GstMessage * message, gpointer u
         g_print("Got EOS\n");
         g_main_loop_quit(loop);
         gst_element_set_state(pipeline, GST_STATE_NULL);
-        g_main_loop_unref(loop);
         break;
     }
     default: break;
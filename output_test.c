@@ -0,0 +1,330 @@
+#include "store_forward.h"
+#include "test_support.h"
+
+#include <glib.h>
+#include <gst/gst.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Streams numbered FLV video tags through the store-and-forward output to a local stand-in server, which is */
+/* killed and restarted repeatedly. Fails if a tag is received twice or out of order, if a connection doesn't */
+/* start with the FLV header then a keyframe, if tags are missing within a connection, or if the last tags    */
+/* never arrive. Tags lost around the kills (in flight, then up to the next keyframe) are only counted.       */
+
+#define OUTPUT_TEST_RECORD_SIZE 1024       /* bytes of each tag, including the size of the tag which follows it */
+#define OUTPUT_TEST_PERIOD_MS 10           /* between two tags, i.e. 100 KiB/s */
+#define OUTPUT_TEST_KEYFRAME_INTERVAL 50   /* tags */
+#define OUTPUT_TEST_DRAIN 10               /* s, for the last tags to get through once the production stops */
+
+/* FLV file header (with the size of the previous tag, 0), tag header: type (1 byte), data size (3), timestamp */
+/* (4), stream id (3). The data of the tags is a video frame type & codec (1), then the sequence number (8).   */
+#define FLV_HEADER_SIZE 13
+#define FLV_TAG_HEADER_SIZE 11
+#define FLV_TAG_TYPE_VIDEO 9
+#define FLV_TAG_DATA_SIZE (OUTPUT_TEST_RECORD_SIZE - FLV_TAG_HEADER_SIZE - 4)
+#define FLV_VIDEO_KEYFRAME 1
+#define FLV_VIDEO_INTER_FRAME 2
+#define FLV_VIDEO_CODEC_AVC 7
+
+/* Input parameters */
+static int iterations = 5;
+static int uptime     = 8;
+static int downtime   = 3;
+
+static GOptionEntry entries[] = {
+    {"iterations", 'i', 0, G_OPTION_ARG_INT, &iterations, "Number of kill/restart cycles of the server", NULL},
+    {"uptime", 'u', 0, G_OPTION_ARG_INT, &uptime, "How long the server runs in each cycle, in seconds", NULL},
+    {"downtime", 'd', 0, G_OPTION_ARG_INT, &downtime, "How long the server is down in each cycle, in seconds", NULL},
+    {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL},
+};
+
+/* A connection of the stand-in server (its data), with the start of a tag split across reads */
+typedef struct {
+    gboolean header_received;
+    guint8   record[OUTPUT_TEST_RECORD_SIZE];
+    gsize    filled;
+    guint64  records;
+    gint64   last_sequence;
+} OutputConnection;
+
+static GMainLoop *    loop;
+static GstElement *   source;
+static guint64        produced;
+static guint64        received;
+static gint64         last_sequence = -1; /* received, over all the connections */
+static guint64        duplicates;
+static guint          cycle;
+static gboolean       failed;
+static gint64         drain_until;
+static StoreForward * store_forward;
+
+/* Stand-in for the ingest server */
+static TestServer * output_server;
+static guint        accepted_before; /* connections, until the current cycle */
+
+static gboolean  cb_produce(gpointer user_data);
+static gboolean  cb_kill_server(gpointer user_data);
+static gboolean  cb_restart_server(gpointer user_data);
+static gboolean  cb_check_drained(gpointer user_data);
+static GstCaps * create_caps(void);
+
+static void cb_output_receive(GSocketConnection * connection, const guint8 * data, gsize size, gpointer user_data);
+static void check_record(OutputConnection * output);
+
+int main(int argc, char * argv[])
+{
+    GError *         error   = NULL;
+    GOptionContext * context = g_option_context_new(" Kill & restart the server of the store-and-forward output");
+    GstStructure *   stats   = gst_structure_new_empty("stats");
+    guint            outages = 0;
+    guint64          dropped = 0;
+
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("option parsing failed: %s\n", error->message);
+        exit(1);
+    }
+    g_option_context_free(context);
+    if (iterations <= 0 || uptime < 2 || downtime <= 0) {
+        g_printerr("The server runs for at least 2 seconds, the other values must be positive.\n");
+        exit(1);
+    }
+
+    gst_init(&argc, &argv);
+    loop = g_main_loop_new(NULL, FALSE);
+
+    output_server = test_server_new(cb_output_receive, NULL);
+    if (output_server == NULL) { exit(1); }
+
+    /* Timestamped on the clock, so that the appsink (synced) takes them in real time */
+    GstElement * pipeline = gst_parse_launch(
+        "appsrc name=source is-live=true format=time do-timestamp=true ! appsink name=sink", &error);
+    if (pipeline == NULL) {
+        g_printerr("Could not create the pipeline: %s\n", error->message);
+        exit(1);
+    }
+    GstElement * sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    GstCaps *    caps = create_caps();
+    source            = gst_bin_get_by_name(GST_BIN(pipeline), "source");
+    store_forward     = store_forward_new(sink);
+    g_object_set(source, "caps", caps, NULL);
+    gst_caps_unref(caps);
+    gst_object_unref(sink);
+
+    gchar * location = g_strdup_printf("tcp://127.0.0.1:%u", test_server_get_port(output_server));
+    store_forward_start(store_forward, location);
+    g_free(location);
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    g_print("%5s %10s %10s %10s %8s\n", "cycle", "produced", "received", "missing", "accepted");
+    g_timeout_add(OUTPUT_TEST_PERIOD_MS, cb_produce, NULL);
+    g_timeout_add_seconds(uptime, cb_kill_server, NULL);
+    g_main_loop_run(loop);
+
+    store_forward_fill_stats(store_forward, stats);
+    gst_structure_get_uint(stats, "output-outages", &outages);
+    gst_structure_get_uint64(stats, "output-dropped-bytes", &dropped);
+    gst_structure_free(stats);
+
+    g_print("%" G_GUINT64_FORMAT " tags produced, %" G_GUINT64_FORMAT " missing, %" G_GUINT64_FORMAT
+            " received again, %u outages, %" G_GUINT64_FORMAT " bytes dropped.\n",
+            produced,
+            produced - received,
+            duplicates,
+            outages,
+            dropped);
+    if (last_sequence != (gint64)produced - 1) {
+        g_printerr("The last tags never arrived (the last one received is %" G_GINT64_FORMAT ").\n", last_sequence);
+        failed = TRUE;
+    }
+    if (outages != (guint)iterations) {
+        g_printerr("%u outages were reported, for %d kills of the server.\n", outages, iterations);
+        failed = TRUE;
+    }
+    g_print(failed ? "Output test failed.\n" : "Output test passed.\n");
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    store_forward_free(store_forward);
+    gst_object_unref(source);
+    gst_object_unref(pipeline);
+    test_server_free(output_server);
+    g_main_loop_unref(loop);
+
+    gst_deinit();
+    return failed ? 1 : 0;
+}
+
+/* private functions' definitions */
+
+/* Stops once the last cycle ended, leaving the rest to drain */
+static gboolean cb_produce(gpointer user_data)
+{
+    GstBuffer *   buffer    = NULL;
+    GstMapInfo    map;
+    guint32       timestamp = produced * OUTPUT_TEST_PERIOD_MS;
+    gboolean      keyframe  = produced % OUTPUT_TEST_KEYFRAME_INTERVAL == 0;
+    GstFlowReturn ret;
+
+    if (cycle >= (guint)iterations) { return G_SOURCE_REMOVE; }
+
+    buffer = gst_buffer_new_allocate(NULL, OUTPUT_TEST_RECORD_SIZE, NULL);
+    gst_buffer_map(buffer, &map, GST_MAP_WRITE);
+    memset(map.data, 0, map.size);
+    map.data[0] = FLV_TAG_TYPE_VIDEO;
+    GST_WRITE_UINT24_BE(map.data + 1, FLV_TAG_DATA_SIZE);
+    GST_WRITE_UINT24_BE(map.data + 4, timestamp & 0xffffff);
+    map.data[7]                   = timestamp >> 24;
+    map.data[FLV_TAG_HEADER_SIZE] = (keyframe ? FLV_VIDEO_KEYFRAME : FLV_VIDEO_INTER_FRAME) << 4 | FLV_VIDEO_CODEC_AVC;
+    GST_WRITE_UINT64_BE(map.data + FLV_TAG_HEADER_SIZE + 1, produced);
+    GST_WRITE_UINT32_BE(map.data + map.size - 4, map.size - 4);
+    gst_buffer_unmap(buffer, &map);
+
+    g_signal_emit_by_name(source, "push-buffer", buffer, &ret);
+    gst_buffer_unref(buffer);
+    produced++;
+
+    return G_SOURCE_CONTINUE;
+}
+
+/* Closes the open connections & stops listening, as a crashing server would */
+static gboolean cb_kill_server(gpointer user_data)
+{
+    guint accepted = test_server_get_accepted(output_server) - accepted_before;
+
+    if (accepted == 0) {
+        g_printerr("Cycle %u: the output didn't connect.\n", cycle + 1);
+        failed = TRUE;
+        g_main_loop_quit(loop);
+        return G_SOURCE_REMOVE;
+    }
+
+    test_server_kill(output_server);
+
+    g_print("%5u %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT " %8u\n",
+            cycle + 1,
+            produced,
+            received,
+            produced - received,
+            accepted);
+    accepted_before += accepted;
+    g_timeout_add_seconds(downtime, cb_restart_server, NULL);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean cb_restart_server(gpointer user_data)
+{
+    if (!test_server_restart(output_server)) {
+        failed = TRUE;
+        g_main_loop_quit(loop);
+        return G_SOURCE_REMOVE;
+    }
+
+    if (++cycle < (guint)iterations) { g_timeout_add_seconds(uptime, cb_kill_server, NULL); }
+    else {
+        drain_until = g_get_monotonic_time() + OUTPUT_TEST_DRAIN * G_USEC_PER_SEC;
+        g_timeout_add(100, cb_check_drained, NULL);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean cb_check_drained(gpointer user_data)
+{
+    if (last_sequence != (gint64)produced - 1 && g_get_monotonic_time() < drain_until) { return G_SOURCE_CONTINUE; }
+
+    g_main_loop_quit(loop);
+    return G_SOURCE_REMOVE;
+}
+
+/* As muxed by flvmux: the FLV header is only in the caps, and sent by the output on each connection */
+static GstCaps * create_caps(void)
+{
+    static const guint8 flv_header[FLV_HEADER_SIZE] = {'F', 'L', 'V', 1, 1, 0, 0, 0, 9, 0, 0, 0, 0};
+    GstCaps *           caps                        = gst_caps_new_empty_simple("video/x-flv");
+    GstBuffer *         header                      = gst_buffer_new_allocate(NULL, sizeof(flv_header), NULL);
+    GValue              stream_header               = G_VALUE_INIT;
+    GValue              value                       = G_VALUE_INIT;
+
+    gst_buffer_fill(header, 0, flv_header, sizeof(flv_header));
+    GST_BUFFER_FLAG_SET(header, GST_BUFFER_FLAG_HEADER);
+    g_value_init(&stream_header, GST_TYPE_ARRAY);
+    g_value_init(&value, GST_TYPE_BUFFER);
+    gst_value_set_buffer(&value, header);
+    gst_value_array_append_and_take_value(&stream_header, &value);
+    gst_structure_take_value(gst_caps_get_structure(caps, 0), "streamheader", &stream_header);
+    gst_buffer_unref(header);
+
+    return caps;
+}
+
+/* Each connection starts with the FLV header. A partial tag is lost with its connection. */
+static void cb_output_receive(GSocketConnection * connection, const guint8 * data, gsize size, gpointer user_data)
+{
+    OutputConnection * output = g_object_get_data(G_OBJECT(connection), "output-test");
+
+    if (output == NULL) {
+        output                = g_new0(OutputConnection, 1);
+        output->last_sequence = -1;
+        g_object_set_data_full(G_OBJECT(connection), "output-test", output, g_free);
+    }
+
+    for (gsize offset = 0; offset < size;) {
+        gsize wanted = output->header_received ? OUTPUT_TEST_RECORD_SIZE : FLV_HEADER_SIZE;
+        gsize length = MIN(size - offset, wanted - output->filled);
+        memcpy(output->record + output->filled, data + offset, length);
+        output->filled += length;
+        offset += length;
+        if (output->filled < wanted) { break; }
+
+        output->filled = 0;
+        if (output->header_received) { check_record(output); }
+        else {
+            output->header_received = TRUE;
+            if (memcmp(output->record, "FLV", 3) != 0) {
+                g_printerr("A connection didn't start with the FLV header.\n");
+                failed = TRUE;
+            }
+        }
+    }
+}
+
+/* A tag on the wire already may not be received again, it would go back in time */
+static void check_record(OutputConnection * output)
+{
+    guint8 * tag      = output->record;
+    gint64   sequence = GST_READ_UINT64_BE(tag + FLV_TAG_HEADER_SIZE + 1);
+    gboolean keyframe = (tag[FLV_TAG_HEADER_SIZE] >> 4) == FLV_VIDEO_KEYFRAME;
+
+    if (tag[0] != FLV_TAG_TYPE_VIDEO || GST_READ_UINT24_BE(tag + 1) != FLV_TAG_DATA_SIZE || sequence < 0
+        || sequence >= (gint64)produced) {
+        g_printerr("Received a corrupted tag.\n");
+        failed = TRUE;
+        return;
+    }
+
+    if (sequence <= last_sequence) {
+        g_printerr("Tag %" G_GINT64_FORMAT " was received again or out of order, after %" G_GINT64_FORMAT ".\n",
+                   sequence,
+                   last_sequence);
+        duplicates++;
+        failed = TRUE;
+    }
+    else if (output->records == 0 && !keyframe) {
+        g_printerr("A connection started with tag %" G_GINT64_FORMAT ", which isn't a keyframe.\n", sequence);
+        failed = TRUE;
+    }
+    else if (output->records > 0 && sequence != output->last_sequence + 1) {
+        g_printerr("Tags %" G_GINT64_FORMAT " to %" G_GINT64_FORMAT " are missing within a connection.\n",
+                   output->last_sequence + 1,
+                   sequence - 1);
+        failed = TRUE;
+    }
+
+    if (sequence > last_sequence) {
+        received++;
+        last_sequence = sequence;
+    }
+    output->records++;
+    output->last_sequence = sequence;
+}
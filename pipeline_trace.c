@@ -0,0 +1,283 @@
+#include "pipeline_trace.h"
+
+#include <string.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define TRACE_RING_SIZE (1 << 15) /* events kept per thread, a power of 2 */
+#define TRACE_STACK_DEPTH 64
+
+typedef struct {
+    guint         seq; /* index + 1 once the event is complete, for the reader to detect torn events */
+    gchar         phase;
+    GstClockTime  ts;
+    const gchar * name; /* interned */
+    gpointer      id;   /* buffer, identifies the async (queue) spans */
+} TraceEvent;
+
+/* Names are looked up once per element, as g_intern_string() takes a global lock. Attached to the element, so */
+/* that it goes away with it: input recovery re-creates elements, possibly at the address of freed ones.      */
+typedef struct {
+    const gchar * name;
+    gboolean      is_queue;
+} TraceElement;
+
+/* Referenced by its thread (until it exits) and by the list of rings (until tracing stops) */
+typedef struct {
+    gint       refs;
+    guint      generation; /* of the list it was added to */
+    guint      tid;
+    gchar      thread_name[17];
+    guint      head; /* events written so far, only ever written by the owning thread */
+    TraceEvent events[TRACE_RING_SIZE];
+
+    /* Only accessed by the owning thread */
+    const gchar * stack[TRACE_STACK_DEPTH];
+    guint         depth;
+} TraceRing;
+
+typedef struct {
+    GstTracer parent;
+} PipelineTracer;
+
+typedef struct {
+    GstTracerClass parent_class;
+} PipelineTracerClass;
+
+GType pipeline_tracer_get_type(void);
+G_DEFINE_TYPE(PipelineTracer, pipeline_tracer, GST_TYPE_TRACER)
+
+static gint        active = FALSE;
+static GstTracer * tracer = NULL;
+static GMutex      rings_lock;
+static GPtrArray * rings      = NULL;
+static guint       generation = 0; /* bumped whenever the rings are released */
+static GQuark      element_quark;
+
+static void           cb_push_pre(GObject * self, GstClockTime ts, GstPad * pad, gpointer buffer);
+static void           cb_push_post(GObject * self, GstClockTime ts, GstPad * pad, GstFlowReturn res);
+static TraceRing *    get_ring();
+static void           ring_unref(gpointer data);
+static TraceElement * get_pad_element(GstPad * pad);
+static void           record(TraceRing * ring, gchar phase, GstClockTime ts, const gchar * name, gpointer id);
+static void           append_json_string(GString * json, const gchar * string);
+
+static GPrivate current_ring = G_PRIVATE_INIT(ring_unref);
+
+void pipeline_trace_start(void)
+{
+    g_mutex_lock(&rings_lock);
+    if (tracer == NULL) {
+        element_quark = g_quark_from_static_string("pipeline-trace-element");
+        rings         = g_ptr_array_new_with_free_func(ring_unref);
+        /* Registers the hooks, which stay registered for the rest of the process */
+        tracer = gst_object_ref_sink(g_object_new(pipeline_tracer_get_type(), NULL));
+    }
+    g_mutex_unlock(&rings_lock);
+
+    g_atomic_int_set(&active, TRUE);
+}
+
+void pipeline_trace_stop(void)
+{
+    g_atomic_int_set(&active, FALSE);
+
+    /* Threads still running keep theirs until they exit, or start a new one if tracing restarts */
+    g_mutex_lock(&rings_lock);
+    if (rings != NULL) { g_ptr_array_set_size(rings, 0); }
+    g_atomic_int_inc(&generation);
+    g_mutex_unlock(&rings_lock);
+}
+
+gboolean pipeline_trace_is_active(void)
+{
+    return g_atomic_int_get(&active);
+}
+
+gboolean pipeline_trace_write(const gchar * path)
+{
+    g_return_val_if_fail(path != NULL, FALSE);
+
+    GString * json  = g_string_new("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    gboolean  first = TRUE;
+
+    g_mutex_lock(&rings_lock);
+    for (guint r = 0; rings != NULL && r < rings->len; r++) {
+        TraceRing * ring = g_ptr_array_index(rings, r);
+
+        g_string_append_printf(json,
+                               "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+                               first ? "" : ",\n",
+                               ring->tid);
+        append_json_string(json, ring->thread_name);
+        g_string_append(json, "}}");
+        first = FALSE;
+
+        /* The ring keeps being written meanwhile, so only events that weren't overwritten while copied are kept */
+        guint head  = g_atomic_int_get(&ring->head);
+        guint count = MIN(head, TRACE_RING_SIZE);
+        for (guint n = 0; n < count; n++) {
+            guint        index = head - count + n;
+            TraceEvent * slot  = &ring->events[index & (TRACE_RING_SIZE - 1)];
+            guint        seq   = g_atomic_int_get(&slot->seq);
+            TraceEvent   event = *slot;
+            if (seq != index + 1 || g_atomic_int_get(&slot->seq) != seq) { continue; }
+
+            g_string_append(json, ",\n{\"name\":");
+            append_json_string(json, event.name);
+            g_string_append_printf(json,
+                                   ",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u",
+                                   event.id != NULL ? "queue" : "push",
+                                   event.phase,
+                                   event.ts / 1000.0,
+                                   ring->tid);
+            if (event.id != NULL) { g_string_append_printf(json, ",\"id\":\"%p\"", event.id); }
+            g_string_append(json, "}");
+        }
+    }
+    g_mutex_unlock(&rings_lock);
+
+    g_string_append(json, "\n]}\n");
+
+    GError * error   = NULL;
+    gboolean written = g_file_set_contents(path, json->str, json->len, &error);
+    if (!written) {
+        g_printerr("Could not write the trace to '%s': %s\n", path, error->message);
+        g_error_free(error);
+    }
+    g_string_free(json, TRUE);
+
+    return written;
+}
+
+/* private functions' definitions */
+
+static void pipeline_tracer_class_init(PipelineTracerClass * klass) {}
+
+static void pipeline_tracer_init(PipelineTracer * self)
+{
+    gst_tracing_register_hook(GST_TRACER(self), "pad-push-pre", G_CALLBACK(cb_push_pre));
+    gst_tracing_register_hook(GST_TRACER(self), "pad-push-post", G_CALLBACK(cb_push_post));
+    gst_tracing_register_hook(GST_TRACER(self), "pad-push-list-pre", G_CALLBACK(cb_push_pre));
+    gst_tracing_register_hook(GST_TRACER(self), "pad-push-list-post", G_CALLBACK(cb_push_post));
+}
+
+/* Runs on the pushing thread, before the buffer (or buffer list) enters the peer element. */
+/* The push span is named after the element receiving the data: it covers that element's  */
+/* processing, and (nested in it) everything downstream up to the next queue.              */
+static void cb_push_pre(GObject * self, GstClockTime ts, GstPad * pad, gpointer buffer)
+{
+    if (!g_atomic_int_get(&active)) { return; }
+
+    TraceRing *    ring    = get_ring();
+    TraceElement * source  = get_pad_element(pad);
+    GstPad *       peer    = GST_PAD_PEER(pad);
+    TraceElement * sink    = peer != NULL ? get_pad_element(peer) : NULL;
+    gboolean       is_list = GST_IS_BUFFER_LIST(buffer);
+    const gchar *  name    = sink != NULL ? sink->name : NULL;
+
+    /* The time buffers wait in queues */
+    if (!is_list && source != NULL && source->is_queue) { record(ring, 'e', ts, source->name, buffer); }
+    if (!is_list && sink != NULL && sink->is_queue) { record(ring, 'b', ts, sink->name, buffer); }
+
+    /* Pushes through ghost pads aren't recorded, they are part of the push into the bin */
+    if (ring->depth < TRACE_STACK_DEPTH) { ring->stack[ring->depth] = name; }
+    ring->depth++;
+    if (name != NULL) { record(ring, 'B', ts, name, NULL); }
+}
+
+static void cb_push_post(GObject * self, GstClockTime ts, GstPad * pad, GstFlowReturn res)
+{
+    /* The spans opened before tracing was stopped still get closed */
+    TraceRing * ring = g_private_get(&current_ring);
+    if (ring == NULL || ring->depth == 0) { return; }
+
+    ring->depth--;
+    if (ring->depth < TRACE_STACK_DEPTH && ring->stack[ring->depth] != NULL) {
+        record(ring, 'E', ts, ring->stack[ring->depth], NULL);
+    }
+}
+
+static TraceRing * get_ring()
+{
+    TraceRing * ring = g_private_get(&current_ring);
+    if (ring != NULL && ring->generation == (guint)g_atomic_int_get(&generation)) { return ring; }
+
+    /* Rings outlive their thread, so that its events can still be written out */
+    ring       = g_new0(TraceRing, 1);
+    ring->refs = 2;
+#ifdef __linux__
+    ring->tid = syscall(SYS_gettid);
+    prctl(PR_GET_NAME, ring->thread_name, 0, 0, 0);
+#else
+    static gint next_tid = 1;
+    ring->tid            = g_atomic_int_add(&next_tid, 1);
+    g_snprintf(ring->thread_name, sizeof(ring->thread_name), "thread %u", ring->tid);
+#endif
+    /* Drops the one of the previous generation, if any */
+    g_private_replace(&current_ring, ring);
+
+    g_mutex_lock(&rings_lock);
+    ring->generation = generation;
+    g_ptr_array_add(rings, ring);
+    g_mutex_unlock(&rings_lock);
+
+    return ring;
+}
+
+/* From the list of rings, or from the thread-local storage as the thread exits */
+static void ring_unref(gpointer data)
+{
+    TraceRing * ring = data;
+
+    if (!g_atomic_int_dec_and_test(&ring->refs)) { return; }
+    g_free(ring);
+}
+
+static TraceElement * get_pad_element(GstPad * pad)
+{
+    GstObject * parent = GST_OBJECT_PARENT(pad);
+    if (parent == NULL || !GST_IS_ELEMENT(parent)) { return NULL; }
+
+    TraceElement * element = g_object_get_qdata(G_OBJECT(parent), element_quark);
+    if (element != NULL) { return element; }
+
+    element           = g_new0(TraceElement, 1);
+    element->name     = g_intern_string(GST_OBJECT_NAME(parent));
+    element->is_queue = strcmp(G_OBJECT_TYPE_NAME(parent), "GstQueue") == 0;
+    /* Another thread pushing through the element may have attached one meanwhile */
+    if (!g_object_replace_qdata(G_OBJECT(parent), element_quark, NULL, element, g_free, NULL)) {
+        g_free(element);
+        element = g_object_get_qdata(G_OBJECT(parent), element_quark);
+    }
+
+    return element;
+}
+
+static void record(TraceRing * ring, gchar phase, GstClockTime ts, const gchar * name, gpointer id)
+{
+    guint        index = ring->head;
+    TraceEvent * event = &ring->events[index & (TRACE_RING_SIZE - 1)];
+
+    g_atomic_int_set(&event->seq, 0);
+    event->phase = phase;
+    event->ts    = ts;
+    event->name  = name;
+    event->id    = id;
+    g_atomic_int_set(&event->seq, index + 1);
+    g_atomic_int_set(&ring->head, index + 1);
+}
+
+static void append_json_string(GString * json, const gchar * string)
+{
+    g_string_append_c(json, '"');
+    for (const gchar * c = string; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') { g_string_append_c(json, '\\'); }
+        if ((guchar)*c < 0x20) { continue; }
+        g_string_append_c(json, *c);
+    }
+    g_string_append_c(json, '"');
+}
@@ -0,0 +1,25 @@
+#ifndef _PIPELINE_TRACE__H_
+#define _PIPELINE_TRACE__H_
+
+#include <gst/gst.h>
+
+/* Per-buffer tracing of all the pipelines of the process.                           */
+/* Hooks into the GStreamer tracing framework: every buffer pushed into an element    */
+/* opens a span (closed when the push returns) on the pushing thread, and every       */
+/* buffer waiting in a queue is recorded as an async span. Each thread records into   */
+/* its own lock-free ring, so only the most recent events are kept.                   */
+/* The events are exported in the Chrome trace event format (chrome://tracing or      */
+/* ui.perfetto.dev).                                                                  */
+
+/* Start recording. Until then (and once stopped) the hooks only check a flag. */
+void pipeline_trace_start(void);
+
+/* Stop recording, and release the events recorded so far */
+void pipeline_trace_stop(void);
+
+gboolean pipeline_trace_is_active(void);
+
+/* Write the events recorded so far as a JSON trace. Can be called while recording. */
+gboolean pipeline_trace_write(const gchar * path);
+
+#endif /* _PIPELINE_TRACE__H_ */
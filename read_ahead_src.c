@@ -0,0 +1,579 @@
+#include "read_ahead_src.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <gst/base/gstbasesrc.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define READ_AHEAD_FACTORY "readaheadsrc"
+#define READ_AHEAD_BLOCK (1024 * 1024) /* bytes per read, reads start at multiples of it */
+#define READ_AHEAD_MEMORY_ALIGN 4096   /* of the read buffers */
+#define READ_AHEAD_DEFAULT_WINDOW (16 * READ_AHEAD_BLOCK)
+#define READ_AHEAD_LOOK_BEHIND (256 * 1024) /* bytes kept before the last read, for demuxers stepping back */
+
+typedef struct {
+    GstBaseSrc parent;
+
+    /* Set before starting */
+    gchar * location;
+    guint64 window;
+    guint64 throttle; /* bytes/s, 0 for none */
+
+    gint    fd;
+    guint64 size;
+
+    GThread * reader;
+    GMutex    lock;
+    GCond     cond;
+    GQueue    chunks;        /* GstBuffers read ahead, contiguous from chunks_offset up to read_offset */
+    guint64   chunks_offset; /* in the file */
+    guint64   read_offset;   /* of the next read */
+    guint64   wanted_end;    /* of the pending request, read up to even past the window */
+    guint64   buffered;      /* bytes in chunks */
+    guint     generation;    /* bumped by every jump, to drop the read in flight */
+    gboolean  flushing;
+    gboolean  stopping;
+    gint      read_error;    /* errno of the failed read */
+
+    /* Metrics */
+    GstClockTime io_wait;
+} ReadAheadSrc;
+
+typedef struct {
+    GstBaseSrcClass parent_class;
+} ReadAheadSrcClass;
+
+#define READ_AHEAD_SRC(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), READ_AHEAD_SRC_TYPE_NAME, ReadAheadSrc))
+
+enum {
+    PROP_0,
+    PROP_LOCATION,
+    PROP_READ_AHEAD,
+    PROP_THROTTLE,
+    PROP_IO_WAIT,
+    PROP_BUFFER_LEVEL,
+};
+
+static void read_ahead_src_uri_handler_init(gpointer g_iface, gpointer iface_data);
+
+G_DEFINE_TYPE_WITH_CODE(ReadAheadSrc,
+                        read_ahead_src,
+                        GST_TYPE_BASE_SRC,
+                        G_IMPLEMENT_INTERFACE(GST_TYPE_URI_HANDLER, read_ahead_src_uri_handler_init))
+
+static GstStaticPadTemplate src_template
+    = GST_STATIC_PAD_TEMPLATE("src", GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+static gpointer    reader_thread(gpointer user_data);
+static gint        read_chunk(ReadAheadSrc * src, guint64 offset, GstBuffer ** chunk);
+static void        drop_chunks_before(ReadAheadSrc * src, guint64 offset);
+static void        jump_to(ReadAheadSrc * src, guint64 offset);
+static GstBuffer * copy_range(ReadAheadSrc * src, guint64 offset, gsize length);
+
+gboolean read_ahead_src_register(void)
+{
+    /* filesrc is PRIMARY */
+    return gst_element_register(NULL, READ_AHEAD_FACTORY, GST_RANK_PRIMARY + 1, READ_AHEAD_SRC_TYPE_NAME);
+}
+
+void read_ahead_src_fill_stats(GstElement * bin, guint index, GstStructure * stats)
+{
+    g_return_if_fail(GST_IS_BIN(bin) && stats != NULL);
+
+    GstIterator * iterator = gst_bin_iterate_all_by_element_factory_name(GST_BIN(bin), READ_AHEAD_FACTORY);
+    GValue        item     = G_VALUE_INIT;
+
+    if (gst_iterator_next(iterator, &item) == GST_ITERATOR_OK) {
+        ReadAheadSrc * src        = READ_AHEAD_SRC(g_value_get_object(&item));
+        gchar *        wait_name  = g_strdup_printf("input%u-io-wait", index + 1);
+        gchar *        level_name = g_strdup_printf("input%u-buffer-level", index + 1);
+
+        g_mutex_lock(&src->lock);
+        gst_structure_set(
+            stats, wait_name, G_TYPE_UINT64, src->io_wait, level_name, G_TYPE_UINT64, src->buffered, NULL);
+        g_mutex_unlock(&src->lock);
+
+        g_free(wait_name);
+        g_free(level_name);
+        g_value_unset(&item);
+    }
+    gst_iterator_free(iterator);
+}
+
+/* GstBaseSrc implementation */
+
+static gboolean read_ahead_src_start(GstBaseSrc * base)
+{
+    ReadAheadSrc * src = READ_AHEAD_SRC(base);
+    struct stat    info;
+
+    if (src->location == NULL) {
+        GST_ELEMENT_ERROR(src, RESOURCE, NOT_FOUND, ("No file name specified for reading."), (NULL));
+        return FALSE;
+    }
+    src->fd = open(src->location, O_RDONLY | O_CLOEXEC);
+    if (src->fd < 0 || fstat(src->fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        GST_ELEMENT_ERROR(src,
+                          RESOURCE,
+                          OPEN_READ,
+                          ("Could not open file \"%s\" for reading.", src->location),
+                          ("%s", src->fd < 0 ? g_strerror(errno) : "not a regular file"));
+        if (src->fd >= 0) { close(src->fd); }
+        src->fd = -1;
+        return FALSE;
+    }
+    src->size = info.st_size;
+#ifdef POSIX_FADV_SEQUENTIAL
+    /* Larger kernel read-ahead, underneath ours */
+    posix_fadvise(src->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    src->chunks_offset = 0;
+    src->read_offset   = 0;
+    src->wanted_end    = 0;
+    src->buffered      = 0;
+    src->read_error    = 0;
+    src->stopping      = FALSE;
+    src->reader        = g_thread_new("readahead", reader_thread, src);
+
+    return TRUE;
+}
+
+static gboolean read_ahead_src_stop(GstBaseSrc * base)
+{
+    ReadAheadSrc * src = READ_AHEAD_SRC(base);
+
+    g_mutex_lock(&src->lock);
+    src->stopping = TRUE;
+    g_cond_broadcast(&src->cond);
+    g_mutex_unlock(&src->lock);
+    g_thread_join(src->reader);
+    src->reader = NULL;
+
+    g_queue_clear_full(&src->chunks, (GDestroyNotify)gst_buffer_unref);
+    src->buffered = 0;
+    close(src->fd);
+    src->fd = -1;
+
+    return TRUE;
+}
+
+static gboolean read_ahead_src_get_size(GstBaseSrc * base, guint64 * size)
+{
+    ReadAheadSrc * src = READ_AHEAD_SRC(base);
+
+    if (src->fd < 0) { return FALSE; }
+    *size = src->size;
+
+    return TRUE;
+}
+
+static gboolean read_ahead_src_is_seekable(GstBaseSrc * base)
+{
+    return TRUE;
+}
+
+static gboolean read_ahead_src_unlock(GstBaseSrc * base)
+{
+    ReadAheadSrc * src = READ_AHEAD_SRC(base);
+
+    g_mutex_lock(&src->lock);
+    src->flushing = TRUE;
+    g_cond_broadcast(&src->cond);
+    g_mutex_unlock(&src->lock);
+
+    return TRUE;
+}
+
+static gboolean read_ahead_src_unlock_stop(GstBaseSrc * base)
+{
+    ReadAheadSrc * src = READ_AHEAD_SRC(base);
+
+    g_mutex_lock(&src->lock);
+    src->flushing = FALSE;
+    g_mutex_unlock(&src->lock);
+
+    return TRUE;
+}
+
+/* Serves any range, sequential reads (the usual case) are served from the window */
+static GstFlowReturn read_ahead_src_create(GstBaseSrc * base, guint64 offset, guint length, GstBuffer ** buffer)
+{
+    ReadAheadSrc * src          = READ_AHEAD_SRC(base);
+    GstFlowReturn  ret          = GST_FLOW_OK;
+    gint64         wait_started = 0;
+    gint           error        = 0;
+
+    g_mutex_lock(&src->lock);
+    if (offset >= src->size) {
+        g_mutex_unlock(&src->lock);
+        return GST_FLOW_EOS;
+    }
+    guint64 end = MIN(offset + length, src->size);
+
+    while (TRUE) {
+        if (src->flushing) {
+            ret = GST_FLOW_FLUSHING;
+            break;
+        }
+        if (src->read_error != 0) {
+            error = src->read_error;
+            ret   = GST_FLOW_ERROR;
+            break;
+        }
+
+        drop_chunks_before(src, offset > READ_AHEAD_LOOK_BEHIND ? offset - READ_AHEAD_LOOK_BEHIND : 0);
+        if (offset < src->chunks_offset || offset > src->read_offset + src->window) { jump_to(src, offset); }
+        if (src->read_offset >= end) { break; }
+
+        /* Requests larger than the window are read in full */
+        if (src->wanted_end < end) {
+            src->wanted_end = end;
+            g_cond_broadcast(&src->cond);
+        }
+
+        /* Storage is behind */
+        if (wait_started == 0) { wait_started = g_get_monotonic_time(); }
+        g_cond_wait(&src->cond, &src->lock);
+    }
+
+    if (wait_started != 0) { src->io_wait += (g_get_monotonic_time() - wait_started) * GST_USECOND; }
+    if (ret == GST_FLOW_OK) { *buffer = copy_range(src, offset, end - offset); }
+    g_mutex_unlock(&src->lock);
+
+    if (ret == GST_FLOW_ERROR) {
+        GST_ELEMENT_ERROR(
+            src, RESOURCE, READ, ("Could not read from file \"%s\".", src->location), ("%s", g_strerror(error)));
+    }
+
+    return ret;
+}
+
+/* GObject implementation */
+
+static void read_ahead_src_init(ReadAheadSrc * src)
+{
+    src->fd     = -1;
+    src->window = READ_AHEAD_DEFAULT_WINDOW;
+    g_mutex_init(&src->lock);
+    g_cond_init(&src->cond);
+    g_queue_init(&src->chunks);
+}
+
+static void read_ahead_src_finalize(GObject * object)
+{
+    ReadAheadSrc * src = READ_AHEAD_SRC(object);
+
+    g_free(src->location);
+    g_mutex_clear(&src->lock);
+    g_cond_clear(&src->cond);
+
+    G_OBJECT_CLASS(read_ahead_src_parent_class)->finalize(object);
+}
+
+static void read_ahead_src_set_property(GObject * object, guint prop_id, const GValue * value, GParamSpec * pspec)
+{
+    ReadAheadSrc * src = READ_AHEAD_SRC(object);
+
+    switch (prop_id) {
+    case PROP_LOCATION:
+        g_free(src->location);
+        src->location = g_value_dup_string(value);
+        break;
+    case PROP_READ_AHEAD:
+        g_mutex_lock(&src->lock);
+        src->window = MAX(g_value_get_uint64(value), READ_AHEAD_BLOCK);
+        g_cond_broadcast(&src->cond);
+        g_mutex_unlock(&src->lock);
+        break;
+    case PROP_THROTTLE:
+        g_mutex_lock(&src->lock);
+        src->throttle = g_value_get_uint64(value);
+        g_mutex_unlock(&src->lock);
+        break;
+    default: G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec); break;
+    }
+}
+
+static void read_ahead_src_get_property(GObject * object, guint prop_id, GValue * value, GParamSpec * pspec)
+{
+    ReadAheadSrc * src = READ_AHEAD_SRC(object);
+
+    g_mutex_lock(&src->lock);
+    switch (prop_id) {
+    case PROP_LOCATION: g_value_set_string(value, src->location); break;
+    case PROP_READ_AHEAD: g_value_set_uint64(value, src->window); break;
+    case PROP_THROTTLE: g_value_set_uint64(value, src->throttle); break;
+    case PROP_IO_WAIT: g_value_set_uint64(value, src->io_wait); break;
+    case PROP_BUFFER_LEVEL: g_value_set_uint64(value, src->buffered); break;
+    default: G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec); break;
+    }
+    g_mutex_unlock(&src->lock);
+}
+
+static void read_ahead_src_class_init(ReadAheadSrcClass * klass)
+{
+    GObjectClass *    object_class   = G_OBJECT_CLASS(klass);
+    GstElementClass * element_class  = GST_ELEMENT_CLASS(klass);
+    GstBaseSrcClass * base_src_class = GST_BASE_SRC_CLASS(klass);
+
+    object_class->set_property = read_ahead_src_set_property;
+    object_class->get_property = read_ahead_src_get_property;
+    object_class->finalize     = read_ahead_src_finalize;
+
+    base_src_class->start       = read_ahead_src_start;
+    base_src_class->stop        = read_ahead_src_stop;
+    base_src_class->get_size    = read_ahead_src_get_size;
+    base_src_class->is_seekable = read_ahead_src_is_seekable;
+    base_src_class->unlock      = read_ahead_src_unlock;
+    base_src_class->unlock_stop = read_ahead_src_unlock_stop;
+    base_src_class->create      = read_ahead_src_create;
+
+    g_object_class_install_property(
+        object_class,
+        PROP_LOCATION,
+        g_param_spec_string(
+            "location", NULL, "Path of the file to read", NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(object_class,
+                                    PROP_READ_AHEAD,
+                                    g_param_spec_uint64("read-ahead",
+                                                        NULL,
+                                                        "How much to read ahead, in bytes (at least one block)",
+                                                        0,
+                                                        G_MAXUINT64,
+                                                        READ_AHEAD_DEFAULT_WINDOW,
+                                                        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(object_class,
+                                    PROP_THROTTLE,
+                                    g_param_spec_uint64("throttle",
+                                                        NULL,
+                                                        "Limit the reads to this many bytes/s, to emulate slow "
+                                                        "storage (0 for no limit)",
+                                                        0,
+                                                        G_MAXUINT64,
+                                                        0,
+                                                        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(object_class,
+                                    PROP_IO_WAIT,
+                                    g_param_spec_uint64("io-wait",
+                                                        NULL,
+                                                        "Total time the reads waited for the storage, in ns",
+                                                        0,
+                                                        G_MAXUINT64,
+                                                        0,
+                                                        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(object_class,
+                                    PROP_BUFFER_LEVEL,
+                                    g_param_spec_uint64("buffer-level",
+                                                        NULL,
+                                                        "Bytes read ahead",
+                                                        0,
+                                                        G_MAXUINT64,
+                                                        0,
+                                                        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+    gst_element_class_add_static_pad_template(element_class, &src_template);
+    gst_element_class_set_static_metadata(element_class,
+                                          "Read-ahead file source",
+                                          "Source/File",
+                                          "Reads a file ahead of its consumer in a separate thread",
+                                          "ThreeVideoStream");
+}
+
+/* GstURIHandler implementation */
+
+static GstURIType read_ahead_src_uri_get_type(GType type)
+{
+    return GST_URI_SRC;
+}
+
+static const gchar * const * read_ahead_src_uri_get_protocols(GType type)
+{
+    static const gchar * protocols[] = {"file", NULL};
+    return protocols;
+}
+
+static gchar * read_ahead_src_uri_get_uri(GstURIHandler * handler)
+{
+    ReadAheadSrc * src = READ_AHEAD_SRC(handler);
+    return src->location != NULL ? gst_filename_to_uri(src->location, NULL) : NULL;
+}
+
+static gboolean read_ahead_src_uri_set_uri(GstURIHandler * handler, const gchar * uri, GError ** error)
+{
+    gchar * location = g_filename_from_uri(uri, NULL, error);
+    if (location == NULL) { return FALSE; }
+
+    g_object_set(handler, "location", location, NULL);
+    g_free(location);
+
+    return TRUE;
+}
+
+static void read_ahead_src_uri_handler_init(gpointer g_iface, gpointer iface_data)
+{
+    GstURIHandlerInterface * iface = g_iface;
+
+    iface->get_type      = read_ahead_src_uri_get_type;
+    iface->get_protocols = read_ahead_src_uri_get_protocols;
+    iface->get_uri       = read_ahead_src_uri_get_uri;
+    iface->set_uri       = read_ahead_src_uri_set_uri;
+}
+
+/* private functions' definitions */
+
+/* Keeps the window full, and reads up to the end of the pending request, unless a read failed. The lock */
+/* is only released around the I/O.                                                                       */
+static gpointer reader_thread(gpointer user_data)
+{
+    ReadAheadSrc * src = user_data;
+
+    g_mutex_lock(&src->lock);
+    while (!src->stopping) {
+        gboolean full = src->buffered >= src->window && src->read_offset >= src->wanted_end;
+        if (src->read_error != 0 || src->read_offset >= src->size || full) {
+            g_cond_wait(&src->cond, &src->lock);
+            continue;
+        }
+
+        guint64 offset     = src->read_offset;
+        guint   generation = src->generation;
+        guint64 throttle   = src->throttle;
+        gint64  started    = g_get_monotonic_time();
+#ifdef POSIX_FADV_WILLNEED
+        guint64 hint_offset = offset + src->window;
+#endif
+        g_mutex_unlock(&src->lock);
+
+        GstBuffer * chunk = NULL;
+        gint        error = read_chunk(src, offset, &chunk);
+#ifdef POSIX_FADV_WILLNEED
+        /* Let the kernel fetch the block after the window meanwhile */
+        posix_fadvise(src->fd, hint_offset, READ_AHEAD_BLOCK, POSIX_FADV_WILLNEED);
+#endif
+
+        g_mutex_lock(&src->lock);
+        if (throttle > 0 && chunk != NULL) {
+            gint64 deadline = started + gst_buffer_get_size(chunk) * G_USEC_PER_SEC / throttle;
+            while (!src->stopping && generation == src->generation && g_get_monotonic_time() < deadline) {
+                g_cond_wait_until(&src->cond, &src->lock, deadline);
+            }
+        }
+
+        if (generation != src->generation) {
+            /* The consumer jumped elsewhere meanwhile */
+            if (chunk != NULL) { gst_buffer_unref(chunk); }
+        }
+        else if (error != 0) {
+            src->read_error = error;
+        }
+        else {
+            g_queue_push_tail(&src->chunks, chunk);
+            src->buffered += gst_buffer_get_size(chunk);
+            src->read_offset += gst_buffer_get_size(chunk);
+        }
+        g_cond_broadcast(&src->cond);
+    }
+    g_mutex_unlock(&src->lock);
+
+    return NULL;
+}
+
+/* Read up to the next block boundary into page aligned memory. Returns an errno value on failure. */
+static gint read_chunk(ReadAheadSrc * src, guint64 offset, GstBuffer ** chunk)
+{
+    GstAllocationParams params;
+    GstMapInfo          map;
+    gsize               length = MIN(READ_AHEAD_BLOCK - offset % READ_AHEAD_BLOCK, src->size - offset);
+    gsize               done   = 0;
+    gint                error  = 0;
+
+    gst_allocation_params_init(&params);
+    params.align = READ_AHEAD_MEMORY_ALIGN - 1;
+    *chunk       = gst_buffer_new_allocate(NULL, length, &params);
+
+    gst_buffer_map(*chunk, &map, GST_MAP_WRITE);
+    while (done < length && error == 0) {
+        ssize_t result = pread(src->fd, map.data + done, length - done, offset + done);
+        if (result > 0) { done += result; }
+        else if (result == 0) {
+            error = EIO; /* the file shrunk */
+        }
+        else if (errno != EINTR) {
+            error = errno;
+        }
+    }
+    gst_buffer_unmap(*chunk, &map);
+
+    if (error != 0) { gst_buffer_replace(chunk, NULL); }
+    else {
+        GST_BUFFER_OFFSET(*chunk) = offset;
+    }
+
+    return error;
+}
+
+/* Called with the lock held */
+static void drop_chunks_before(ReadAheadSrc * src, guint64 offset)
+{
+    GstBuffer * chunk   = NULL;
+    gboolean    dropped = FALSE;
+
+    while ((chunk = g_queue_peek_head(&src->chunks)) != NULL
+           && GST_BUFFER_OFFSET(chunk) + gst_buffer_get_size(chunk) <= offset) {
+        g_queue_pop_head(&src->chunks);
+        src->chunks_offset += gst_buffer_get_size(chunk);
+        src->buffered -= gst_buffer_get_size(chunk);
+        gst_buffer_unref(chunk);
+        dropped = TRUE;
+    }
+    /* Room for the reader */
+    if (dropped) { g_cond_broadcast(&src->cond); }
+}
+
+/* Restart reading at @offset (e.g. after a seek), called with the lock held */
+static void jump_to(ReadAheadSrc * src, guint64 offset)
+{
+    g_queue_clear_full(&src->chunks, (GDestroyNotify)gst_buffer_unref);
+    src->chunks_offset = offset - offset % READ_AHEAD_BLOCK;
+    src->read_offset   = src->chunks_offset;
+    src->wanted_end    = 0;
+    src->buffered      = 0;
+    src->read_error    = 0;
+    src->generation++;
+    g_cond_broadcast(&src->cond);
+}
+
+/* Called with the lock held, for a range within the chunks */
+static GstBuffer * copy_range(ReadAheadSrc * src, guint64 offset, gsize length)
+{
+    GList *     first  = src->chunks.head;
+    GstBuffer * chunk  = NULL;
+    GstBuffer * buffer = NULL;
+    GstMapInfo  map;
+    gsize       done   = 0;
+
+    /* Skip the look-behind */
+    while (GST_BUFFER_OFFSET(first->data) + gst_buffer_get_size(first->data) <= offset) { first = first->next; }
+    chunk = first->data;
+
+    /* Usually within a single chunk, sharing its memory */
+    if (offset + length <= GST_BUFFER_OFFSET(chunk) + gst_buffer_get_size(chunk)) {
+        buffer = gst_buffer_copy_region(chunk, GST_BUFFER_COPY_MEMORY, offset - GST_BUFFER_OFFSET(chunk), length);
+    }
+    else {
+        buffer = gst_buffer_new_allocate(NULL, length, NULL);
+        gst_buffer_map(buffer, &map, GST_MAP_WRITE);
+        for (GList * link = first; link != NULL && done < length; link = link->next) {
+            chunk            = link->data;
+            gsize chunk_skip = offset + done - GST_BUFFER_OFFSET(chunk);
+            done += gst_buffer_extract(chunk, chunk_skip, map.data + done, length - done);
+        }
+        gst_buffer_unmap(buffer, &map);
+    }
+    GST_BUFFER_OFFSET(buffer)     = offset;
+    GST_BUFFER_OFFSET_END(buffer) = offset + length;
+
+    return buffer;
+}
@@ -0,0 +1,25 @@
+#ifndef _READ_AHEAD_SRC__H_
+#define _READ_AHEAD_SRC__H_
+
+#include <gst/gst.h>
+
+/* File source reading ahead of the decoder in its own thread, in large aligned blocks, so that latency */
+/* spikes of slow or shared (e.g. network) storage are absorbed by its window instead of stalling the   */
+/* input. Reads are served as soon as their range is in, i.e. playback starts from a partial window,    */
+/* while larger ones are read past the window. A little is kept behind the last read, so that demuxers  */
+/* stepping back across a block boundary don't restart the reading.                                     */
+/* It has properties "location", "read-ahead" (window, in bytes), "throttle" (bytes/s, to emulate slow  */
+/* storage) and the read-only "io-wait" (total time reads waited, in ns) and "buffer-level" (bytes).    */
+#define READ_AHEAD_SRC_TYPE_NAME (read_ahead_src_get_type())
+#define IS_READ_AHEAD_SRC(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj), READ_AHEAD_SRC_TYPE_NAME))
+
+GType read_ahead_src_get_type(void);
+
+/* Register the source with a higher rank than filesrc, so that from then on uridecodebin3 reads */
+/* file:// URIs with it (for the whole process).                                                  */
+gboolean read_ahead_src_register(void);
+
+/* Add the I/O metrics of the source within @bin, if any, to @stats (fields prefixed with "input<N>-") */
+void read_ahead_src_fill_stats(GstElement * bin, guint index, GstStructure * stats);
+
+#endif /* _READ_AHEAD_SRC__H_ */
@@ -0,0 +1,213 @@
+#include "read_ahead_src.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+#include <stdlib.h>
+
+/* Pulls ranges of a throttled file through the read-ahead source with its smallest window, the way demuxers */
+/* do: a read larger than the window, sequential reads, then steps back & forth across a block boundary (to  */
+/* be served without waiting for the storage again). Fails on wrong data, a wait where none is expected, or  */
+/* if the reads don't complete in time.                                                                      */
+
+#define READ_AHEAD_TEST_MIB (1024 * 1024) /* the block size of the source, and its smallest window */
+
+/* Input parameters */
+static int size     = 8;
+static int throttle = 4096;
+static int timeout  = 30;
+
+static GOptionEntry entries[] = {
+    {"size", 's', 0, G_OPTION_ARG_INT, &size, "Size of the test file, in MiB", NULL},
+    {"throttle", 't', 0, G_OPTION_ARG_INT, &throttle, "Reads of the file are limited to this many KiB/s", NULL},
+    {"timeout", 0, 0, G_OPTION_ARG_INT, &timeout, "Fail if the reads take longer, in seconds", NULL},
+    {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL},
+};
+
+/* A pull, which must not wait for the storage if @from_memory */
+typedef struct {
+    const gchar * name;
+    guint64       offset;
+    guint         length;
+    gboolean      from_memory;
+} TestRead;
+
+static GMainLoop *  loop;
+static gchar *      path;
+static GstElement * source;
+static GstPad *     source_pad;
+static gboolean     failed;
+
+static guint8   pattern_byte(guint64 offset);
+static gpointer read_thread(gpointer user_data);
+static gboolean check_read(const TestRead * read);
+static gboolean cb_timeout(gpointer user_data);
+
+int main(int argc, char * argv[])
+{
+    GError *         error   = NULL;
+    GOptionContext * context = g_option_context_new(" Pull ranges of a throttled file through the read-ahead source");
+    gint             fd      = -1;
+
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("option parsing failed: %s\n", error->message);
+        exit(1);
+    }
+    g_option_context_free(context);
+    if (size < 6 || throttle <= 0 || timeout <= 0) {
+        g_printerr("The test file is at least 6 MiB, read at a positive rate.\n");
+        exit(1);
+    }
+
+    gst_init(&argc, &argv);
+    loop = g_main_loop_new(NULL, FALSE);
+
+    gsize    length = (gsize)size * READ_AHEAD_TEST_MIB;
+    guint8 * data   = g_malloc(length);
+    for (gsize i = 0; i < length; i++) { data[i] = pattern_byte(i); }
+    fd = g_file_open_tmp("read-ahead-XXXXXX", &path, &error);
+    if (fd < 0 || !g_file_set_contents(path, (const gchar *)data, length, &error)) {
+        g_printerr("Could not write the test file: %s\n", error->message);
+        exit(1);
+    }
+    g_close(fd, NULL);
+    g_free(data);
+
+    read_ahead_src_register();
+    source = gst_element_factory_make("readaheadsrc", NULL);
+    g_object_set(source,
+                 "location",
+                 path,
+                 "read-ahead",
+                 (guint64)READ_AHEAD_TEST_MIB,
+                 "throttle",
+                 (guint64)throttle * 1024,
+                 NULL);
+
+    /* Pulled directly from the source pad, as by a demuxer */
+    source_pad = gst_element_get_static_pad(source, "src");
+    gst_element_set_state(source, GST_STATE_READY);
+    if (!gst_pad_activate_mode(source_pad, GST_PAD_MODE_PULL, TRUE)) {
+        g_printerr("Could not activate the source in pull mode.\n");
+        exit(1);
+    }
+    gst_element_set_state(source, GST_STATE_PAUSED);
+
+    GThread * reads = g_thread_new("reads", read_thread, NULL);
+    guint     timer = g_timeout_add_seconds(timeout, cb_timeout, NULL);
+    g_main_loop_run(loop);
+    g_thread_join(reads);
+    g_source_remove(timer);
+    g_print(failed ? "Read-ahead test failed.\n" : "Read-ahead test passed.\n");
+
+    gst_element_set_state(source, GST_STATE_NULL);
+    gst_object_unref(source_pad);
+    gst_object_unref(source);
+    g_unlink(path);
+    g_free(path);
+    g_main_loop_unref(loop);
+
+    gst_deinit();
+    return failed ? 1 : 0;
+}
+
+/* private functions' definitions */
+
+/* Doesn't repeat at block boundaries, i.e. data from the wrong block is detected */
+static guint8 pattern_byte(guint64 offset)
+{
+    return (guint8)(offset % 251);
+}
+
+static gpointer read_thread(gpointer user_data)
+{
+    const guint64  end          = (guint64)size * READ_AHEAD_TEST_MIB;
+    const guint64  boundary     = 5 * READ_AHEAD_TEST_MIB;
+    const TestRead test_reads[] = {
+        {"larger than the window", 100, 3 * READ_AHEAD_TEST_MIB, FALSE},
+        {"sequential", boundary - 128 * 1024, 64 * 1024, FALSE},
+        {"sequential", boundary - 64 * 1024, 64 * 1024, FALSE},
+        {"sequential", boundary, 64 * 1024, FALSE},
+        {"sequential", boundary + 64 * 1024, 64 * 1024, FALSE},
+        {"back across the boundary", boundary - 16 * 1024, 32 * 1024, TRUE},
+        {"forward again", boundary + 96 * 1024, 16 * 1024, TRUE},
+        {"back across the boundary", boundary - 100 * 1024, 4096, TRUE},
+        {"forward again", boundary + 100 * 1024, 4096, TRUE},
+        {"past the end", end - 1000, 4096, FALSE},
+    };
+
+    for (guint i = 0; i < G_N_ELEMENTS(test_reads) && !failed; i++) {
+        if (!check_read(&test_reads[i])) { failed = TRUE; }
+    }
+
+    GstBuffer *   buffer = NULL;
+    GstFlowReturn ret    = gst_pad_get_range(source_pad, end, 4096, &buffer);
+    if (!failed && ret != GST_FLOW_EOS) {
+        g_printerr("A read at the end of the file returned %s instead of EOS.\n", gst_flow_get_name(ret));
+        if (buffer != NULL) { gst_buffer_unref(buffer); }
+        failed = TRUE;
+    }
+
+    g_main_loop_quit(loop);
+    return NULL;
+}
+
+static gboolean check_read(const TestRead * read)
+{
+    GstBuffer * buffer   = NULL;
+    GstMapInfo  map;
+    guint64     wait     = 0;
+    guint64     waited   = 0;
+    guint64     size_end = (guint64)size * READ_AHEAD_TEST_MIB;
+    gsize       expected = MIN(read->offset + read->length, size_end) - read->offset;
+    gboolean    correct  = TRUE;
+    gint64      started  = g_get_monotonic_time();
+
+    g_object_get(source, "io-wait", &wait, NULL);
+    GstFlowReturn ret = gst_pad_get_range(source_pad, read->offset, read->length, &buffer);
+    g_object_get(source, "io-wait", &waited, NULL);
+
+    if (ret != GST_FLOW_OK) {
+        g_printerr("Read %s (%u bytes at %" G_GUINT64_FORMAT ") returned %s.\n",
+                   read->name,
+                   read->length,
+                   read->offset,
+                   gst_flow_get_name(ret));
+        return FALSE;
+    }
+
+    gst_buffer_map(buffer, &map, GST_MAP_READ);
+    correct = map.size == expected;
+    for (gsize i = 0; i < map.size && correct; i++) { correct = map.data[i] == pattern_byte(read->offset + i); }
+    gst_buffer_unmap(buffer, &map);
+    gst_buffer_unref(buffer);
+
+    g_print("%-26s %8u bytes at %8" G_GUINT64_FORMAT ": %6" G_GINT64_FORMAT " ms, waited %6" G_GUINT64_FORMAT
+            " ms\n",
+            read->name,
+            read->length,
+            read->offset,
+            (g_get_monotonic_time() - started) / 1000,
+            (waited - wait) / GST_MSECOND);
+
+    if (!correct) {
+        g_printerr("Read %s returned wrong data.\n", read->name);
+        return FALSE;
+    }
+    if (read->from_memory && waited != wait) {
+        g_printerr("Read %s waited for the storage, instead of being served from memory.\n", read->name);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* A read waiting forever, e.g. for data the source never reads */
+static gboolean cb_timeout(gpointer user_data)
+{
+    g_printerr("The reads didn't complete within %d seconds.\n", timeout);
+    g_unlink(path);
+    exit(1);
+    return G_SOURCE_REMOVE;
+}
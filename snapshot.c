@@ -0,0 +1,428 @@
+#include "snapshot.h"
+
+#include <gst/video/video.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define SNAPSHOT_WORKER_NICE 19
+
+struct _Snapshot {
+    GstElement * queue;
+    GstElement * appsink;
+    gulong       probe_id;
+
+    GMutex      lock;
+    GCond       cond;
+    guint       interval;
+    gchar *     format;
+    gint        width;
+    gint64      last_sample_time;
+    gboolean    requested;
+    GstSample * pending;
+    GBytes *    latest;
+    gboolean    stopping;
+    GThread *   worker;
+
+    /* Worker only. The scaling & the encoder are run right on the worker (instead of in a pipeline of their  */
+    /* own, e.g. gst_video_convert_sample()), so that they don't use threads which wouldn't be low priority.  */
+    GstVideoInfo        scaled_from;
+    GstVideoInfo        scaled_to;
+    GstVideoConverter * converter;
+    GstElement *        encoder;
+    gchar *             encoder_format;
+    GstPad *            encoder_input;  /* linked to the sink pad of the encoder */
+    GstPad *            encoder_output; /* linked to its src pad */
+    GstBuffer *         encoded;
+
+    /* Metrics */
+    guint   taken;
+    guint   failed;
+    guint64 encode_time;
+};
+
+static GstPadProbeReturn cb_sample_probe(GstPad * pad, GstPadProbeInfo * info, gpointer user_data);
+static GstFlowReturn     cb_new_sample(GstElement * appsink, gpointer user_data);
+static gpointer          encode_loop(gpointer user_data);
+static GstBuffer *       scale_frame(Snapshot * snapshot, GstSample * sample, const gchar * format, gint width);
+static GBytes *          encode_frame(Snapshot * snapshot, GstBuffer * frame, const gchar * format);
+static gboolean          encoder_open(Snapshot * snapshot, const gchar * format);
+static void              encoder_close(Snapshot * snapshot);
+static GstFlowReturn     cb_encoded(GstPad * pad, GstObject * parent, GstBuffer * buffer);
+static gboolean          cb_encoder_event(GstPad * pad, GstObject * parent, GstEvent * event);
+
+Snapshot * snapshot_new(GstElement * queue, GstElement * appsink)
+{
+    g_return_val_if_fail(queue != NULL && appsink != NULL, NULL);
+
+    Snapshot * snapshot = g_new0(Snapshot, 1);
+    snapshot->queue     = gst_object_ref(queue);
+    snapshot->appsink   = gst_object_ref(appsink);
+    snapshot->format    = g_strdup("jpeg");
+    snapshot->width     = 320;
+    g_mutex_init(&snapshot->lock);
+    g_cond_init(&snapshot->cond);
+
+    /* Never holds back the mixer: a single frame at most, which is replaced by a newer one */
+    g_object_set(queue,
+                 "leaky",
+                 2 /* downstream */,
+                 "max-size-buffers",
+                 1,
+                 "max-size-bytes",
+                 0,
+                 "max-size-time",
+                 (guint64)0,
+                 NULL);
+    /* Not async, as most of the time no frame reaches it (so it wouldn't preroll) */
+    g_object_set(appsink,
+                 "emit-signals",
+                 TRUE,
+                 "sync",
+                 FALSE,
+                 "async",
+                 FALSE,
+                 "max-buffers",
+                 1,
+                 "drop",
+                 TRUE,
+                 "enable-last-sample",
+                 FALSE,
+                 NULL);
+    g_signal_connect(appsink, "new-sample", G_CALLBACK(cb_new_sample), snapshot);
+
+    GstPad * queue_sink = gst_element_get_static_pad(queue, "sink");
+    snapshot->probe_id  = gst_pad_add_probe(queue_sink, GST_PAD_PROBE_TYPE_BUFFER, cb_sample_probe, snapshot, NULL);
+    gst_object_unref(queue_sink);
+
+    snapshot->worker = g_thread_new("snapshot", encode_loop, snapshot);
+
+    return snapshot;
+}
+
+void snapshot_set_interval(Snapshot * snapshot, guint interval)
+{
+    g_return_if_fail(snapshot != NULL);
+
+    g_mutex_lock(&snapshot->lock);
+    snapshot->interval = interval;
+    g_mutex_unlock(&snapshot->lock);
+}
+
+void snapshot_set_format(Snapshot * snapshot, const gchar * format, gint width)
+{
+    g_return_if_fail(snapshot != NULL && format != NULL && width > 0);
+
+    g_mutex_lock(&snapshot->lock);
+    g_free(snapshot->format);
+    snapshot->format = g_strdup(format);
+    snapshot->width  = width;
+    g_mutex_unlock(&snapshot->lock);
+}
+
+void snapshot_request(Snapshot * snapshot)
+{
+    g_return_if_fail(snapshot != NULL);
+
+    g_mutex_lock(&snapshot->lock);
+    snapshot->requested = TRUE;
+    g_mutex_unlock(&snapshot->lock);
+}
+
+GBytes * snapshot_get_latest(Snapshot * snapshot)
+{
+    g_return_val_if_fail(snapshot != NULL, NULL);
+
+    g_mutex_lock(&snapshot->lock);
+    GBytes * latest = snapshot->latest != NULL ? g_bytes_ref(snapshot->latest) : NULL;
+    g_mutex_unlock(&snapshot->lock);
+
+    return latest;
+}
+
+void snapshot_free(Snapshot * snapshot)
+{
+    g_return_if_fail(snapshot != NULL);
+
+    GstPad * queue_sink = gst_element_get_static_pad(snapshot->queue, "sink");
+    gst_pad_remove_probe(queue_sink, snapshot->probe_id);
+    gst_object_unref(queue_sink);
+    g_signal_handlers_disconnect_by_data(snapshot->appsink, snapshot);
+
+    g_mutex_lock(&snapshot->lock);
+    snapshot->stopping = TRUE;
+    g_cond_signal(&snapshot->cond);
+    g_mutex_unlock(&snapshot->lock);
+    g_thread_join(snapshot->worker);
+
+    if (snapshot->pending != NULL) { gst_sample_unref(snapshot->pending); }
+    if (snapshot->latest != NULL) { g_bytes_unref(snapshot->latest); }
+    gst_object_unref(snapshot->queue);
+    gst_object_unref(snapshot->appsink);
+    g_free(snapshot->format);
+    g_mutex_clear(&snapshot->lock);
+    g_cond_clear(&snapshot->cond);
+    g_free(snapshot);
+}
+
+void snapshot_fill_stats(Snapshot * snapshot, GstStructure * stats)
+{
+    g_return_if_fail(snapshot != NULL && stats != NULL);
+
+    g_mutex_lock(&snapshot->lock);
+    gst_structure_set(stats,
+                      "snapshot-taken",
+                      G_TYPE_UINT,
+                      snapshot->taken,
+                      "snapshot-failed",
+                      G_TYPE_UINT,
+                      snapshot->failed,
+                      "snapshot-encode-time",
+                      G_TYPE_UINT64,
+                      snapshot->taken > 0 ? snapshot->encode_time / snapshot->taken : (guint64)0,
+                      NULL);
+    g_mutex_unlock(&snapshot->lock);
+}
+
+/* private functions' definitions */
+
+/* Runs on the mixer's thread for every frame, so only decides whether to let the frame through */
+static GstPadProbeReturn cb_sample_probe(GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+    Snapshot * snapshot = user_data;
+    gint64     now      = g_get_monotonic_time();
+    gboolean   take     = FALSE;
+
+    g_mutex_lock(&snapshot->lock);
+    if (snapshot->requested
+        || (snapshot->interval > 0 && now - snapshot->last_sample_time >= snapshot->interval * G_TIME_SPAN_SECOND)) {
+        snapshot->requested        = FALSE;
+        snapshot->last_sample_time = now;
+        take                       = TRUE;
+    }
+    g_mutex_unlock(&snapshot->lock);
+
+    return take ? GST_PAD_PROBE_OK : GST_PAD_PROBE_DROP;
+}
+
+static GstFlowReturn cb_new_sample(GstElement * appsink, gpointer user_data)
+{
+    Snapshot *  snapshot = user_data;
+    GstSample * sample   = NULL;
+
+    g_signal_emit_by_name(appsink, "pull-sample", &sample);
+    if (sample == NULL) { return GST_FLOW_EOS; }
+
+    /* Hand it over to the worker, replacing a frame it didn't get to yet */
+    g_mutex_lock(&snapshot->lock);
+    if (snapshot->pending != NULL) { gst_sample_unref(snapshot->pending); }
+    snapshot->pending = sample;
+    g_cond_signal(&snapshot->cond);
+    g_mutex_unlock(&snapshot->lock);
+
+    return GST_FLOW_OK;
+}
+
+static gpointer encode_loop(gpointer user_data)
+{
+    Snapshot * snapshot = user_data;
+
+#ifdef __linux__
+    /* On Linux the nice value is per thread */
+    if (setpriority(PRIO_PROCESS, syscall(SYS_gettid), SNAPSHOT_WORKER_NICE) != 0) {
+        g_printerr("Could not lower the priority of the snapshot worker.\n");
+    }
+#endif
+
+    g_mutex_lock(&snapshot->lock);
+    while (!snapshot->stopping) {
+        if (snapshot->pending == NULL) {
+            g_cond_wait(&snapshot->cond, &snapshot->lock);
+            continue;
+        }
+
+        GstSample * sample = snapshot->pending;
+        gchar *     format = g_strdup(snapshot->format);
+        gint        width  = snapshot->width;
+        snapshot->pending  = NULL;
+        g_mutex_unlock(&snapshot->lock);
+
+        gint64      started = g_get_monotonic_time();
+        GstBuffer * scaled  = scale_frame(snapshot, sample, format, width);
+        GBytes *    image   = scaled != NULL ? encode_frame(snapshot, scaled, format) : NULL;
+        if (image == NULL) { g_printerr("Snapshot could not be encoded to %s.\n", format); }
+
+        if (scaled != NULL) { gst_buffer_unref(scaled); }
+        gst_sample_unref(sample);
+        g_free(format);
+
+        g_mutex_lock(&snapshot->lock);
+        if (image != NULL) {
+            if (snapshot->latest != NULL) { g_bytes_unref(snapshot->latest); }
+            snapshot->latest = image;
+            snapshot->taken++;
+            snapshot->encode_time += (g_get_monotonic_time() - started) * GST_USECOND;
+        }
+        else {
+            snapshot->failed++;
+        }
+    }
+    g_mutex_unlock(&snapshot->lock);
+
+    encoder_close(snapshot);
+    if (snapshot->converter != NULL) { gst_video_converter_free(snapshot->converter); }
+
+    return NULL;
+}
+
+/* Scale the frame to @width (keeping the aspect ratio of the mix), into a format the encoder of @format takes */
+static GstBuffer * scale_frame(Snapshot * snapshot, GstSample * sample, const gchar * format, gint width)
+{
+    GstVideoInfo  from;
+    GstVideoInfo  to;
+    GstVideoFrame from_frame;
+    GstVideoFrame to_frame;
+
+    if (!gst_video_info_from_caps(&from, gst_sample_get_caps(sample))) { return NULL; }
+    gint height = MAX(2, (gint)(((gint64)width * GST_VIDEO_INFO_HEIGHT(&from) / GST_VIDEO_INFO_WIDTH(&from)) & ~1));
+    gst_video_info_set_format(
+        &to, g_strcmp0(format, "png") == 0 ? GST_VIDEO_FORMAT_RGB : GST_VIDEO_FORMAT_I420, width, height);
+
+    /* A single thread, i.e. the worker */
+    if (snapshot->converter == NULL || !gst_video_info_is_equal(&from, &snapshot->scaled_from)
+        || !gst_video_info_is_equal(&to, &snapshot->scaled_to)) {
+        if (snapshot->converter != NULL) { gst_video_converter_free(snapshot->converter); }
+        snapshot->scaled_from = from;
+        snapshot->scaled_to   = to;
+        snapshot->converter   = gst_video_converter_new(
+            &from, &to, gst_structure_new("options", GST_VIDEO_CONVERTER_OPT_THREADS, G_TYPE_UINT, 1, NULL));
+    }
+    if (snapshot->converter == NULL) { return NULL; }
+
+    GstBuffer * scaled = gst_buffer_new_allocate(NULL, GST_VIDEO_INFO_SIZE(&to), NULL);
+    if (!gst_video_frame_map(&from_frame, &from, gst_sample_get_buffer(sample), GST_MAP_READ)) {
+        gst_buffer_unref(scaled);
+        return NULL;
+    }
+    if (!gst_video_frame_map(&to_frame, &to, scaled, GST_MAP_WRITE)) {
+        gst_video_frame_unmap(&from_frame);
+        gst_buffer_unref(scaled);
+        return NULL;
+    }
+    gst_video_converter_frame(snapshot->converter, &from_frame, &to_frame);
+    gst_video_frame_unmap(&to_frame);
+    gst_video_frame_unmap(&from_frame);
+
+    return scaled;
+}
+
+/* The encoder works synchronously, so the image is out once the frame is pushed */
+static GBytes * encode_frame(Snapshot * snapshot, GstBuffer * frame, const gchar * format)
+{
+    GBytes *   image = NULL;
+    GstMapInfo map;
+    GstSegment segment;
+
+    if (snapshot->encoder_format == NULL || g_strcmp0(format, snapshot->encoder_format) != 0) {
+        encoder_close(snapshot);
+        if (!encoder_open(snapshot, format)) { return NULL; }
+    }
+
+    /* Only sent when they changed, as the encoder resets on each. The segment follows the first ones. */
+    GstCaps * caps    = gst_video_info_to_caps(&snapshot->scaled_to);
+    GstCaps * current = gst_pad_get_current_caps(snapshot->encoder_input);
+    if (current == NULL || !gst_caps_is_equal(current, caps)) {
+        gst_pad_push_event(snapshot->encoder_input, gst_event_new_caps(caps));
+    }
+    if (current == NULL) {
+        gst_segment_init(&segment, GST_FORMAT_TIME);
+        gst_pad_push_event(snapshot->encoder_input, gst_event_new_segment(&segment));
+    }
+    else {
+        gst_caps_unref(current);
+    }
+    gst_caps_unref(caps);
+
+    if (gst_pad_push(snapshot->encoder_input, gst_buffer_ref(frame)) != GST_FLOW_OK) {
+        /* Re-created for the next one */
+        encoder_close(snapshot);
+    }
+    if (snapshot->encoded != NULL) {
+        if (gst_buffer_map(snapshot->encoded, &map, GST_MAP_READ)) {
+            image = g_bytes_new(map.data, map.size);
+            gst_buffer_unmap(snapshot->encoded, &map);
+        }
+        gst_buffer_replace(&snapshot->encoded, NULL);
+    }
+
+    return image;
+}
+
+/* The encoder isn't in a pipeline: it's linked to pads of the worker, and fed from it */
+static gboolean encoder_open(Snapshot * snapshot, const gchar * format)
+{
+    snapshot->encoder = gst_element_factory_make(g_strcmp0(format, "png") == 0 ? "pngenc" : "jpegenc", NULL);
+    if (snapshot->encoder == NULL) { return FALSE; }
+    gst_object_ref_sink(snapshot->encoder);
+
+    snapshot->encoder_input  = gst_object_ref_sink(gst_pad_new("snapshot_src", GST_PAD_SRC));
+    snapshot->encoder_output = gst_object_ref_sink(gst_pad_new("snapshot_sink", GST_PAD_SINK));
+    gst_pad_set_element_private(snapshot->encoder_output, snapshot);
+    gst_pad_set_chain_function(snapshot->encoder_output, cb_encoded);
+    gst_pad_set_event_function(snapshot->encoder_output, cb_encoder_event);
+    gst_pad_set_active(snapshot->encoder_input, TRUE);
+    gst_pad_set_active(snapshot->encoder_output, TRUE);
+
+    GstPad * encoder_sink = gst_element_get_static_pad(snapshot->encoder, "sink");
+    GstPad * encoder_src  = gst_element_get_static_pad(snapshot->encoder, "src");
+    gboolean linked       = gst_pad_link(snapshot->encoder_input, encoder_sink) == GST_PAD_LINK_OK
+                      && gst_pad_link(encoder_src, snapshot->encoder_output) == GST_PAD_LINK_OK;
+    gst_object_unref(encoder_sink);
+    gst_object_unref(encoder_src);
+    snapshot->encoder_format = g_strdup(format);
+
+    if (!linked || gst_element_set_state(snapshot->encoder, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        encoder_close(snapshot);
+        return FALSE;
+    }
+
+    gst_pad_push_event(snapshot->encoder_input, gst_event_new_stream_start("snapshot"));
+
+    return TRUE;
+}
+
+static void encoder_close(Snapshot * snapshot)
+{
+    if (snapshot->encoder != NULL) {
+        gst_element_set_state(snapshot->encoder, GST_STATE_NULL);
+        gst_clear_object(&snapshot->encoder);
+    }
+    if (snapshot->encoder_input != NULL) {
+        gst_pad_set_active(snapshot->encoder_input, FALSE);
+        gst_clear_object(&snapshot->encoder_input);
+    }
+    if (snapshot->encoder_output != NULL) {
+        gst_pad_set_active(snapshot->encoder_output, FALSE);
+        gst_clear_object(&snapshot->encoder_output);
+    }
+    gst_buffer_replace(&snapshot->encoded, NULL);
+    g_clear_pointer(&snapshot->encoder_format, g_free);
+}
+
+/* On the worker, from within gst_pad_push() */
+static GstFlowReturn cb_encoded(GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+    Snapshot * snapshot = gst_pad_get_element_private(pad);
+
+    gst_buffer_replace(&snapshot->encoded, NULL);
+    snapshot->encoded = buffer;
+
+    return GST_FLOW_OK;
+}
+
+/* Whatever the encoder outputs is taken as is */
+static gboolean cb_encoder_event(GstPad * pad, GstObject * parent, GstEvent * event)
+{
+    gst_event_unref(event);
+    return TRUE;
+}
@@ -0,0 +1,33 @@
+#ifndef _SNAPSHOT__H_
+#define _SNAPSHOT__H_
+
+#include <gst/gst.h>
+
+/* Sparse snapshots of the mix.                                                   */
+/* A pad probe in front of a leaky queue lets through one frame every interval    */
+/* (or when requested) and drops the rest, so the branch costs nothing between    */
+/* samples. The frames are downscaled and encoded on a low priority worker        */
+/* thread, and the latest image is kept in memory.                                */
+typedef struct _Snapshot Snapshot;
+
+/* @queue and @appsink form the snapshot branch of the mixer tee, they get configured here */
+Snapshot * snapshot_new(GstElement * queue, GstElement * appsink);
+
+/* Sample a frame every @interval seconds, 0 to sample only on request */
+void snapshot_set_interval(Snapshot * snapshot, guint interval);
+
+/* @format is either "jpeg" or "png", @width of the image (the height keeps the aspect ratio) */
+void snapshot_set_format(Snapshot * snapshot, const gchar * format, gint width);
+
+/* Sample the next frame, regardless of the interval */
+void snapshot_request(Snapshot * snapshot);
+
+/* Returns: (transfer full) (nullable): the latest encoded image */
+GBytes * snapshot_get_latest(Snapshot * snapshot);
+
+void snapshot_free(Snapshot * snapshot);
+
+/* Add the snapshot metrics to @stats (fields prefixed with "snapshot-") */
+void snapshot_fill_stats(Snapshot * snapshot, GstStructure * stats);
+
+#endif /* _SNAPSHOT__H_ */
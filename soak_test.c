@@ -0,0 +1,414 @@
+#include "test_support.h"
+#include "three_video_stream.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Cycles a ThreeVideoStream through start/stop, input swaps and output reconnections on synthetic inputs, */
+/* and fails once what is left over after a cycle (memory, fds, threads, live GStreamer objects) or the    */
+/* frame times of the mix grow beyond the configured bounds, compared to the first cycle after a warm-up.  */
+
+#define SOAK_INPUTS 4 /* the three inputs & a spare one to swap in */
+#define SOAK_INPUT_WIDTH 320
+#define SOAK_INPUT_HEIGHT 240
+#define SOAK_INPUT_MARGIN 5   /* s, the inputs are longer than a cycle by this much */
+#define SOAK_WARM_UP_CYCLES 1 /* plugins loaded, pools allocated, ... the baseline is the cycle after */
+#define SOAK_STREAM_KEY "soak"
+
+typedef struct {
+    guint64      rss; /* bytes */
+    guint        fds;
+    guint        threads;
+    gint         objects; /* live GstObjects, -1 without the leaks tracer */
+    gint         buffers; /* live GstBuffers, likewise */
+    GstClockTime frame_time; /* p99 of the mix over the cycle */
+} SoakSample;
+
+/* One start/stop cycle, driven from the main loop */
+typedef struct {
+    ThreeVideoStream * stream;
+    GstElement *       pipeline;
+    GMainLoop *        loop;
+    guint              index;
+    const gchar *      spare_input;
+    guint              accepted_at_start;
+    guint              accepted_at_drop;
+    gboolean           failed;
+} SoakCycle;
+
+/* Input parameters */
+static int      duration             = 3600;
+static int      iterations           = 0;
+static int      cycle_length         = 20;
+static gboolean no_output            = FALSE;
+static int      max_rss_growth       = 64;
+static int      max_fd_growth        = 4;
+static int      max_thread_growth    = 4;
+static int      max_object_growth    = 100;
+static int      max_buffer_growth    = 100;
+static int      max_frame_time_drift = 20;
+
+static GOptionEntry entries[] = {
+    {"duration", 'd', 0, G_OPTION_ARG_INT, &duration, "How long to run, in seconds", NULL},
+    {"iterations", 'i', 0, G_OPTION_ARG_INT, &iterations, "Number of cycles to run, instead of a duration", NULL},
+    {"cycle", 'c', 0, G_OPTION_ARG_INT, &cycle_length, "Length of each start/stop cycle, in seconds", NULL},
+    {"no-output", 'n', 0, G_OPTION_ARG_NONE, &no_output, "Don't stream, i.e. skip the output reconnections", NULL},
+    {"max-rss-growth", 0, 0, G_OPTION_ARG_INT, &max_rss_growth, "Bound of the resident memory growth, in MiB", NULL},
+    {"max-fd-growth", 0, 0, G_OPTION_ARG_INT, &max_fd_growth, "Bound of the open file descriptors growth", NULL},
+    {"max-thread-growth", 0, 0, G_OPTION_ARG_INT, &max_thread_growth, "Bound of the thread count growth", NULL},
+    {"max-object-growth", 0, 0, G_OPTION_ARG_INT, &max_object_growth, "Bound of the live GstObjects growth", NULL},
+    {"max-buffer-growth", 0, 0, G_OPTION_ARG_INT, &max_buffer_growth, "Bound of the live GstBuffers growth", NULL},
+    {"max-frame-time-drift",
+     0,
+     0,
+     G_OPTION_ARG_INT,
+     &max_frame_time_drift,
+     "Bound of the growth of the p99 frame time of the mix, in ms",
+     NULL},
+    {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL},
+};
+
+/* Stand-in for the ingest server, discarding the stream */
+static TestServer * output_server;
+
+static gboolean run_cycle(guint index, gchar ** inputs, SoakSample * sample);
+static void     take_sample(SoakSample * sample);
+static gboolean check_growth(const SoakSample * baseline, const SoakSample * sample);
+static void     count_live_objects(gint * objects, gint * buffers);
+static guint    read_status_value(const gchar * key);
+
+static gboolean cb_bus_message(GstBus * bus, GstMessage * message, gpointer user_data);
+static gboolean cb_swap_input(gpointer user_data);
+static gboolean cb_drop_output(gpointer user_data);
+static gboolean cb_end_cycle(gpointer user_data);
+
+int main(int argc, char * argv[])
+{
+    GError *         error    = NULL;
+    GOptionContext * context  = g_option_context_new(" Soak test the stream through repeated start/stop cycles");
+    gboolean         failed   = FALSE;
+    SoakSample       baseline = {0};
+    SoakSample       sample   = {0};
+    gint64           started  = g_get_monotonic_time();
+    gchar *          inputs[SOAK_INPUTS + 1] = {NULL};
+    const gchar *    patterns[SOAK_INPUTS]   = {"smpte", "ball", "pinwheel", "zone-plate"};
+    const gchar *    waves[SOAK_INPUTS]      = {"sine", "square", "saw", "triangle"};
+
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("option parsing failed: %s\n", error->message);
+        exit(1);
+    }
+    g_option_context_free(context);
+    if (cycle_length < 3 || duration <= 0 || iterations < 0) {
+        g_printerr("A cycle takes at least 3 seconds, and the duration must be positive.\n");
+        exit(1);
+    }
+
+    /* Counts the live objects, unless other tracers were asked for */
+    g_setenv("GST_TRACERS", "leaks", FALSE);
+    gst_init(&argc, &argv);
+
+    gchar * directory = g_dir_make_tmp("soak-XXXXXX", &error);
+    if (directory == NULL) {
+        g_printerr("Could not create a directory for the inputs: %s\n", error->message);
+        exit(1);
+    }
+    for (guint i = 0; i < SOAK_INPUTS && !failed; i++) {
+        gchar * name = g_strdup_printf("input%u.mkv", i + 1);
+        inputs[i]    = g_build_filename(directory, name, NULL);
+        failed       = !test_input_create(
+            inputs[i], patterns[i], waves[i], SOAK_INPUT_WIDTH, SOAK_INPUT_HEIGHT, cycle_length + SOAK_INPUT_MARGIN);
+        g_free(name);
+    }
+    if (!failed && !no_output) {
+        output_server = test_server_new(NULL, NULL);
+        failed        = output_server == NULL;
+    }
+
+    g_print("%5s %10s %5s %7s %8s %8s %10s\n", "cycle", "RSS (MiB)", "fds", "threads", "objects", "buffers", "p99 ms");
+    for (guint i = 0; !failed; i++) {
+        gint64 elapsed = (g_get_monotonic_time() - started) / G_USEC_PER_SEC;
+        if (iterations > 0 ? i >= (guint)iterations : elapsed + cycle_length > duration) { break; }
+
+        failed = !run_cycle(i, inputs, &sample);
+        g_print("%5u %10.1f %5u %7u %8d %8d %10.2f\n",
+                i + 1,
+                sample.rss / (1024.0 * 1024.0),
+                sample.fds,
+                sample.threads,
+                sample.objects,
+                sample.buffers,
+                (gdouble)sample.frame_time / GST_MSECOND);
+
+        if (i == SOAK_WARM_UP_CYCLES) { baseline = sample; }
+        else if (i > SOAK_WARM_UP_CYCLES && !failed) {
+            failed = !check_growth(&baseline, &sample);
+        }
+    }
+    g_print(failed ? "Soak test failed.\n" : "Soak test passed.\n");
+
+    if (output_server != NULL) { test_server_free(output_server); }
+    for (guint i = 0; inputs[i] != NULL; i++) { g_unlink(inputs[i]); }
+    g_rmdir(directory);
+    g_free(directory);
+    for (guint i = 0; inputs[i] != NULL; i++) { g_free(inputs[i]); }
+
+    gst_deinit();
+    return failed ? 1 : 0;
+}
+
+/* private functions' definitions */
+
+/* Start the stream, swap an input after a third of the cycle, drop the output connection at half of it, */
+/* stop it at the end, and measure what is left once it's gone                                          */
+static gboolean run_cycle(guint index, gchar ** inputs, SoakSample * sample)
+{
+    SoakCycle      cycle = {0};
+    GstStructure * stats = NULL;
+    guint          timeouts[3];
+
+    cycle.index       = index;
+    cycle.spare_input = inputs[SOAK_INPUTS - 1];
+    cycle.loop        = g_main_loop_new(NULL, FALSE);
+    cycle.stream      = three_video_stream_new(inputs[0], inputs[1], inputs[2], no_output ? "" : SOAK_STREAM_KEY);
+    if (!no_output) {
+        gchar * server = g_strdup_printf("tcp://127.0.0.1:%u/", test_server_get_port(output_server));
+        g_object_set(cycle.stream, "twitch-server", server, NULL);
+        g_free(server);
+        cycle.accepted_at_start = test_server_get_accepted(output_server);
+    }
+    g_object_set(cycle.stream, "ready-to-play", TRUE, NULL);
+    g_object_get(cycle.stream, "gst-pipeline", &cycle.pipeline, NULL);
+
+    GstBus * bus      = gst_element_get_bus(cycle.pipeline);
+    guint    watch_id = gst_bus_add_watch(bus, cb_bus_message, &cycle);
+    gst_object_unref(bus);
+
+    timeouts[0] = g_timeout_add(cycle_length * 1000 / 3, cb_swap_input, &cycle);
+    timeouts[1] = no_output ? 0 : g_timeout_add(cycle_length * 1000 / 2, cb_drop_output, &cycle);
+    timeouts[2] = g_timeout_add(cycle_length * 1000, cb_end_cycle, &cycle);
+
+    gst_element_set_state(cycle.pipeline, GST_STATE_PAUSED);
+    g_main_loop_run(cycle.loop);
+
+    /* Some are still pending if the cycle ended on an error */
+    for (guint i = 0; i < G_N_ELEMENTS(timeouts); i++) {
+        GSource * source = timeouts[i] != 0 ? g_main_context_find_source_by_id(NULL, timeouts[i]) : NULL;
+        if (source != NULL) { g_source_destroy(source); }
+    }
+    g_source_remove(watch_id);
+
+    g_object_get(cycle.stream, "stats", &stats, NULL);
+    if (!gst_structure_get_uint64(stats, "frame-time-p99", &sample->frame_time)) { sample->frame_time = 0; }
+    gst_structure_free(stats);
+
+    gst_element_set_state(cycle.pipeline, GST_STATE_NULL);
+    gst_object_unref(cycle.pipeline);
+    three_video_stream_free(cycle.stream);
+    g_main_loop_unref(cycle.loop);
+
+    /* Let the deferred clean-ups run, e.g. of slates */
+    while (g_main_context_iteration(NULL, FALSE)) {}
+
+    take_sample(sample);
+
+    return !cycle.failed;
+}
+
+static void take_sample(SoakSample * sample)
+{
+    gchar * statm = NULL;
+    GDir *  fds   = g_dir_open("/proc/self/fd", 0, NULL);
+
+    /* The second field is the resident set, in pages */
+    sample->rss = 0;
+    if (g_file_get_contents("/proc/self/statm", &statm, NULL, NULL)) {
+        gchar ** fields = g_strsplit(statm, " ", 3);
+        if (fields[0] != NULL && fields[1] != NULL) {
+            sample->rss = g_ascii_strtoull(fields[1], NULL, 10) * sysconf(_SC_PAGESIZE);
+        }
+        g_strfreev(fields);
+        g_free(statm);
+    }
+
+    /* Not counting the one of the directory being read */
+    sample->fds = 0;
+    if (fds != NULL) {
+        while (g_dir_read_name(fds) != NULL) { sample->fds++; }
+        g_dir_close(fds);
+        sample->fds--;
+    }
+
+    sample->threads = read_status_value("Threads:");
+    count_live_objects(&sample->objects, &sample->buffers);
+}
+
+static gboolean check_growth(const SoakSample * baseline, const SoakSample * sample)
+{
+    gboolean within = TRUE;
+
+    if (sample->rss > baseline->rss + (guint64)max_rss_growth * 1024 * 1024) {
+        g_printerr("The resident memory grew by %.1f MiB.\n", (sample->rss - baseline->rss) / (1024.0 * 1024.0));
+        within = FALSE;
+    }
+    if (sample->fds > baseline->fds + max_fd_growth) {
+        g_printerr("%u more file descriptors are open.\n", sample->fds - baseline->fds);
+        within = FALSE;
+    }
+    if (sample->threads > baseline->threads + max_thread_growth) {
+        g_printerr("%u more threads are running.\n", sample->threads - baseline->threads);
+        within = FALSE;
+    }
+    if (baseline->objects >= 0 && sample->objects > baseline->objects + max_object_growth) {
+        g_printerr("%d more GstObjects are alive.\n", sample->objects - baseline->objects);
+        within = FALSE;
+    }
+    if (baseline->buffers >= 0 && sample->buffers > baseline->buffers + max_buffer_growth) {
+        g_printerr("%d more GstBuffers are alive.\n", sample->buffers - baseline->buffers);
+        within = FALSE;
+    }
+    if (sample->frame_time > baseline->frame_time + max_frame_time_drift * GST_MSECOND) {
+        g_printerr("The p99 frame time drifted by %.2f ms.\n",
+                   (gdouble)(sample->frame_time - baseline->frame_time) / GST_MSECOND);
+        within = FALSE;
+    }
+
+    return within;
+}
+
+/* From the leaks tracer, if it is active (see GST_TRACERS) */
+static void count_live_objects(gint * objects, gint * buffers)
+{
+    GList * tracers = gst_tracing_get_active_tracers();
+
+    *objects = -1;
+    *buffers = -1;
+    for (GList * tracer = tracers; tracer != NULL; tracer = tracer->next) {
+        GstStructure * live = NULL;
+
+        if (strcmp(G_OBJECT_TYPE_NAME(tracer->data), "GstLeaksTracer") != 0) { continue; }
+        g_signal_emit_by_name(tracer->data, "get-live-objects", &live);
+        if (live == NULL) { continue; }
+
+        const GValue * list = gst_structure_get_value(live, "live-objects-list");
+        *objects            = 0;
+        *buffers            = 0;
+        for (guint i = 0; list != NULL && i < gst_value_list_get_size(list); i++) {
+            const GstStructure * info   = gst_value_get_structure(gst_value_list_get_value(list, i));
+            const GValue *       object = gst_structure_get_value(info, "object");
+            GType                type   = object != NULL ? G_VALUE_TYPE(object) : G_TYPE_INVALID;
+            if (g_type_is_a(type, GST_TYPE_BUFFER)) { (*buffers)++; }
+            else if (g_type_is_a(type, GST_TYPE_OBJECT)) {
+                (*objects)++;
+            }
+        }
+        gst_structure_free(live);
+    }
+    g_list_free_full(tracers, gst_object_unref);
+}
+
+/* e.g. "Threads:" from /proc/self/status */
+static guint read_status_value(const gchar * key)
+{
+    gchar * status = NULL;
+    guint   value  = 0;
+
+    if (!g_file_get_contents("/proc/self/status", &status, NULL, NULL)) { return 0; }
+    const gchar * line = strstr(status, key);
+    if (line != NULL) { value = (guint)g_ascii_strtoull(line + strlen(key), NULL, 10); }
+    g_free(status);
+
+    return value;
+}
+
+static gboolean cb_bus_message(GstBus * bus, GstMessage * message, gpointer user_data)
+{
+    SoakCycle * cycle = user_data;
+
+    switch (GST_MESSAGE_TYPE(message)) {
+    case GST_MESSAGE_ERROR: {
+        GError * err  = NULL;
+        gchar *  name = gst_object_get_path_string(message->src);
+
+        gst_message_parse_error(message, &err, NULL);
+        g_printerr("Cycle %u: error from %s: %s\n", cycle->index + 1, name, err->message);
+        g_error_free(err);
+        g_free(name);
+
+        cycle->failed = TRUE;
+        g_main_loop_quit(cycle->loop);
+        break;
+    }
+    case GST_MESSAGE_EOS:
+        g_printerr("Cycle %u: the inputs ended before the cycle.\n", cycle->index + 1);
+        cycle->failed = TRUE;
+        g_main_loop_quit(cycle->loop);
+        break;
+    case GST_MESSAGE_STATE_CHANGED: {
+        GstState new_state = GST_STATE_NULL;
+        gst_message_parse_state_changed(message, NULL, &new_state, NULL);
+        if (GST_MESSAGE_SRC(message) == GST_OBJECT(cycle->pipeline) && new_state == GST_STATE_PAUSED) {
+            gst_element_set_state(cycle->pipeline, GST_STATE_PLAYING);
+        }
+        break;
+    }
+    case GST_MESSAGE_LATENCY: gst_bin_recalculate_latency(GST_BIN(cycle->pipeline)); break;
+    default: break;
+    }
+
+    return TRUE;
+}
+
+/* Through the control API, as a client would */
+static gboolean cb_swap_input(gpointer user_data)
+{
+    SoakCycle *    cycle   = user_data;
+    GError *       error   = NULL;
+    gchar *        name    = g_strdup_printf("file-path%u", cycle->index % 3 + 1);
+    GstStructure * changes = gst_structure_new("changes", name, G_TYPE_STRING, cycle->spare_input, NULL);
+
+    if (!three_video_stream_apply(cycle->stream, changes, &error)) {
+        g_printerr("Cycle %u: could not swap an input: %s\n", cycle->index + 1, error->message);
+        g_error_free(error);
+        cycle->failed = TRUE;
+        g_main_loop_quit(cycle->loop);
+    }
+    gst_structure_free(changes);
+    g_free(name);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean cb_drop_output(gpointer user_data)
+{
+    SoakCycle * cycle = user_data;
+
+    cycle->accepted_at_drop = test_server_get_accepted(output_server);
+    if (cycle->accepted_at_drop == cycle->accepted_at_start) {
+        g_printerr("Cycle %u: the output never connected.\n", cycle->index + 1);
+        cycle->failed = TRUE;
+        g_main_loop_quit(cycle->loop);
+        return G_SOURCE_REMOVE;
+    }
+    test_server_drop_connections(output_server);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean cb_end_cycle(gpointer user_data)
+{
+    SoakCycle * cycle = user_data;
+
+    if (!no_output && test_server_get_accepted(output_server) == cycle->accepted_at_drop) {
+        g_printerr("Cycle %u: the output didn't reconnect.\n", cycle->index + 1);
+        cycle->failed = TRUE;
+    }
+    g_main_loop_quit(cycle->loop);
+
+    return G_SOURCE_REMOVE;
+}
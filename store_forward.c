@@ -0,0 +1,671 @@
+#include "store_forward.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#define RECONNECT_INITIAL_DELAY_MS 1000
+#define RECONNECT_MAX_DELAY_MS 30000
+#define OUTPUT_QUEUE_BYTES (1 << 20)
+
+/* FLV tag header: type (1 byte), data size (3), timestamp (4), stream id (3), then the tag data */
+#define FLV_TAG_TYPE_VIDEO 9
+#define FLV_TAG_HEADER_SIZE 11
+#define FLV_VIDEO_KEYFRAME 1
+
+typedef struct _StoredBuffer {
+    GstBuffer * buffer;
+    gboolean    keyframe;
+    gboolean    on_wire; /* reached the sink, i.e. it may have been written */
+} StoredBuffer;
+
+/* Record header of the buffers spilled to disk, followed by the buffer data */
+typedef struct _SpillHeader {
+    guint64 pts;
+    guint64 dts;
+    guint32 size;
+    guint32 keyframe;
+} SpillHeader;
+
+struct _StoreForward {
+    GstElement *   appsink;
+    gchar *        location;
+    guint64        max_memory_bytes;
+    guint64        max_disk_bytes;
+    gboolean       catch_up;
+    ThreadPolicy * thread_policy;
+
+    GMutex    lock;
+    GCond     cond;
+    GQueue    memory; /* StoredBuffer *, oldest first. Always older than the spilled ones */
+    guint64   memory_bytes;
+    FILE *    spill;
+    off_t     spill_read_pos;
+    off_t     spill_write_pos;
+    guint     spill_count;
+    guint64   spill_bytes;
+    guint     keyframes_queued;
+    GstCaps * caps;
+    GQueue    sent; /* StoredBuffer *, pushed to the output but not written by its sink yet, oldest first */
+
+    GstElement * output;
+    GstElement * output_src;
+    guint        output_buffers; /* buffers which reached the sink of the current output */
+    gboolean     connected;      /* the sink of the current output wrote data */
+    gboolean     needs_header;
+    gboolean     needs_keyframe; /* a new connection starts on a video keyframe */
+    gboolean     stopping;
+    GThread *    forwarder;
+    guint        bus_watch_id;
+    guint        reconnect_source_id;
+    guint        reconnect_delay_ms;
+
+    /* Metrics */
+    guint   outages;
+    guint64 dropped_bytes;
+};
+
+static GstFlowReturn     cb_new_sample(GstElement * appsink, gpointer user_data);
+static gboolean          cb_output_bus_message(GstBus * bus, GstMessage * message, gpointer user_data);
+static GstBusSyncReply   cb_output_sync_message(GstBus * bus, GstMessage * message, gpointer user_data);
+static GstPadProbeReturn cb_output_buffer(GstPad * pad, GstPadProbeInfo * info, gpointer user_data);
+static gpointer          forward_loop(gpointer user_data);
+static gboolean          connect_output(gpointer user_data);
+static void              disconnect_output(StoreForward * store_forward);
+static GstElement *      create_output_sink(const gchar * location);
+static void              push_stream_header(GstElement * output_src, GstCaps * caps);
+static gboolean          is_video_keyframe(GstBuffer * buffer);
+static void              enqueue_locked(StoreForward * store_forward, GstBuffer * buffer);
+static StoredBuffer *    dequeue_locked(StoreForward * store_forward);
+static void              requeue_locked(StoreForward * store_forward, StoredBuffer * stored);
+static void              requeue_sent_locked(StoreForward * store_forward);
+static void              skip_to_latest_keyframe_locked(StoreForward * store_forward);
+static void              spill_write_locked(StoreForward * store_forward, StoredBuffer * stored);
+static void              spill_read_locked(StoreForward * store_forward);
+static void              spill_discard_locked(StoreForward * store_forward);
+static void              stored_buffer_free(StoredBuffer * stored);
+
+StoreForward * store_forward_new(GstElement * appsink)
+{
+    g_return_val_if_fail(appsink != NULL, NULL);
+
+    StoreForward * store_forward      = g_new0(StoreForward, 1);
+    store_forward->appsink            = gst_object_ref(appsink);
+    store_forward->max_memory_bytes   = 64 * 1024 * 1024;
+    store_forward->max_disk_bytes     = 0;
+    store_forward->catch_up           = TRUE;
+    store_forward->reconnect_delay_ms = RECONNECT_INITIAL_DELAY_MS;
+    g_mutex_init(&store_forward->lock);
+    g_cond_init(&store_forward->cond);
+    g_queue_init(&store_forward->memory);
+    g_queue_init(&store_forward->sent);
+
+    /* Keeps the main pipeline running in real time, while the buffers are taken over right away */
+    g_object_set(appsink, "emit-signals", TRUE, "sync", TRUE, "max-buffers", 0, NULL);
+    g_signal_connect(appsink, "new-sample", G_CALLBACK(cb_new_sample), store_forward);
+
+    return store_forward;
+}
+
+void store_forward_set_limits(StoreForward * store_forward, guint64 max_memory_bytes, guint64 max_disk_bytes)
+{
+    g_return_if_fail(store_forward != NULL);
+
+    g_mutex_lock(&store_forward->lock);
+    store_forward->max_memory_bytes = max_memory_bytes;
+    store_forward->max_disk_bytes   = max_disk_bytes;
+    g_mutex_unlock(&store_forward->lock);
+}
+
+void store_forward_set_thread_policy(StoreForward * store_forward, ThreadPolicy * policy)
+{
+    g_return_if_fail(store_forward != NULL);
+    g_return_if_fail(store_forward->forwarder == NULL);
+
+    store_forward->thread_policy = policy;
+}
+
+void store_forward_set_catch_up(StoreForward * store_forward, gboolean catch_up)
+{
+    g_return_if_fail(store_forward != NULL);
+
+    g_mutex_lock(&store_forward->lock);
+    store_forward->catch_up = catch_up;
+    g_mutex_unlock(&store_forward->lock);
+}
+
+void store_forward_start(StoreForward * store_forward, const gchar * location)
+{
+    g_return_if_fail(store_forward != NULL && location != NULL);
+    g_return_if_fail(store_forward->forwarder == NULL);
+
+    store_forward->location  = g_strdup(location);
+    store_forward->forwarder = g_thread_new("store-forward", forward_loop, store_forward);
+    connect_output(store_forward);
+}
+
+void store_forward_free(StoreForward * store_forward)
+{
+    g_return_if_fail(store_forward != NULL);
+
+    g_signal_handlers_disconnect_by_data(store_forward->appsink, store_forward);
+
+    g_mutex_lock(&store_forward->lock);
+    store_forward->stopping = TRUE;
+    g_cond_signal(&store_forward->cond);
+    g_mutex_unlock(&store_forward->lock);
+
+    /* Unblocks the forwarder if it's waiting on a full output, and takes back what it pushed */
+    disconnect_output(store_forward);
+    if (store_forward->forwarder != NULL) { g_thread_join(store_forward->forwarder); }
+    if (store_forward->reconnect_source_id != 0) { g_source_remove(store_forward->reconnect_source_id); }
+
+    g_queue_clear_full(&store_forward->memory, (GDestroyNotify)stored_buffer_free);
+    if (store_forward->spill != NULL) { fclose(store_forward->spill); }
+    if (store_forward->caps != NULL) { gst_caps_unref(store_forward->caps); }
+    gst_object_unref(store_forward->appsink);
+    g_free(store_forward->location);
+    g_mutex_clear(&store_forward->lock);
+    g_cond_clear(&store_forward->cond);
+    g_free(store_forward);
+}
+
+void store_forward_fill_stats(StoreForward * store_forward, GstStructure * stats)
+{
+    g_return_if_fail(store_forward != NULL && stats != NULL);
+
+    g_mutex_lock(&store_forward->lock);
+    gst_structure_set(stats,
+                      "output-connected",
+                      G_TYPE_BOOLEAN,
+                      store_forward->connected,
+                      "output-outages",
+                      G_TYPE_UINT,
+                      store_forward->outages,
+                      "output-buffered-bytes",
+                      G_TYPE_UINT64,
+                      store_forward->memory_bytes + store_forward->spill_bytes,
+                      "output-spilled-bytes",
+                      G_TYPE_UINT64,
+                      store_forward->spill_bytes,
+                      "output-dropped-bytes",
+                      G_TYPE_UINT64,
+                      store_forward->dropped_bytes,
+                      NULL);
+    g_mutex_unlock(&store_forward->lock);
+}
+
+/* private functions' definitions */
+
+static GstFlowReturn cb_new_sample(GstElement * appsink, gpointer user_data)
+{
+    StoreForward * store_forward = user_data;
+    GstSample *    sample        = NULL;
+
+    g_signal_emit_by_name(appsink, "pull-sample", &sample);
+    if (sample == NULL) { return GST_FLOW_EOS; }
+
+    GstBuffer * buffer = gst_sample_get_buffer(sample);
+    GstCaps *   caps   = gst_sample_get_caps(sample);
+
+    g_mutex_lock(&store_forward->lock);
+    if (caps != NULL) { gst_caps_replace(&store_forward->caps, caps); }
+    /* The stream header is sent from the caps on every (re)connection instead */
+    if (buffer != NULL && !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_HEADER)) {
+        enqueue_locked(store_forward, buffer);
+        g_cond_signal(&store_forward->cond);
+    }
+    g_mutex_unlock(&store_forward->lock);
+
+    gst_sample_unref(sample);
+    return GST_FLOW_OK;
+}
+
+static gboolean cb_output_bus_message(GstBus * bus, GstMessage * message, gpointer user_data)
+{
+    StoreForward * store_forward = user_data;
+
+    switch (GST_MESSAGE_TYPE(message)) {
+    case GST_MESSAGE_ERROR:
+    case GST_MESSAGE_EOS: {
+        GError * err      = NULL;
+        guint    delay_ms = 0;
+
+        /* Only reset once the next output really delivers, so that failed attempts back off */
+        g_mutex_lock(&store_forward->lock);
+        if (store_forward->connected) { store_forward->outages++; }
+        delay_ms                          = store_forward->reconnect_delay_ms;
+        store_forward->reconnect_delay_ms = MIN(delay_ms * 2, RECONNECT_MAX_DELAY_MS);
+        g_mutex_unlock(&store_forward->lock);
+
+        if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR) { gst_message_parse_error(message, &err, NULL); }
+        g_printerr("Output to %s lost (%s), reconnecting in %u ms.\n",
+                   store_forward->location,
+                   err != NULL ? err->message : "end of stream",
+                   delay_ms);
+        if (err != NULL) { g_error_free(err); }
+
+        /* The watch is removed by returning FALSE */
+        store_forward->bus_watch_id = 0;
+        disconnect_output(store_forward);
+
+        store_forward->reconnect_source_id = g_timeout_add(delay_ms, connect_output, store_forward);
+        return FALSE;
+    }
+    default: break;
+    }
+
+    return TRUE;
+}
+
+/* Runs on the thread posting the message, which is what the thread policy relies on */
+static GstBusSyncReply cb_output_sync_message(GstBus * bus, GstMessage * message, gpointer user_data)
+{
+    StoreForward * store_forward = user_data;
+
+    if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_STREAM_STATUS) {
+        thread_policy_handle_message(store_forward->thread_policy, message);
+    }
+
+    return GST_BUS_PASS;
+}
+
+/* A buffer reaching the sink means that the previous one was written, and that it may be written at any time */
+static GstPadProbeReturn cb_output_buffer(GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+    StoreForward * store_forward = user_data;
+    GstBuffer *    buffer        = GST_PAD_PROBE_INFO_BUFFER(info);
+
+    g_mutex_lock(&store_forward->lock);
+    if (store_forward->output_buffers++ > 0 && !store_forward->connected) {
+        store_forward->connected          = TRUE;
+        store_forward->reconnect_delay_ms = RECONNECT_INITIAL_DELAY_MS;
+    }
+
+    /* Not found for the stream header, which isn't stored */
+    for (GList * l = store_forward->sent.head; l != NULL; l = l->next) {
+        if (((StoredBuffer *)l->data)->buffer != buffer) { continue; }
+        while (store_forward->sent.head != l) { stored_buffer_free(g_queue_pop_head(&store_forward->sent)); }
+        ((StoredBuffer *)l->data)->on_wire = TRUE;
+        break;
+    }
+    g_mutex_unlock(&store_forward->lock);
+
+    return GST_PAD_PROBE_OK;
+}
+
+static gpointer forward_loop(gpointer user_data)
+{
+    StoreForward * store_forward = user_data;
+
+    if (store_forward->thread_policy != NULL) {
+        thread_policy_apply(store_forward->thread_policy, THREAD_BRANCH_OUTPUT);
+    }
+
+    g_mutex_lock(&store_forward->lock);
+    while (!store_forward->stopping) {
+        if (store_forward->output_src == NULL || store_forward->caps == NULL
+            || (g_queue_is_empty(&store_forward->memory) && store_forward->spill_count == 0)) {
+            g_cond_wait(&store_forward->cond, &store_forward->lock);
+            continue;
+        }
+
+        GstElement * output_src = gst_object_ref(store_forward->output_src);
+
+        if (store_forward->needs_header) {
+            GstCaps * caps              = gst_caps_ref(store_forward->caps);
+            store_forward->needs_header = FALSE;
+            if (!store_forward->catch_up) { skip_to_latest_keyframe_locked(store_forward); }
+
+            g_mutex_unlock(&store_forward->lock);
+            push_stream_header(output_src, caps);
+            gst_caps_unref(caps);
+            gst_object_unref(output_src);
+            g_mutex_lock(&store_forward->lock);
+            continue;
+        }
+
+        StoredBuffer * stored = dequeue_locked(store_forward);
+        GstFlowReturn  ret    = GST_FLOW_OK;
+        if (stored == NULL) {
+            gst_object_unref(output_src);
+            continue;
+        }
+        /* What comes before can't be decoded after the new stream header */
+        if (store_forward->needs_keyframe && !stored->keyframe) {
+            store_forward->dropped_bytes += gst_buffer_get_size(stored->buffer);
+            stored_buffer_free(stored);
+            gst_object_unref(output_src);
+            continue;
+        }
+        store_forward->needs_keyframe = FALSE;
+
+        /* Kept until the sink wrote it. Taken back on disconnection, even if it's never pushed. */
+        g_queue_push_tail(&store_forward->sent, stored);
+
+        /* Blocks while the output is slower than the data comes in */
+        g_mutex_unlock(&store_forward->lock);
+        g_signal_emit_by_name(output_src, "push-buffer", stored->buffer, &ret);
+        gst_object_unref(output_src);
+        g_mutex_lock(&store_forward->lock);
+
+        if (ret != GST_FLOW_OK) {
+            /* The output went away meanwhile, wait for the next one */
+            g_cond_wait_until(
+                &store_forward->cond, &store_forward->lock, g_get_monotonic_time() + G_TIME_SPAN_SECOND / 10);
+        }
+    }
+    g_mutex_unlock(&store_forward->lock);
+
+    return NULL;
+}
+
+static gboolean connect_output(gpointer user_data)
+{
+    StoreForward * store_forward = user_data;
+    GstElement *   output        = gst_pipeline_new("output");
+    GstElement *   output_src    = gst_element_factory_make("appsrc", "output_src");
+    GstElement *   output_sink   = create_output_sink(store_forward->location);
+    GstBus *       bus           = NULL;
+
+    store_forward->reconnect_source_id = 0;
+
+    if (!output || !output_src || !output_sink) {
+        g_printerr("Output elements could not be created.\n");
+        if (output != NULL) { gst_object_unref(output); }
+        if (output_src != NULL) { gst_object_unref(output_src); }
+        if (output_sink != NULL) { gst_object_unref(output_sink); }
+        return G_SOURCE_REMOVE;
+    }
+
+    /* Not synced - buffered data is sent as fast as the connection allows */
+    g_object_set(output_src, "block", TRUE, "max-bytes", (guint64)OUTPUT_QUEUE_BYTES, NULL);
+    g_object_set(output_sink, "sync", FALSE, NULL);
+
+    gst_bin_add_many(GST_BIN(output), output_src, output_sink, NULL);
+    gst_element_link(output_src, output_sink);
+
+    GstPad * sink_pad = gst_element_get_static_pad(output_sink, "sink");
+    gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, cb_output_buffer, store_forward, NULL);
+    gst_object_unref(sink_pad);
+
+    bus                         = gst_element_get_bus(output);
+    store_forward->bus_watch_id = gst_bus_add_watch(bus, cb_output_bus_message, store_forward);
+    /* Its elements are all of the output branch (see classify_thread()) */
+    if (store_forward->thread_policy != NULL) {
+        gst_bus_set_sync_handler(bus, cb_output_sync_message, store_forward, NULL);
+    }
+    gst_object_unref(bus);
+
+    g_mutex_lock(&store_forward->lock);
+    store_forward->output         = output;
+    store_forward->output_src     = output_src;
+    store_forward->output_buffers = 0;
+    store_forward->needs_header   = TRUE;
+    store_forward->needs_keyframe = TRUE;
+    g_cond_signal(&store_forward->cond);
+    g_mutex_unlock(&store_forward->lock);
+
+    /* A failure gets reported on the bus as well, which schedules the next attempt */
+    gst_element_set_state(output, GST_STATE_PLAYING);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void disconnect_output(StoreForward * store_forward)
+{
+    GstElement * output = NULL;
+
+    g_mutex_lock(&store_forward->lock);
+    output                    = store_forward->output;
+    store_forward->output     = NULL;
+    store_forward->output_src = NULL;
+    store_forward->connected  = FALSE;
+    g_mutex_unlock(&store_forward->lock);
+
+    if (store_forward->bus_watch_id != 0) {
+        g_source_remove(store_forward->bus_watch_id);
+        store_forward->bus_watch_id = 0;
+    }
+    if (output != NULL) {
+        gst_element_set_state(output, GST_STATE_NULL);
+        gst_object_unref(output);
+    }
+
+    /* Never reached the sink, sent again on the next connection */
+    g_mutex_lock(&store_forward->lock);
+    requeue_sent_locked(store_forward);
+    g_mutex_unlock(&store_forward->lock);
+}
+
+static GstElement * create_output_sink(const gchar * location)
+{
+    GstElement * sink = NULL;
+
+    if (g_str_has_prefix(location, "tcp://")) {
+        GstUri * uri = gst_uri_from_string(location);
+        sink         = gst_element_factory_make("tcpclientsink", "sink_output");
+        if (sink != NULL && uri != NULL) {
+            g_object_set(sink, "host", gst_uri_get_host(uri), "port", (gint)gst_uri_get_port(uri), NULL);
+        }
+        if (uri != NULL) { gst_uri_unref(uri); }
+    }
+    else {
+        sink = gst_element_factory_make("rtmpsink", "sink_output");
+        if (sink != NULL) { g_object_set(sink, "location", location, NULL); }
+    }
+
+    return sink;
+}
+
+static void push_stream_header(GstElement * output_src, GstCaps * caps)
+{
+    GstCaps *      stripped_caps = gst_caps_copy(caps);
+    GstStructure * structure     = gst_caps_get_structure(caps, 0);
+    const GValue * stream_header = gst_structure_get_value(structure, "streamheader");
+    GstFlowReturn  ret;
+
+    /* The header is pushed as regular data, so that each kind of sink sends it */
+    gst_structure_remove_field(gst_caps_get_structure(stripped_caps, 0), "streamheader");
+    g_object_set(output_src, "caps", stripped_caps, NULL);
+    gst_caps_unref(stripped_caps);
+
+    if (stream_header == NULL || !GST_VALUE_HOLDS_ARRAY(stream_header)) { return; }
+
+    for (guint i = 0; i < gst_value_array_get_size(stream_header); i++) {
+        GstBuffer * header = gst_value_get_buffer(gst_value_array_get_value(stream_header, i));
+        g_signal_emit_by_name(output_src, "push-buffer", header, &ret);
+    }
+}
+
+static gboolean is_video_keyframe(GstBuffer * buffer)
+{
+    guint8 tag[FLV_TAG_HEADER_SIZE + 1];
+
+    if (gst_buffer_extract(buffer, 0, tag, sizeof(tag)) != sizeof(tag)) { return FALSE; }
+    return tag[0] == FLV_TAG_TYPE_VIDEO && (tag[FLV_TAG_HEADER_SIZE] >> 4) == FLV_VIDEO_KEYFRAME;
+}
+
+static void enqueue_locked(StoreForward * store_forward, GstBuffer * buffer)
+{
+    StoredBuffer * stored = g_new0(StoredBuffer, 1);
+    gsize          size   = gst_buffer_get_size(buffer);
+
+    /* Both full - make room by dropping the oldest data */
+    while ((!g_queue_is_empty(&store_forward->memory) || store_forward->spill_count > 0)
+           && store_forward->memory_bytes + store_forward->spill_bytes + size
+                  > store_forward->max_memory_bytes + store_forward->max_disk_bytes) {
+        StoredBuffer * oldest = dequeue_locked(store_forward);
+        if (oldest == NULL) { break; }
+        store_forward->dropped_bytes += gst_buffer_get_size(oldest->buffer);
+        stored_buffer_free(oldest);
+    }
+
+    stored->buffer   = gst_buffer_ref(buffer);
+    stored->keyframe = is_video_keyframe(buffer);
+    if (stored->keyframe) { store_forward->keyframes_queued++; }
+
+    if (store_forward->spill_count == 0 && store_forward->memory_bytes + size <= store_forward->max_memory_bytes) {
+        g_queue_push_tail(&store_forward->memory, stored);
+        store_forward->memory_bytes += size;
+    }
+    else if (store_forward->max_disk_bytes > 0) {
+        spill_write_locked(store_forward, stored);
+        stored_buffer_free(stored);
+    }
+    else {
+        g_queue_push_tail(&store_forward->memory, stored);
+        store_forward->memory_bytes += size;
+    }
+}
+
+static StoredBuffer * dequeue_locked(StoreForward * store_forward)
+{
+    if (g_queue_is_empty(&store_forward->memory) && store_forward->spill_count > 0) {
+        spill_read_locked(store_forward);
+    }
+
+    StoredBuffer * stored = g_queue_pop_head(&store_forward->memory);
+    if (stored != NULL) {
+        store_forward->memory_bytes -= gst_buffer_get_size(stored->buffer);
+        if (stored->keyframe) { store_forward->keyframes_queued--; }
+    }
+
+    return stored;
+}
+
+static void requeue_locked(StoreForward * store_forward, StoredBuffer * stored)
+{
+    g_queue_push_head(&store_forward->memory, stored);
+    store_forward->memory_bytes += gst_buffer_get_size(stored->buffer);
+    if (stored->keyframe) { store_forward->keyframes_queued++; }
+}
+
+/* Whatever may be on the wire isn't sent again, the server would get tags with timestamps going backwards */
+static void requeue_sent_locked(StoreForward * store_forward)
+{
+    StoredBuffer * stored = NULL;
+
+    while ((stored = g_queue_peek_head(&store_forward->sent)) != NULL && stored->on_wire) {
+        stored_buffer_free(g_queue_pop_head(&store_forward->sent));
+    }
+    while ((stored = g_queue_pop_tail(&store_forward->sent)) != NULL) { requeue_locked(store_forward, stored); }
+}
+
+static void skip_to_latest_keyframe_locked(StoreForward * store_forward)
+{
+    if (store_forward->keyframes_queued == 0) { return; }
+
+    for (;;) {
+        StoredBuffer * stored = dequeue_locked(store_forward);
+        if (stored == NULL) { break; }
+        if (stored->keyframe && store_forward->keyframes_queued == 0) {
+            requeue_locked(store_forward, stored);
+            break;
+        }
+        store_forward->dropped_bytes += gst_buffer_get_size(stored->buffer);
+        stored_buffer_free(stored);
+    }
+}
+
+static void spill_write_locked(StoreForward * store_forward, StoredBuffer * stored)
+{
+    GstMapInfo  map;
+    SpillHeader header;
+
+    if (store_forward->spill == NULL) { store_forward->spill = tmpfile(); }
+    if (store_forward->spill == NULL || !gst_buffer_map(stored->buffer, &map, GST_MAP_READ)) {
+        g_printerr("Could not spill the output to disk, dropping a buffer.\n");
+        store_forward->dropped_bytes += gst_buffer_get_size(stored->buffer);
+        if (stored->keyframe) { store_forward->keyframes_queued--; }
+        return;
+    }
+
+    header.pts      = GST_BUFFER_PTS(stored->buffer);
+    header.dts      = GST_BUFFER_DTS(stored->buffer);
+    header.size     = map.size;
+    header.keyframe = stored->keyframe;
+
+    fseeko(store_forward->spill, store_forward->spill_write_pos, SEEK_SET);
+    if (fwrite(&header, sizeof(header), 1, store_forward->spill) != 1
+        || fwrite(map.data, 1, map.size, store_forward->spill) != map.size) {
+        g_printerr("Could not spill the output to disk, dropping a buffer.\n");
+        store_forward->dropped_bytes += map.size;
+        if (stored->keyframe) { store_forward->keyframes_queued--; }
+    }
+    else {
+        store_forward->spill_write_pos += sizeof(header) + map.size;
+        store_forward->spill_bytes += map.size;
+        store_forward->spill_count++;
+    }
+
+    gst_buffer_unmap(stored->buffer, &map);
+}
+
+/* Move the oldest spilled buffers back to memory, up to half of its capacity */
+static void spill_read_locked(StoreForward * store_forward)
+{
+    fflush(store_forward->spill);
+    fseeko(store_forward->spill, store_forward->spill_read_pos, SEEK_SET);
+
+    while (store_forward->spill_count > 0
+           && (g_queue_is_empty(&store_forward->memory)
+               || store_forward->memory_bytes < store_forward->max_memory_bytes / 2)) {
+        SpillHeader header;
+        GstMapInfo  map;
+
+        if (fread(&header, sizeof(header), 1, store_forward->spill) != 1) {
+            spill_discard_locked(store_forward);
+            break;
+        }
+
+        StoredBuffer * stored = g_new0(StoredBuffer, 1);
+        stored->buffer        = gst_buffer_new_allocate(NULL, header.size, NULL);
+        stored->keyframe      = header.keyframe;
+        GST_BUFFER_PTS(stored->buffer) = header.pts;
+        GST_BUFFER_DTS(stored->buffer) = header.dts;
+
+        gst_buffer_map(stored->buffer, &map, GST_MAP_WRITE);
+        gsize read = fread(map.data, 1, header.size, store_forward->spill);
+        gst_buffer_unmap(stored->buffer, &map);
+        if (read != header.size) {
+            stored_buffer_free(stored);
+            spill_discard_locked(store_forward);
+            break;
+        }
+
+        /* Keyframes were counted when spilled */
+        g_queue_push_tail(&store_forward->memory, stored);
+        store_forward->memory_bytes += header.size;
+        store_forward->spill_read_pos += sizeof(header) + header.size;
+        store_forward->spill_bytes -= header.size;
+        store_forward->spill_count--;
+    }
+
+    /* Everything read back - release the disk space */
+    if (store_forward->spill_count == 0) {
+        store_forward->spill_read_pos  = 0;
+        store_forward->spill_write_pos = 0;
+        store_forward->spill_bytes     = 0;
+        if (ftruncate(fileno(store_forward->spill), 0) != 0) { g_printerr("Could not truncate the spill file.\n"); }
+    }
+}
+
+/* The spill file can't be read back - drop whatever is left in it */
+static void spill_discard_locked(StoreForward * store_forward)
+{
+    g_printerr("Could not read the spilled output back, dropping %" G_GUINT64_FORMAT " bytes.\n",
+               store_forward->spill_bytes);
+    store_forward->dropped_bytes += store_forward->spill_bytes;
+    store_forward->spill_count = 0;
+
+    store_forward->keyframes_queued = 0;
+    for (GList * l = store_forward->memory.head; l != NULL; l = l->next) {
+        if (((StoredBuffer *)l->data)->keyframe) { store_forward->keyframes_queued++; }
+    }
+}
+
+static void stored_buffer_free(StoredBuffer * stored)
+{
+    gst_buffer_unref(stored->buffer);
+    g_free(stored);
+}
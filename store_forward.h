@@ -0,0 +1,44 @@
+#ifndef _STORE_FORWARD__H_
+#define _STORE_FORWARD__H_
+
+#include "thread_policy.h"
+
+#include <gst/gst.h>
+
+/* Store-and-forward output stage.                                                  */
+/* Muxed FLV buffers are pulled from an appsink in the main pipeline into a bounded */
+/* in-memory queue which spills to a temporary file once full, and are forwarded    */
+/* from a dedicated thread into a separate output pipeline (appsrc ! rtmpsink).     */
+/* Errors of the output pipeline don't reach the main pipeline - the output is      */
+/* re-created with backoff, and the data buffered in the meantime is either sent    */
+/* faster than real time or skipped up to the latest keyframe.                      */
+/* Buffers are kept until they reach the sink, those which didn't are sent again   */
+/* after a reconnection. Nothing which may have been written is sent twice, and     */
+/* each connection starts with the stream header then a video keyframe, i.e. what   */
+/* was in flight when the connection dropped (and up to the next keyframe) is lost. */
+/* A "tcp://host:port" location uses a tcpclientsink instead (e.g. for a stand-in). */
+typedef struct _StoreForward StoreForward;
+
+/* @appsink is the end of the main pipeline's streaming branch, it gets configured here */
+StoreForward * store_forward_new(GstElement * appsink);
+
+/* Bounds of the buffered data. 0 for @max_disk_bytes disables spilling to disk. */
+/* Has to be called before store_forward_start().                                */
+void store_forward_set_limits(StoreForward * store_forward, guint64 max_memory_bytes, guint64 max_disk_bytes);
+
+/* Place the streaming threads of the output pipeline and the forwarder thread as the output branch of @policy, */
+/* which has to outlive @store_forward. Has to be called before store_forward_start().                          */
+void store_forward_set_thread_policy(StoreForward * store_forward, ThreadPolicy * policy);
+
+/* TRUE: send all the buffered data after a reconnection, FALSE: skip to the latest keyframe */
+void store_forward_set_catch_up(StoreForward * store_forward, gboolean catch_up);
+
+/* Start forwarding to @location */
+void store_forward_start(StoreForward * store_forward, const gchar * location);
+
+void store_forward_free(StoreForward * store_forward);
+
+/* Add the output metrics to @stats (fields prefixed with "output-") */
+void store_forward_fill_stats(StoreForward * store_forward, GstStructure * stats);
+
+#endif /* _STORE_FORWARD__H_ */
@@ -0,0 +1,236 @@
+#include "test_support.h"
+
+#define TEST_INPUT_FRAMERATE 30
+#define TEST_AUDIO_RATE 48000
+#define TEST_AUDIO_SAMPLES 1024 /* per buffer, audiotestsrc's default */
+
+struct _TestServer {
+    GSocketService *  service;
+    guint16           port;
+    GCancellable *    cancellable; /* of the reads of the open connections */
+    guint             accepted;
+    TestServerReceive receive;
+    gpointer          user_data;
+};
+
+/* The pending read holds the connection, which is released once it fails (closed or cancelled) */
+typedef struct {
+    GSocketConnection * connection;
+    GCancellable *      cancellable;
+    TestServerReceive   receive;
+    gpointer            user_data;
+    guint8              scratch[64 * 1024];
+} TestConnection;
+
+static gboolean test_server_listen(TestServer * server);
+static gboolean cb_incoming(GSocketService *    service,
+                            GSocketConnection * connection,
+                            GObject *           source_object,
+                            gpointer            user_data);
+static void     cb_read(GObject * source, GAsyncResult * result, gpointer user_data);
+
+gboolean test_input_create(const gchar * path,
+                           const gchar * pattern,
+                           const gchar * wave,
+                           gint          width,
+                           gint          height,
+                           guint         seconds)
+{
+    g_return_val_if_fail(path != NULL && pattern != NULL, FALSE);
+
+    GError * error = NULL;
+    gchar *  audio = g_strdup("");
+    if (wave != NULL) {
+        g_free(audio);
+        audio = g_strdup_printf("audiotestsrc wave=%s num-buffers=%u ! audio/x-raw,rate=%d,channels=2 ! mux.",
+                                wave,
+                                seconds * TEST_AUDIO_RATE / TEST_AUDIO_SAMPLES + 1,
+                                TEST_AUDIO_RATE);
+    }
+    gchar * description = g_strdup_printf(
+        "videotestsrc pattern=%s num-buffers=%u ! video/x-raw,width=%d,height=%d,framerate=%d/1 ! jpegenc ! mux. "
+        "%s matroskamux name=mux ! filesink name=file",
+        pattern,
+        seconds * TEST_INPUT_FRAMERATE,
+        width,
+        height,
+        TEST_INPUT_FRAMERATE,
+        audio);
+    GstElement * pipeline = gst_parse_launch(description, &error);
+
+    g_free(description);
+    g_free(audio);
+    if (pipeline == NULL) {
+        g_printerr("Could not create the input generator: %s\n", error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+
+    GstElement * file = gst_bin_get_by_name(GST_BIN(pipeline), "file");
+    g_object_set(file, "location", path, NULL);
+    gst_object_unref(file);
+
+    GstBus * bus = gst_element_get_bus(pipeline);
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstMessage * message = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+    gboolean     created = GST_MESSAGE_TYPE(message) == GST_MESSAGE_EOS;
+    if (!created) {
+        gst_message_parse_error(message, &error, NULL);
+        g_printerr("Could not generate %s: %s\n", path, error->message);
+        g_error_free(error);
+    }
+    gst_message_unref(message);
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    return created;
+}
+
+TestServer * test_server_new(TestServerReceive receive, gpointer user_data)
+{
+    TestServer * server = g_new0(TestServer, 1);
+
+    server->service     = g_socket_service_new();
+    server->cancellable = g_cancellable_new();
+    server->receive     = receive;
+    server->user_data   = user_data;
+    g_signal_connect(server->service, "incoming", G_CALLBACK(cb_incoming), server);
+
+    if (!test_server_listen(server)) {
+        test_server_free(server);
+        return NULL;
+    }
+    return server;
+}
+
+guint16 test_server_get_port(TestServer * server)
+{
+    g_return_val_if_fail(server != NULL, 0);
+
+    return server->port;
+}
+
+guint test_server_get_accepted(TestServer * server)
+{
+    g_return_val_if_fail(server != NULL, 0);
+
+    return server->accepted;
+}
+
+/* The pending reads fail, closing their connections */
+void test_server_drop_connections(TestServer * server)
+{
+    g_return_if_fail(server != NULL);
+
+    g_cancellable_cancel(server->cancellable);
+    g_object_unref(server->cancellable);
+    server->cancellable = g_cancellable_new();
+}
+
+void test_server_kill(TestServer * server)
+{
+    g_return_if_fail(server != NULL);
+
+    test_server_drop_connections(server);
+    g_socket_service_stop(server->service);
+    g_socket_listener_close(G_SOCKET_LISTENER(server->service));
+}
+
+gboolean test_server_restart(TestServer * server)
+{
+    g_return_val_if_fail(server != NULL, FALSE);
+
+    return test_server_listen(server);
+}
+
+void test_server_free(TestServer * server)
+{
+    g_return_if_fail(server != NULL);
+
+    test_server_kill(server);
+    g_object_unref(server->cancellable);
+    g_object_unref(server->service);
+    g_free(server);
+    while (g_main_context_iteration(NULL, FALSE)) {}
+}
+
+/* private functions' definitions */
+
+/* On the same port as before if any, as the output reconnects to it */
+static gboolean test_server_listen(TestServer * server)
+{
+    GError *         error     = NULL;
+    GInetAddress *   loopback  = g_inet_address_new_loopback(G_SOCKET_FAMILY_IPV4);
+    GSocketAddress * address   = g_inet_socket_address_new(loopback, server->port);
+    GSocketAddress * effective = NULL;
+
+    gboolean listening = g_socket_listener_add_address(G_SOCKET_LISTENER(server->service),
+                                                       address,
+                                                       G_SOCKET_TYPE_STREAM,
+                                                       G_SOCKET_PROTOCOL_TCP,
+                                                       NULL,
+                                                       &effective,
+                                                       &error);
+    g_object_unref(address);
+    g_object_unref(loopback);
+    if (!listening) {
+        g_printerr("Could not listen for the output: %s\n", error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+
+    server->port = g_inet_socket_address_get_port(G_INET_SOCKET_ADDRESS(effective));
+    g_object_unref(effective);
+    g_socket_service_start(server->service);
+
+    return TRUE;
+}
+
+static gboolean cb_incoming(GSocketService *    service,
+                            GSocketConnection * connection,
+                            GObject *           source_object,
+                            gpointer            user_data)
+{
+    TestServer *     server = user_data;
+    TestConnection * client = g_new0(TestConnection, 1);
+
+    server->accepted++;
+    client->connection  = g_object_ref(connection);
+    client->cancellable = g_object_ref(server->cancellable);
+    client->receive     = server->receive;
+    client->user_data   = server->user_data;
+    g_input_stream_read_async(g_io_stream_get_input_stream(G_IO_STREAM(connection)),
+                              client->scratch,
+                              sizeof(client->scratch),
+                              G_PRIORITY_DEFAULT,
+                              client->cancellable,
+                              cb_read,
+                              client);
+
+    return TRUE;
+}
+
+static void cb_read(GObject * source, GAsyncResult * result, gpointer user_data)
+{
+    TestConnection * client = user_data;
+    gssize           read   = g_input_stream_read_finish(G_INPUT_STREAM(source), result, NULL);
+
+    if (read > 0) {
+        if (client->receive != NULL) { client->receive(client->connection, client->scratch, read, client->user_data); }
+        g_input_stream_read_async(G_INPUT_STREAM(source),
+                                  client->scratch,
+                                  sizeof(client->scratch),
+                                  G_PRIORITY_DEFAULT,
+                                  client->cancellable,
+                                  cb_read,
+                                  client);
+        return;
+    }
+
+    /* Closed by the output, or dropped. The data of the test attached to the connection goes with it. */
+    g_io_stream_close(G_IO_STREAM(client->connection), NULL, NULL);
+    g_object_unref(client->connection);
+    g_object_unref(client->cancellable);
+    g_free(client);
+}
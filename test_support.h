@@ -0,0 +1,42 @@
+#ifndef _TEST_SUPPORT__H_
+#define _TEST_SUPPORT__H_
+
+#include <gio/gio.h>
+#include <gst/gst.h>
+
+/* Shared by the tests & benchmarks: synthetic inputs, and a stand-in for the ingest server of the output */
+
+/* Generate @seconds of Motion JPEG video (a videotestsrc @pattern) at 30 fps in a Matroska file, along with raw */
+/* audio (an audiotestsrc @wave, NULL for none). Cheap to decode, so that the rest of the pipeline is measured.  */
+gboolean test_input_create(const gchar * path,
+                           const gchar * pattern,
+                           const gchar * wave,
+                           gint          width,
+                           gint          height,
+                           guint         seconds);
+
+typedef struct _TestServer TestServer;
+
+/* Called from the main loop with what was read from @connection, which can hold a state of the test as its data */
+typedef void (*TestServerReceive)(GSocketConnection * connection, const guint8 * data, gsize size, gpointer user_data);
+
+/* Listen on a free port of the loopback interface, serving the connections from the default main loop. With a */
+/* NULL @receive, whatever is received is discarded. NULL on error.                                            */
+TestServer * test_server_new(TestServerReceive receive, gpointer user_data);
+
+guint16 test_server_get_port(TestServer * server);
+
+/* Number of connections accepted so far */
+guint test_server_get_accepted(TestServer * server);
+
+/* Close the open connections, as a server dropping its clients would. Still listening. */
+void test_server_drop_connections(TestServer * server);
+
+/* Close the open connections & stop listening, as a crashing server would, then listen again on the same port */
+void     test_server_kill(TestServer * server);
+gboolean test_server_restart(TestServer * server);
+
+/* Also lets the closed connections be released, from the default main loop */
+void test_server_free(TestServer * server);
+
+#endif /* _TEST_SUPPORT__H_ */
@@ -0,0 +1,327 @@
+#include "frame_timing.h"
+#include "test_support.h"
+#include "three_video_stream.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+#include <stdlib.h>
+
+/* Runs the stream on synthetic inputs alternately with the default thread placement and with the given one */
+/* (--cpus, --priority), and compares the frame times of the mix, p99 in particular, measured after a warm-up. */
+
+#define BENCH_INPUT_WIDTH 1280
+#define BENCH_INPUT_HEIGHT 720
+#define BENCH_INPUT_MARGIN 5 /* s, the inputs are longer than a run by this much */
+
+typedef struct {
+    GstClockTime p50;
+    GstClockTime p99;
+    GstClockTime max;
+} BenchSample;
+
+/* One run, driven from the main loop */
+typedef struct {
+    GstElement *  pipeline;
+    GMainLoop *   loop;
+    FrameTiming * timing;
+    gboolean      failed;
+} BenchRun;
+
+/* Input parameters */
+static int      duration        = 20;
+static int      warm_up         = 5;
+static int      runs            = 3;
+static gboolean no_output       = FALSE;
+static gchar ** thread_cpus     = NULL;
+static gchar ** thread_priority = NULL;
+
+static GOptionEntry entries[] = {
+    {"duration", 'd', 0, G_OPTION_ARG_INT, &duration, "How long each run is measured, in seconds", NULL},
+    {"warm-up", 'W', 0, G_OPTION_ARG_INT, &warm_up, "How long each run goes before it is measured, in seconds", NULL},
+    {"runs", 'r', 0, G_OPTION_ARG_INT, &runs, "Number of runs with each placement", NULL},
+    {"no-output", 'n', 0, G_OPTION_ARG_NONE, &no_output, "Don't encode & stream, i.e. only mix", NULL},
+    {"cpus",
+     0,
+     0,
+     G_OPTION_ARG_STRING_ARRAY,
+     &thread_cpus,
+     "Pin the threads of a branch (input1..3, mixer, encoder, output) to CPUs, e.g. 'mixer=4-5' (repeatable)",
+     NULL},
+    {"priority",
+     0,
+     0,
+     G_OPTION_ARG_STRING_ARRAY,
+     &thread_priority,
+     "Priority of the mixer or encoder threads, e.g. 'encoder=10' for SCHED_FIFO (repeatable)",
+     NULL},
+    {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL},
+};
+
+/* Stand-in for the ingest server, discarding the stream */
+static TestServer * output_server;
+
+static gboolean     run_once(gchar ** inputs, gboolean placed, BenchSample * sample);
+static gboolean     set_branch_properties(ThreeVideoStream * stream, const gchar * prefix, gchar ** settings);
+static GstClockTime median_p99(const BenchSample * samples, guint count);
+static gint         compare_clock_times(gconstpointer a, gconstpointer b);
+
+static gboolean cb_bus_message(GstBus * bus, GstMessage * message, gpointer user_data);
+static gboolean cb_start_measuring(gpointer user_data);
+static gboolean cb_end_run(gpointer user_data);
+
+int main(int argc, char * argv[])
+{
+    GError *         error         = NULL;
+    GOptionContext * context       = g_option_context_new(" Compare the frame times with & without thread placement");
+    gboolean         failed        = FALSE;
+    gchar *          inputs[3 + 1] = {NULL};
+    BenchSample *    samples[2]    = {NULL};
+    const gchar *    patterns[3]   = {"smpte", "ball", "pinwheel"};
+
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("option parsing failed: %s\n", error->message);
+        exit(1);
+    }
+    g_option_context_free(context);
+    if (duration <= 0 || warm_up < 0 || runs <= 0) {
+        g_printerr("The duration & the number of runs must be positive.\n");
+        exit(1);
+    }
+    if (thread_cpus == NULL && thread_priority == NULL) {
+        g_printerr("Nothing to compare, give the placement to measure with --cpus and/or --priority.\n");
+        exit(1);
+    }
+
+    gst_init(&argc, &argv);
+
+    gchar * directory = g_dir_make_tmp("bench-XXXXXX", &error);
+    if (directory == NULL) {
+        g_printerr("Could not create a directory for the inputs: %s\n", error->message);
+        exit(1);
+    }
+    /* Video only, large enough for the decoding & mixing to matter */
+    for (guint i = 0; i < 3 && !failed; i++) {
+        gchar * name    = g_strdup_printf("input%u.mkv", i + 1);
+        guint   seconds = warm_up + duration + BENCH_INPUT_MARGIN;
+        inputs[i]       = g_build_filename(directory, name, NULL);
+        failed          = !test_input_create(
+            inputs[i], patterns[i], NULL, BENCH_INPUT_WIDTH, BENCH_INPUT_HEIGHT, seconds);
+        g_free(name);
+    }
+    if (!failed && !no_output) {
+        output_server = test_server_new(NULL, NULL);
+        failed        = output_server == NULL;
+    }
+
+    /* Alternating, so that both placements see the same drift of the machine (thermal, other load) */
+    samples[0] = g_new0(BenchSample, runs);
+    samples[1] = g_new0(BenchSample, runs);
+    g_print("%3s %-9s %10s %10s %10s\n", "run", "placement", "p50 ms", "p99 ms", "max ms");
+    for (guint i = 0; i < (guint)runs * 2 && !failed; i++) {
+        gboolean      placed = i % 2 == 1;
+        BenchSample * sample = &samples[placed][i / 2];
+
+        failed = !run_once(inputs, placed, sample);
+        g_print("%3u %-9s %10.2f %10.2f %10.2f\n",
+                i / 2 + 1,
+                placed ? "placed" : "default",
+                (gdouble)sample->p50 / GST_MSECOND,
+                (gdouble)sample->p99 / GST_MSECOND,
+                (gdouble)sample->max / GST_MSECOND);
+    }
+    if (!failed) {
+        GstClockTime unplaced = median_p99(samples[0], runs);
+        GstClockTime placed   = median_p99(samples[1], runs);
+        g_print("Median p99: %.2f ms by default, %.2f ms placed (%+.1f%%).\n",
+                (gdouble)unplaced / GST_MSECOND,
+                (gdouble)placed / GST_MSECOND,
+                unplaced > 0 ? 100.0 * ((gdouble)placed - unplaced) / unplaced : 0.0);
+    }
+
+    if (output_server != NULL) { test_server_free(output_server); }
+    for (guint i = 0; inputs[i] != NULL; i++) { g_unlink(inputs[i]); }
+    g_rmdir(directory);
+    g_free(directory);
+    for (guint i = 0; inputs[i] != NULL; i++) { g_free(inputs[i]); }
+    g_free(samples[0]);
+    g_free(samples[1]);
+
+    gst_deinit();
+    return failed ? 1 : 0;
+}
+
+/* private functions' definitions */
+
+/* Start the stream, measure the frame times of the mix once warmed up, and stop it */
+static gboolean run_once(gchar ** inputs, gboolean placed, BenchSample * sample)
+{
+    BenchRun           run    = {0};
+    GstStructure *     stats  = gst_structure_new_empty("stats");
+    gboolean           valid  = TRUE;
+    ThreeVideoStream * stream = three_video_stream_new(inputs[0], inputs[1], inputs[2], no_output ? "" : "bench");
+
+    if (!no_output) {
+        gchar * server = g_strdup_printf("tcp://127.0.0.1:%u/", test_server_get_port(output_server));
+        g_object_set(stream, "twitch-server", server, NULL);
+        g_free(server);
+    }
+    if (placed) {
+        valid = set_branch_properties(stream, "cpus", thread_cpus)
+                && set_branch_properties(stream, "priority", thread_priority);
+    }
+    if (!valid) {
+        three_video_stream_free(stream);
+        gst_structure_free(stats);
+        return FALSE;
+    }
+
+    run.loop = g_main_loop_new(NULL, FALSE);
+    g_object_set(stream, "ready-to-play", TRUE, NULL);
+    g_object_get(stream, "gst-pipeline", &run.pipeline, NULL);
+
+    GstBus * bus      = gst_element_get_bus(run.pipeline);
+    guint    watch_id = gst_bus_add_watch(bus, cb_bus_message, &run);
+    gst_object_unref(bus);
+
+    guint timeouts[2] = {g_timeout_add_seconds(warm_up, cb_start_measuring, &run),
+                         g_timeout_add_seconds(warm_up + duration, cb_end_run, &run)};
+
+    gst_element_set_state(run.pipeline, GST_STATE_PAUSED);
+    g_main_loop_run(run.loop);
+
+    /* Some are still pending if the run ended on an error */
+    for (guint i = 0; i < G_N_ELEMENTS(timeouts); i++) {
+        GSource * source = g_main_context_find_source_by_id(NULL, timeouts[i]);
+        if (source != NULL) { g_source_destroy(source); }
+    }
+    g_source_remove(watch_id);
+
+    if (run.timing != NULL) {
+        frame_timing_fill_stats(run.timing, stats);
+        frame_timing_free(run.timing);
+    }
+    if (!gst_structure_get_uint64(stats, "frame-time-p50", &sample->p50)) { sample->p50 = 0; }
+    if (!gst_structure_get_uint64(stats, "frame-time-p99", &sample->p99)) { sample->p99 = 0; }
+    if (!gst_structure_get_uint64(stats, "frame-time-max", &sample->max)) { sample->max = 0; }
+    gst_structure_free(stats);
+
+    gst_element_set_state(run.pipeline, GST_STATE_NULL);
+    gst_object_unref(run.pipeline);
+    three_video_stream_free(stream);
+    g_main_loop_unref(run.loop);
+
+    /* Let the deferred clean-ups run */
+    while (g_main_context_iteration(NULL, FALSE)) {}
+
+    return !run.failed;
+}
+
+/* Set the "<prefix>-<branch>" property for each "<branch>=<value>" setting, as ThreeVideoStream's options do */
+static gboolean set_branch_properties(ThreeVideoStream * stream, const gchar * prefix, gchar ** settings)
+{
+    gboolean valid = TRUE;
+
+    for (guint i = 0; settings != NULL && settings[i] != NULL && valid; i++) {
+        gchar **     setting = g_strsplit(settings[i], "=", 2);
+        gchar *      name    = g_strdup_printf("%s-%s", prefix, setting[0]);
+        GParamSpec * pspec   = g_object_class_find_property(G_OBJECT_GET_CLASS(stream), name);
+
+        valid = setting[1] != NULL && pspec != NULL;
+        if (!valid) { g_printerr("Invalid '--%s %s' option.\n", prefix, settings[i]); }
+        else if (pspec->value_type == G_TYPE_INT) {
+            g_object_set(stream, name, atoi(setting[1]), NULL);
+        }
+        else {
+            g_object_set(stream, name, setting[1], NULL);
+        }
+
+        g_free(name);
+        g_strfreev(setting);
+    }
+
+    return valid;
+}
+
+static GstClockTime median_p99(const BenchSample * samples, guint count)
+{
+    GstClockTime * p99s = g_new(GstClockTime, count);
+
+    for (guint i = 0; i < count; i++) { p99s[i] = samples[i].p99; }
+    qsort(p99s, count, sizeof(GstClockTime), compare_clock_times);
+    GstClockTime median = p99s[count / 2];
+    g_free(p99s);
+
+    return median;
+}
+
+static gint compare_clock_times(gconstpointer a, gconstpointer b)
+{
+    GstClockTime first  = *(const GstClockTime *)a;
+    GstClockTime second = *(const GstClockTime *)b;
+
+    return first < second ? -1 : first > second;
+}
+
+static gboolean cb_bus_message(GstBus * bus, GstMessage * message, gpointer user_data)
+{
+    BenchRun * run = user_data;
+
+    switch (GST_MESSAGE_TYPE(message)) {
+    case GST_MESSAGE_ERROR: {
+        GError * err  = NULL;
+        gchar *  name = gst_object_get_path_string(message->src);
+
+        gst_message_parse_error(message, &err, NULL);
+        g_printerr("Error from %s: %s\n", name, err->message);
+        g_error_free(err);
+        g_free(name);
+
+        run->failed = TRUE;
+        g_main_loop_quit(run->loop);
+        break;
+    }
+    case GST_MESSAGE_EOS:
+        g_printerr("The inputs ended before the run.\n");
+        run->failed = TRUE;
+        g_main_loop_quit(run->loop);
+        break;
+    case GST_MESSAGE_STATE_CHANGED: {
+        GstState new_state = GST_STATE_NULL;
+        gst_message_parse_state_changed(message, NULL, &new_state, NULL);
+        if (GST_MESSAGE_SRC(message) == GST_OBJECT(run->pipeline) && new_state == GST_STATE_PAUSED) {
+            gst_element_set_state(run->pipeline, GST_STATE_PLAYING);
+        }
+        break;
+    }
+    case GST_MESSAGE_LATENCY: gst_bin_recalculate_latency(GST_BIN(run->pipeline)); break;
+    default: break;
+    }
+
+    return TRUE;
+}
+
+/* On the output of the mixer, as the stream's own frame times include the start */
+static gboolean cb_start_measuring(gpointer user_data)
+{
+    BenchRun *   run   = user_data;
+    GstElement * mixer = gst_bin_get_by_name(GST_BIN(run->pipeline), "videomixer");
+
+    if (mixer != NULL) {
+        GstPad * mix_pad = gst_element_get_static_pad(mixer, "src");
+        run->timing      = frame_timing_new(mix_pad);
+        gst_object_unref(mix_pad);
+        gst_object_unref(mixer);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean cb_end_run(gpointer user_data)
+{
+    BenchRun * run = user_data;
+
+    g_main_loop_quit(run->loop);
+    return G_SOURCE_REMOVE;
+}
@@ -0,0 +1,461 @@
+#ifdef __linux__
+#define _GNU_SOURCE /* cpu_set_t */
+#endif
+
+#include "thread_policy.h"
+
+#include <gst/video/video.h>
+#include <string.h>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define THREAD_POLICY_FALLBACK_NICE -10
+#define THREAD_POLICY_MPOL_LOCAL 4 /* from linux/mempolicy.h, saves depending on libnuma */
+#define THREAD_POLICY_MPOL_PREFERRED 1
+#define THREAD_POLICY_MPOL_MF_MOVE (1 << 1)
+
+static const gchar * branch_names[THREAD_BRANCH_COUNT] = {"input1", "input2", "input3", "mixer", "encoder", "output"};
+
+struct _ThreadPolicy {
+    GMutex lock;
+    /* Once anything is set, the threads of the other branches get reset to the defaults, */
+    /* as GStreamer reuses threads across branches                                       */
+    gboolean configured;
+    gint     default_nice;
+    gboolean pinned[THREAD_BRANCH_COUNT];
+    gint     priority[THREAD_BRANCH_COUNT];
+#ifdef __linux__
+    cpu_set_t default_cpus;
+    cpu_set_t cpus[THREAD_BRANCH_COUNT];
+#endif
+    /* Of the frames consumed by each branch, once pinned to a known node, see thread_policy_bind_allocation() */
+    GstAllocator * allocators[THREAD_BRANCH_COUNT];
+
+    /* Metrics */
+    guint threads_pinned;
+    guint threads_prioritized;
+    guint failures;
+    guint pools_bound;
+};
+
+/* The ALLOCATION queries passing a pad, answered for the branch consuming its buffers */
+typedef struct {
+    ThreadPolicy * policy;
+    ThreadBranch   consumer;
+} AllocationBinding;
+
+/* System memory bound to a NUMA node: the pages are placed there when first touched (by the producer) */
+typedef struct {
+    GstAllocator parent;
+    gint         node;
+} NodeAllocator;
+
+typedef struct {
+    GstAllocatorClass parent_class;
+} NodeAllocatorClass;
+
+GType node_allocator_get_type(void);
+G_DEFINE_TYPE(NodeAllocator, node_allocator, GST_TYPE_ALLOCATOR)
+
+static ThreadBranch      classify_thread(GstElement * owner);
+static void              apply_to_current_thread(ThreadPolicy * policy, ThreadBranch branch);
+static GstPadProbeReturn cb_allocation_query(GstPad * pad, GstPadProbeInfo * info, gpointer user_data);
+static GstMemory *       node_allocator_alloc(GstAllocator * allocator, gsize size, GstAllocationParams * params);
+#ifdef __linux__
+static gboolean parse_cpus(const gchar * cpus, cpu_set_t * set);
+static gint     cpu_node(guint cpu);
+#endif
+
+ThreadPolicy * thread_policy_new(void)
+{
+    ThreadPolicy * policy = g_new0(ThreadPolicy, 1);
+    g_mutex_init(&policy->lock);
+
+#ifdef __linux__
+    /* The settings the threads start with, inherited from the process */
+    policy->default_nice = getpriority(PRIO_PROCESS, 0);
+    if (sched_getaffinity(0, sizeof(policy->default_cpus), &policy->default_cpus) != 0) {
+        CPU_ZERO(&policy->default_cpus);
+        for (guint cpu = 0; cpu < CPU_SETSIZE; cpu++) { CPU_SET(cpu, &policy->default_cpus); }
+    }
+#endif
+
+    return policy;
+}
+
+gboolean thread_policy_set_cpus(ThreadPolicy * policy, ThreadBranch branch, const gchar * cpus)
+{
+    g_return_val_if_fail(policy != NULL && branch < THREAD_BRANCH_COUNT, FALSE);
+
+    gboolean pinned = cpus != NULL && strlen(cpus) != 0;
+#ifdef __linux__
+    cpu_set_t set;
+    if (pinned && !parse_cpus(cpus, &set)) {
+        g_printerr("Invalid CPU list '%s' for the %s threads.\n", cpus, branch_names[branch]);
+        return FALSE;
+    }
+
+    /* The frames consumed by the branch go to the node of its first CPU */
+    NodeAllocator * allocator = NULL;
+    for (guint cpu = 0; pinned && allocator == NULL && cpu < CPU_SETSIZE; cpu++) {
+        gint node = CPU_ISSET(cpu, &set) ? cpu_node(cpu) : -1;
+        if (node >= 0) {
+            allocator       = g_object_new(node_allocator_get_type(), NULL);
+            allocator->node = node;
+            gst_object_ref_sink(allocator);
+        }
+    }
+
+    g_mutex_lock(&policy->lock);
+    policy->pinned[branch] = pinned;
+    if (pinned) { policy->cpus[branch] = set; }
+    policy->configured = policy->configured || pinned;
+    gst_object_replace((GstObject **)&policy->allocators[branch], (GstObject *)allocator);
+    g_mutex_unlock(&policy->lock);
+
+    if (allocator != NULL) { gst_object_unref(allocator); }
+    return TRUE;
+#else
+    if (pinned) { g_printerr("Pinning the %s threads to CPUs is only supported on Linux.\n", branch_names[branch]); }
+    return !pinned;
+#endif
+}
+
+void thread_policy_set_priority(ThreadPolicy * policy, ThreadBranch branch, gint priority)
+{
+    g_return_if_fail(policy != NULL && branch < THREAD_BRANCH_COUNT);
+    g_return_if_fail(priority >= -20 && priority <= 99);
+
+    g_mutex_lock(&policy->lock);
+    policy->priority[branch] = priority;
+    policy->configured       = policy->configured || priority != 0;
+    g_mutex_unlock(&policy->lock);
+}
+
+void thread_policy_handle_message(ThreadPolicy * policy, GstMessage * message)
+{
+    g_return_if_fail(policy != NULL && message != NULL);
+
+    GstStreamStatusType type  = GST_STREAM_STATUS_TYPE_CREATE;
+    GstElement *        owner = NULL;
+
+    if (GST_MESSAGE_TYPE(message) != GST_MESSAGE_STREAM_STATUS) { return; }
+
+    /* ENTER is posted from the new streaming thread itself, before it starts processing */
+    gst_message_parse_stream_status(message, &type, &owner);
+    if (type != GST_STREAM_STATUS_TYPE_ENTER || owner == NULL) { return; }
+
+    apply_to_current_thread(policy, classify_thread(owner));
+}
+
+void thread_policy_apply(ThreadPolicy * policy, ThreadBranch branch)
+{
+    g_return_if_fail(policy != NULL && branch < THREAD_BRANCH_COUNT);
+
+    apply_to_current_thread(policy, branch);
+}
+
+void thread_policy_bind_allocation(ThreadPolicy * policy, GstPad * pad, ThreadBranch consumer)
+{
+    g_return_if_fail(policy != NULL && GST_IS_PAD(pad) && consumer < THREAD_BRANCH_COUNT);
+
+    AllocationBinding * binding = g_new0(AllocationBinding, 1);
+    binding->policy             = policy;
+    binding->consumer           = consumer;
+
+    /* PULL: once the query has been answered downstream */
+    gst_pad_add_probe(
+        pad, GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM | GST_PAD_PROBE_TYPE_PULL, cb_allocation_query, binding, g_free);
+}
+
+void thread_policy_free(ThreadPolicy * policy)
+{
+    g_return_if_fail(policy != NULL);
+
+    for (guint i = 0; i < THREAD_BRANCH_COUNT; i++) {
+        if (policy->allocators[i] != NULL) { gst_object_unref(policy->allocators[i]); }
+    }
+    g_mutex_clear(&policy->lock);
+    g_free(policy);
+}
+
+void thread_policy_fill_stats(ThreadPolicy * policy, GstStructure * stats)
+{
+    g_return_if_fail(policy != NULL && stats != NULL);
+
+    g_mutex_lock(&policy->lock);
+    gst_structure_set(stats,
+                      "threads-pinned",
+                      G_TYPE_UINT,
+                      policy->threads_pinned,
+                      "threads-prioritized",
+                      G_TYPE_UINT,
+                      policy->threads_prioritized,
+                      "threads-failures",
+                      G_TYPE_UINT,
+                      policy->failures,
+                      "threads-numa-pools",
+                      G_TYPE_UINT,
+                      policy->pools_bound,
+                      NULL);
+    g_mutex_unlock(&policy->lock);
+}
+
+/* private functions' definitions */
+
+/* Threads are assigned to a branch by the top-level element (i.e. direct child of the pipeline) */
+/* whose pad they drive. The element names are the ones given in create_data().                  */
+static ThreadBranch classify_thread(GstElement * owner)
+{
+    GstObject * element = gst_object_ref(GST_OBJECT(owner));
+    GstObject * parent  = NULL;
+    while ((parent = gst_object_get_parent(element)) != NULL && !GST_IS_PIPELINE(parent)) {
+        gst_object_unref(element);
+        element = parent;
+    }
+    if (parent != NULL) { gst_object_unref(parent); }
+
+    gchar *      name   = gst_object_get_name(element);
+    ThreadBranch branch = THREAD_BRANCH_OUTPUT;
+    gchar        last   = name[strlen(name) - 1];
+
+    if ((g_str_has_prefix(name, "decodebin") || g_str_has_prefix(name, "queue_jitter")
+         || g_str_has_prefix(name, "queue_audio_jitter") || g_str_has_prefix(name, "slate"))
+        && last >= '1' && last <= '3') {
+        branch = THREAD_BRANCH_INPUT1 + (last - '1');
+    }
+    else if (strcmp(name, "videomixer") == 0 || strcmp(name, "audiomixer") == 0
+             || strcmp(name, "audio_bed") == 0) {
+        branch = THREAD_BRANCH_MIXER;
+    }
+    else if (strcmp(name, "queue_streaming") == 0 || strcmp(name, "queue_audio_streaming") == 0) {
+        /* These queues drive the encoders */
+        branch = THREAD_BRANCH_ENCODER;
+    }
+
+    g_free(name);
+    gst_object_unref(element);
+
+    return branch;
+}
+
+static void apply_to_current_thread(ThreadPolicy * policy, ThreadBranch branch)
+{
+#ifdef __linux__
+    g_mutex_lock(&policy->lock);
+    if (!policy->configured) {
+        g_mutex_unlock(&policy->lock);
+        return;
+    }
+    gboolean  pinned       = policy->pinned[branch];
+    cpu_set_t cpus         = pinned ? policy->cpus[branch] : policy->default_cpus;
+    gint      priority     = policy->priority[branch];
+    gint      default_nice = policy->default_nice;
+    g_mutex_unlock(&policy->lock);
+
+    pid_t              tid         = syscall(SYS_gettid);
+    gboolean           failed      = FALSE;
+    gboolean           prioritized = FALSE;
+    struct sched_param param       = {.sched_priority = 0};
+
+    /* On Linux these calls apply to the calling thread only */
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+        g_printerr("Could not set the CPU affinity of a %s thread.\n", branch_names[branch]);
+        failed = TRUE;
+    }
+    /* Allocate on the node the thread runs on (the default, unless the process policy says otherwise). The  */
+    /* frames passed on to another branch are allocated on its node, see thread_policy_bind_allocation().    */
+    if (pinned) { syscall(SYS_set_mempolicy, THREAD_POLICY_MPOL_LOCAL, NULL, 0); }
+
+    if (priority > 0) {
+        param.sched_priority = priority;
+        if (sched_setscheduler(0, SCHED_FIFO, &param) == 0) { prioritized = TRUE; }
+        else if (setpriority(PRIO_PROCESS, tid, THREAD_POLICY_FALLBACK_NICE) == 0) {
+            g_printerr("No permission for SCHED_FIFO, using nice %d for a %s thread instead.\n",
+                       THREAD_POLICY_FALLBACK_NICE,
+                       branch_names[branch]);
+            prioritized = TRUE;
+        }
+    }
+    else {
+        /* The thread may have been used by another branch before */
+        if (sched_getscheduler(0) != SCHED_OTHER) { sched_setscheduler(0, SCHED_OTHER, &param); }
+        prioritized = priority < 0 && setpriority(PRIO_PROCESS, tid, priority) == 0;
+        if (priority == 0) { setpriority(PRIO_PROCESS, tid, default_nice); }
+    }
+    if (priority != 0 && !prioritized) {
+        g_printerr("Could not raise the priority of a %s thread.\n", branch_names[branch]);
+        failed = TRUE;
+    }
+
+    g_mutex_lock(&policy->lock);
+    if (pinned && !failed) { policy->threads_pinned++; }
+    if (prioritized) { policy->threads_prioritized++; }
+    if (failed) { policy->failures++; }
+    g_mutex_unlock(&policy->lock);
+#endif
+}
+
+/* Offers a pool allocating on the node of the consumer, first i.e. preferred by the producer. Only for frames in */
+/* system memory, other memory (e.g. GL) is left to the pool proposed downstream.                               */
+static GstPadProbeReturn cb_allocation_query(GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+    AllocationBinding * binding   = user_data;
+    GstQuery *          query     = GST_PAD_PROBE_INFO_QUERY(info);
+    GstAllocator *      allocator = NULL;
+    GstCaps *           caps      = NULL;
+    gboolean            need_pool = FALSE;
+    GstVideoInfo        video_info;
+
+    if (GST_QUERY_TYPE(query) != GST_QUERY_ALLOCATION) { return GST_PAD_PROBE_OK; }
+    gst_query_parse_allocation(query, &caps, &need_pool);
+    if (caps == NULL || !gst_video_info_from_caps(&video_info, caps)
+        || !gst_caps_features_contains(gst_caps_get_features(caps, 0), GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY)) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    g_mutex_lock(&binding->policy->lock);
+    if (binding->policy->allocators[binding->consumer] != NULL) {
+        allocator = gst_object_ref(binding->policy->allocators[binding->consumer]);
+    }
+    g_mutex_unlock(&binding->policy->lock);
+    if (allocator == NULL) { return GST_PAD_PROBE_OK; }
+
+    GstAllocationParams params;
+    guint               min = 0;
+    guint               max = 0;
+    gst_allocation_params_init(&params);
+    if (gst_query_get_n_allocation_pools(query) > 0) {
+        gst_query_parse_nth_allocation_pool(query, 0, NULL, NULL, &min, &max);
+    }
+
+    GstBufferPool * pool   = gst_video_buffer_pool_new();
+    GstStructure *  config = gst_buffer_pool_get_config(pool);
+    gst_buffer_pool_config_set_params(config, caps, video_info.size, min, max);
+    gst_buffer_pool_config_set_allocator(config, allocator, &params);
+    gst_buffer_pool_config_add_option(config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+    if (gst_buffer_pool_set_config(pool, config)) {
+        if (gst_query_get_n_allocation_pools(query) > 0) {
+            gst_query_set_nth_allocation_pool(query, 0, pool, video_info.size, min, max);
+        }
+        else {
+            gst_query_add_allocation_pool(query, pool, video_info.size, min, max);
+        }
+        if (gst_query_get_n_allocation_params(query) > 0) {
+            gst_query_set_nth_allocation_param(query, 0, allocator, &params);
+        }
+        else {
+            gst_query_add_allocation_param(query, allocator, &params);
+        }
+
+        g_mutex_lock(&binding->policy->lock);
+        binding->policy->pools_bound++;
+        g_mutex_unlock(&binding->policy->lock);
+    }
+    gst_object_unref(pool);
+    gst_object_unref(allocator);
+
+    return GST_PAD_PROBE_OK;
+}
+
+static void node_allocator_class_init(NodeAllocatorClass * klass)
+{
+    /* The memory itself is the system allocator's, which also frees it */
+    GST_ALLOCATOR_CLASS(klass)->alloc = node_allocator_alloc;
+}
+
+static void node_allocator_init(NodeAllocator * self)
+{
+    GST_OBJECT_FLAG_SET(self, GST_ALLOCATOR_FLAG_CUSTOM_ALLOC);
+}
+
+/* Page-aligned system memory, whose pages are bound to the node before anyone touches them */
+static GstMemory * node_allocator_alloc(GstAllocator * allocator, gsize size, GstAllocationParams * params)
+{
+    GstAllocationParams aligned;
+    GstMemory *         memory = NULL;
+
+    if (params != NULL) { aligned = *params; }
+    else {
+        gst_allocation_params_init(&aligned);
+    }
+#ifdef __linux__
+    NodeAllocator * self = (NodeAllocator *)allocator;
+    gsize           page = sysconf(_SC_PAGESIZE);
+    GstMapInfo      map;
+
+    aligned.align |= page - 1;
+    memory = gst_allocator_alloc(NULL, size, &aligned);
+    if (memory != NULL && gst_memory_map(memory, &map, GST_MAP_READ)) {
+        /* Only the pages entirely within the frame, the others may be shared with the allocator's bookkeeping */
+        guintptr      start = ((guintptr)map.data + page - 1) & ~(guintptr)(page - 1);
+        guintptr      end   = ((guintptr)map.data + map.size) & ~(guintptr)(page - 1);
+        unsigned long mask  = 1UL << self->node;
+        if (end > start) {
+            syscall(SYS_mbind,
+                    (void *)start,
+                    end - start,
+                    THREAD_POLICY_MPOL_PREFERRED,
+                    &mask,
+                    sizeof(mask) * 8,
+                    THREAD_POLICY_MPOL_MF_MOVE);
+        }
+        gst_memory_unmap(memory, &map);
+    }
+#else
+    memory = gst_allocator_alloc(NULL, size, &aligned);
+#endif
+
+    return memory;
+}
+
+#ifdef __linux__
+static gboolean parse_cpus(const gchar * cpus, cpu_set_t * set)
+{
+    gchar ** ranges = g_strsplit(cpus, ",", -1);
+    gboolean valid  = TRUE;
+
+    CPU_ZERO(set);
+    for (guint i = 0; valid && ranges[i] != NULL; i++) {
+        gchar * range = g_strstrip(ranges[i]);
+        gchar * end   = NULL;
+        guint64 first = g_ascii_strtoull(range, &end, 10);
+        guint64 last  = first;
+
+        if (end == range) { valid = FALSE; }
+        else if (*end == '-') {
+            gchar * start = end + 1;
+            last          = g_ascii_strtoull(start, &end, 10);
+            valid         = end != start;
+        }
+        valid = valid && *end == '\0' && first <= last && last < CPU_SETSIZE;
+
+        for (guint64 cpu = first; valid && cpu <= last; cpu++) { CPU_SET(cpu, set); }
+    }
+    g_strfreev(ranges);
+
+    return valid;
+}
+
+/* From the nodeN link of the CPU in sysfs, -1 if unknown (e.g. no NUMA support) */
+static gint cpu_node(guint cpu)
+{
+    gchar *       path = g_strdup_printf("/sys/devices/system/cpu/cpu%u", cpu);
+    GDir *        dir  = g_dir_open(path, 0, NULL);
+    const gchar * name = NULL;
+    gint          node = -1;
+
+    while (dir != NULL && node < 0 && (name = g_dir_read_name(dir)) != NULL) {
+        if (g_str_has_prefix(name, "node") && g_ascii_isdigit(name[4])) { node = g_ascii_strtoll(name + 4, NULL, 10); }
+    }
+    if (dir != NULL) { g_dir_close(dir); }
+    g_free(path);
+
+    /* The node mask passed to mbind() is a single word */
+    return node < (gint)(sizeof(unsigned long) * 8) ? node : -1;
+}
+#endif
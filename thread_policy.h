@@ -0,0 +1,50 @@
+#ifndef _THREAD_POLICY__H_
+#define _THREAD_POLICY__H_
+
+#include <gst/gst.h>
+
+/* CPU affinity & priority of the streaming threads, per branch of the pipeline.         */
+/* Applied from the thread itself when it starts (the ENTER stream-status message), so   */
+/* helper threads created later on (e.g. the x264 worker threads) inherit the settings.  */
+/* Pinned threads also allocate from their local NUMA node, except for the frames passed */
+/* on to another branch: those are allocated on the node of the branch consuming them,   */
+/* see thread_policy_bind_allocation().                                                  */
+typedef enum {
+    THREAD_BRANCH_INPUT1,
+    THREAD_BRANCH_INPUT2,
+    THREAD_BRANCH_INPUT3,
+    THREAD_BRANCH_MIXER,
+    THREAD_BRANCH_ENCODER,
+    THREAD_BRANCH_OUTPUT,
+    THREAD_BRANCH_COUNT,
+} ThreadBranch;
+
+typedef struct _ThreadPolicy ThreadPolicy;
+
+ThreadPolicy * thread_policy_new(void);
+
+/* @cpus is a CPU list such as "0-3,8", NULL or empty to not pin the branch. Returns FALSE if invalid. */
+/* Only affects the threads started afterwards.                                                        */
+gboolean thread_policy_set_cpus(ThreadPolicy * policy, ThreadBranch branch, const gchar * cpus);
+
+/* 0 keeps the default scheduling, 1..99 is a SCHED_FIFO priority, -1..-20 a nice value.   */
+/* A SCHED_FIFO priority falls back to nice -10 without the permission (CAP_SYS_NICE).      */
+void thread_policy_set_priority(ThreadPolicy * policy, ThreadBranch branch, gint priority);
+
+/* To be called from the bus sync handler, for every stream-status message of the pipeline */
+void thread_policy_handle_message(ThreadPolicy * policy, GstMessage * message);
+
+/* Apply the settings of @branch to the calling thread, for threads which aren't GStreamer's (no stream-status) */
+void thread_policy_apply(ThreadPolicy * policy, ThreadBranch branch);
+
+/* The frames flowing downstream through @pad get allocated on the NUMA node of @consumer (that of the first CPU */
+/* it's pinned to): the ALLOCATION queries passing @pad are answered with a pool bound to that node, preferred to  */
+/* the ones proposed downstream. No effect while @consumer isn't pinned, or for memory other than system memory.    */
+void thread_policy_bind_allocation(ThreadPolicy * policy, GstPad * pad, ThreadBranch consumer);
+
+void thread_policy_free(ThreadPolicy * policy);
+
+/* Add the thread metrics to @stats (fields prefixed with "threads-") */
+void thread_policy_fill_stats(ThreadPolicy * policy, GstStructure * stats);
+
+#endif /* _THREAD_POLICY__H_ */
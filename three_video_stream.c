@@ -10,19 +10,63 @@
  *
  */
 
+#include "control_queue.h"
+#include "dvr_ring.h"
+#include "encoder_backend.h"
+#include "frame_timing.h"
 #include "gst_helpers.h"
+#include "input_recovery.h"
+#include "pipeline_trace.h"
+#include "read_ahead_src.h"
+#include "snapshot.h"
+#include "store_forward.h"
+#include "thread_policy.h"
 #include "three_video_stream.h"
+#include "video_layout.h"
 
 struct _ThreeVideoStreamPrivate {
-    gchar *       file_path1;
-    gchar *       file_path2;
-    gchar *       file_path3;
-    gchar *       twitch_api_key;
-    gchar *       twitch_server;
-    int           output_width;
-    int           output_height;
-    gboolean      ready_to_play;
-    GstreamerData gstreamer_data;
+    gchar *                file_path1;
+    gchar *                file_path2;
+    gchar *                file_path3;
+    gchar *                twitch_api_key;
+    gchar *                twitch_server;
+    int                    output_width;
+    int                    output_height;
+    gboolean               ready_to_play;
+    gboolean               audio_enabled;
+    gdouble                audio_volumes[3];
+    gboolean               audio_mutes[3];
+    guint64                output_buffer_memory;
+    guint64                output_buffer_disk;
+    gboolean               output_catch_up;
+    StoreForward *         store_forward;
+    guint64                dvr_max_bytes;
+    guint                  dvr_max_duration;
+    DvrRing *              dvr_ring;
+    guint                  snapshot_interval;
+    gint                   snapshot_width;
+    gchar *                snapshot_format;
+    Snapshot *             snapshot;
+    guint                  input_jitter[3];
+    guint                  mixer_timeout;
+    gchar *                trace_file;
+    gchar *                thread_cpus[THREAD_BRANCH_COUNT];
+    gint                   thread_priorities[THREAD_BRANCH_COUNT];
+    ThreadPolicy *         thread_policy;
+    FrameTiming *          frame_timing;
+    ThreeVideoStreamLayout layout;
+    guint                  layout_transition;
+    VideoLayout *          video_layout;
+    gchar *                video_encoder;
+    gchar *                video_encoder_preset;
+    guint                  video_bitrate;
+    guint                  input_read_ahead;
+    guint                  input_read_throttle;
+    gchar *                input_caps[3];
+    ControlQueue *         control_queue;
+    /* The values above, set by the mixer thread too (see apply_changes()). Never held while calling into GStreamer. */
+    GMutex                 property_lock;
+    GstreamerData          gstreamer_data;
 };
 
 enum {
@@ -36,37 +80,465 @@ enum {
     PROP_OUTPUT_WIDTH,
     PROP_OUTPUT_HEIGHT,
     PROP_GST_PIPELINE,
+    PROP_AUDIO_ENABLED,
+    PROP_AUDIO_VOLUME1,
+    PROP_AUDIO_VOLUME2,
+    PROP_AUDIO_VOLUME3,
+    PROP_AUDIO_MUTE1,
+    PROP_AUDIO_MUTE2,
+    PROP_AUDIO_MUTE3,
+    PROP_STATS,
+    PROP_OUTPUT_BUFFER_MEMORY,
+    PROP_OUTPUT_BUFFER_DISK,
+    PROP_OUTPUT_CATCH_UP,
+    PROP_DVR_MAX_BYTES,
+    PROP_DVR_MAX_DURATION,
+    PROP_SNAPSHOT_INTERVAL,
+    PROP_SNAPSHOT_WIDTH,
+    PROP_SNAPSHOT_FORMAT,
+    PROP_INPUT_JITTER1,
+    PROP_INPUT_JITTER2,
+    PROP_INPUT_JITTER3,
+    PROP_MIXER_TIMEOUT,
+    PROP_TRACE_FILE,
+    PROP_CPUS_INPUT1,
+    PROP_CPUS_INPUT2,
+    PROP_CPUS_INPUT3,
+    PROP_CPUS_MIXER,
+    PROP_CPUS_ENCODER,
+    PROP_CPUS_OUTPUT,
+    PROP_PRIORITY_MIXER,
+    PROP_PRIORITY_ENCODER,
+    PROP_LAYOUT,
+    PROP_LAYOUT_TRANSITION,
+    PROP_VIDEO_ENCODER,
+    PROP_VIDEO_ENCODER_PRESET,
+    PROP_VIDEO_BITRATE,
+    PROP_INPUT_READ_AHEAD,
+    PROP_INPUT_READ_THROTTLE,
+    PROP_CAPS_INPUT1,
+    PROP_CAPS_INPUT2,
+    PROP_CAPS_INPUT3,
     PROP_SIZE,
 };
 
 /* This object is a child of GObject */
 G_DEFINE_TYPE_WITH_CODE(ThreeVideoStream, three_video_stream, G_TYPE_OBJECT, G_ADD_PRIVATE(ThreeVideoStream))
 
-static void cb_pad_added(GstElement * src, GstPad * new_pad, GstreamerData * data);
+static void            cb_pad_added(GstElement * src, GstPad * new_pad, GstreamerData * data);
+static GstBusSyncReply cb_bus_sync_message(GstBus * bus, GstMessage * message, gpointer user_data);
+static void            cb_deep_element_added(GstBin *                  bin,
+                                             GstBin *                  sub_bin,
+                                             GstElement *              element,
+                                             ThreeVideoStreamPrivate * priv);
 
 
+static gboolean check_property(ThreeVideoStreamPrivate * priv, guint prop_id, const GValue * value);
+static void     update_pipeline(ThreeVideoStreamPrivate * priv, guint prop_id);
+static void     update_dvr_limits(ThreeVideoStreamPrivate * priv);
+static void     update_snapshot_settings(ThreeVideoStreamPrivate * priv);
+static void     update_input_buffering(ThreeVideoStreamPrivate * priv);
+static void compute_layout(ThreeVideoStreamLayout layout, int width, int height, VideoPlacement placement[3]);
+static void swap_input(ThreeVideoStreamPrivate * priv, guint index, const gchar * location);
+
+static void           apply_changes(const GstStructure * batch, gpointer user_data);
+static gboolean       cb_apply_change(GQuark field_id, const GValue * value, gpointer user_data);
+static GstStructure * convert_changes(GObject * object, const GstStructure * changes, GError ** error);
+
+G_DEFINE_QUARK(three-video-stream-error-quark, three_video_stream_error)
+
+GType three_video_stream_layout_get_type(void)
+{
+    static gsize            layout_type = 0;
+    static const GEnumValue layouts[] = {
+        {THREE_VIDEO_STREAM_LAYOUT_LEFT_AND_STACKED, "1 on the left, 2 & 3 stacked on the right", "left-and-stacked"},
+        {THREE_VIDEO_STREAM_LAYOUT_COLUMNS, "Side by side", "columns"},
+        {THREE_VIDEO_STREAM_LAYOUT_MAIN_AND_INSETS, "1 on the whole screen, 2 & 3 inset", "main-and-insets"},
+        {THREE_VIDEO_STREAM_LAYOUT_FULLSCREEN1, "Only 1, on the whole screen", "fullscreen1"},
+        {THREE_VIDEO_STREAM_LAYOUT_FULLSCREEN2, "Only 2, on the whole screen", "fullscreen2"},
+        {THREE_VIDEO_STREAM_LAYOUT_FULLSCREEN3, "Only 3, on the whole screen", "fullscreen3"},
+        {0, NULL, NULL},
+    };
+
+    if (g_once_init_enter(&layout_type)) {
+        g_once_init_leave(&layout_type, g_enum_register_static("ThreeVideoStreamLayout", layouts));
+    }
+
+    return layout_type;
+}
+
 /* TODO allow changing at runtime */
-void configure_gst_pipeline(ThreeVideoStreamPrivate * priv)
+void configure_gst_pipeline(ThreeVideoStream * self)
 {
-    gboolean link_with_twitch = strlen(priv->twitch_api_key) != 0;
+    ThreeVideoStreamPrivate * priv             = self->priv;
+    gboolean                  link_with_twitch = strlen(priv->twitch_api_key) != 0;
 
-    link_pipeline_elements(&priv->gstreamer_data, link_with_twitch);
+    if (priv->trace_file == NULL && g_getenv("THREE_VIDEO_STREAM_TRACE") != NULL) {
+        priv->trace_file = g_strdup(g_getenv("THREE_VIDEO_STREAM_TRACE"));
+        pipeline_trace_start();
+    }
+
+    if (link_with_twitch) {
+        /* Both validated when set */
+        EncoderPreset preset = ENCODER_PRESET_LOW_LATENCY;
+        encoder_preset_from_name(priv->video_encoder_preset, &preset);
+        create_video_encoder(
+            &priv->gstreamer_data, encoder_backend_find(priv->video_encoder), preset, priv->video_bitrate);
+    }
+    if (priv->audio_enabled) { create_audio_elements(&priv->gstreamer_data, link_with_twitch); }
+    link_pipeline_elements(&priv->gstreamer_data, link_with_twitch, priv->audio_enabled);
     setup_video_placement(&priv->gstreamer_data, priv->output_width, priv->output_height);
 
-    setup_file_sources(&priv->gstreamer_data, priv->file_path1, priv->file_path2, priv->file_path3);
+    /* Runtime changes are applied between two frames of the mix, see three_video_stream_apply(). Created */
+    /* before the layout, for a batch changing it to take effect on the same frame as the rest of the batch. */
+    GstPad * mix_src_pad = gst_element_get_static_pad(priv->gstreamer_data.video_mixer, "src");
+    priv->control_queue  = control_queue_new(mix_src_pad, apply_changes, self);
+    gst_object_unref(mix_src_pad);
 
-    if (link_with_twitch) { setup_twitch_streaming(&priv->gstreamer_data, priv->twitch_api_key, priv->twitch_server); }
+    VideoPlacement placement[3];
+    GstPad *       mixer_pads[3] = {priv->gstreamer_data.video_mixer_pad1,
+                                    priv->gstreamer_data.video_mixer_pad2,
+                                    priv->gstreamer_data.video_mixer_pad3};
+    compute_layout(priv->layout, priv->output_width, priv->output_height, placement);
+    priv->video_layout = video_layout_new(priv->gstreamer_data.video_mixer, mixer_pads, placement);
+
+    if (priv->audio_enabled) { setup_audio_mixing(&priv->gstreamer_data); }
+    setup_audio_mix(&priv->gstreamer_data, priv->audio_volumes, priv->audio_mutes);
+
+    setup_input_buffering(&priv->gstreamer_data, priv->input_jitter, priv->mixer_timeout);
+
+    /* The decoded frames are allocated on the node of the mixer, and the mix on the node of the encoder */
+    for (guint i = 0; i < 3; i++) {
+        GstPad * queue_pad = gst_element_get_static_pad(get_input_video_queue(&priv->gstreamer_data, i), "src");
+        thread_policy_bind_allocation(priv->thread_policy, queue_pad, THREAD_BRANCH_MIXER);
+        gst_object_unref(queue_pad);
+    }
+    GstPad * mixer_pad = gst_element_get_static_pad(priv->gstreamer_data.video_mixer, "src");
+    thread_policy_bind_allocation(priv->thread_policy, mixer_pad, THREAD_BRANCH_ENCODER);
+    gst_object_unref(mixer_pad);
+
+    /* File inputs are read ahead by a dedicated source, the sources are configured once uridecodebin3 creates them */
+    if (priv->input_read_ahead > 0 || priv->input_read_throttle > 0) { read_ahead_src_register(); }
+    g_signal_connect(priv->gstreamer_data.pipeline, "deep-element-added", G_CALLBACK(cb_deep_element_added), priv);
+    setup_input_sources(&priv->gstreamer_data, priv->file_path1, priv->file_path2, priv->file_path3);
+
+    if (link_with_twitch) {
+        setup_twitch_streaming(&priv->gstreamer_data);
+
+        /* Outages of the RTMP connection are bridged by the store-and-forward stage */
+        gchar * location    = g_strjoin("", priv->twitch_server, priv->twitch_api_key, NULL);
+        priv->store_forward = store_forward_new(priv->gstreamer_data.sink_streaming);
+        store_forward_set_limits(priv->store_forward, priv->output_buffer_memory, priv->output_buffer_disk);
+        store_forward_set_thread_policy(priv->store_forward, priv->thread_policy);
+        store_forward_set_catch_up(priv->store_forward, priv->output_catch_up);
+        store_forward_start(priv->store_forward, location);
+        g_free(location);
+
+        priv->dvr_ring = dvr_ring_new(priv->gstreamer_data.sink_dvr);
+        update_dvr_limits(priv);
+    }
+
+    priv->snapshot = snapshot_new(priv->gstreamer_data.queue_snapshot, priv->gstreamer_data.sink_snapshot);
+    update_snapshot_settings(priv);
 
     g_signal_connect(priv->gstreamer_data.decodebin1, "pad-added", G_CALLBACK(cb_pad_added), &priv->gstreamer_data);
     g_signal_connect(priv->gstreamer_data.decodebin2, "pad-added", G_CALLBACK(cb_pad_added), &priv->gstreamer_data);
     g_signal_connect(priv->gstreamer_data.decodebin3, "pad-added", G_CALLBACK(cb_pad_added), &priv->gstreamer_data);
+
+    /* Errors of an input only affect that input, see input_recovery.h */
+    for (guint i = 0; i < 3; i++) {
+        priv->gstreamer_data.input_recoveries[i] =
+            input_recovery_new(&priv->gstreamer_data, i, G_CALLBACK(cb_pad_added));
+    }
+    GstBus * bus = gst_element_get_bus(priv->gstreamer_data.pipeline);
+    gst_bus_set_sync_handler(bus, cb_bus_sync_message, priv, NULL);
+    gst_object_unref(bus);
+
+    GstPad * mix_pad   = gst_element_get_static_pad(priv->gstreamer_data.video_mixer, "src");
+    priv->frame_timing = frame_timing_new(mix_pad);
+    gst_object_unref(mix_pad);
+}
+
+/* The values GStreamer (or the thread policy) has to accept, checked before anything is stored. Outside of the */
+/* property lock, which is never held while calling into GStreamer.                                            */
+static gboolean check_property(ThreeVideoStreamPrivate * priv, guint prop_id, const GValue * value)
+{
+    switch (prop_id) {
+    case PROP_SNAPSHOT_FORMAT: {
+        const gchar * format = g_value_get_string(value);
+        if (g_strcmp0(format, "jpeg") != 0 && g_strcmp0(format, "png") != 0) {
+            g_printerr("Unsupported snapshot format '%s' (expected 'jpeg' or 'png').\n", format);
+            return FALSE;
+        }
+        return TRUE;
+    }
+    case PROP_CPUS_INPUT1:
+    case PROP_CPUS_INPUT2:
+    case PROP_CPUS_INPUT3:
+    case PROP_CPUS_MIXER:
+    case PROP_CPUS_ENCODER:
+    case PROP_CPUS_OUTPUT:
+        /* Applied right away if valid, the thread policy has its own lock */
+        return thread_policy_set_cpus(
+            priv->thread_policy, THREAD_BRANCH_INPUT1 + (prop_id - PROP_CPUS_INPUT1), g_value_get_string(value));
+    case PROP_VIDEO_ENCODER: {
+        const gchar *          name    = g_value_get_string(value);
+        const EncoderBackend * backend = name != NULL ? encoder_backend_find(name) : NULL;
+        if (backend == NULL || !backend->flv) {
+            g_printerr("Unsupported video encoder '%s' (expected 'x264' or 'openh264').\n", name);
+            return FALSE;
+        }
+        return TRUE;
+    }
+    case PROP_VIDEO_ENCODER_PRESET: {
+        const gchar * name = g_value_get_string(value);
+        EncoderPreset preset;
+        if (!encoder_preset_from_name(name, &preset)) {
+            g_printerr("Unsupported encoder preset '%s' (expected 'low-latency' or 'quality').\n", name);
+            return FALSE;
+        }
+        return TRUE;
+    }
+    case PROP_CAPS_INPUT1:
+    case PROP_CAPS_INPUT2:
+    case PROP_CAPS_INPUT3: {
+        const gchar * hint = g_value_get_string(value);
+        GstCaps *     caps = hint != NULL ? gst_caps_from_string(hint) : NULL;
+        if (hint != NULL && caps == NULL) {
+            g_printerr("Invalid caps '%s' for input %u.\n", hint, prop_id - PROP_CAPS_INPUT1 + 1);
+            return FALSE;
+        }
+        if (caps != NULL) { gst_caps_unref(caps); }
+        return TRUE;
+    }
+    default: return TRUE;
+    }
+}
+
+/* Applies a property just stored to the pipeline, from a copy of the values taken under the property lock. Only */
+/* sets properties of elements & pads, when called for a batch between two frames of the mix, see apply_changes(). */
+static void update_pipeline(ThreeVideoStreamPrivate * priv, guint prop_id)
+{
+    switch (prop_id) {
+    case PROP_FILEPATH1:
+    case PROP_FILEPATH2:
+    case PROP_FILEPATH3: {
+        guint index = prop_id - PROP_FILEPATH1;
+        g_mutex_lock(&priv->property_lock);
+        gchar * paths[3] = {priv->file_path1, priv->file_path2, priv->file_path3};
+        gchar * location = g_strdup(paths[index]);
+        g_mutex_unlock(&priv->property_lock);
+
+        swap_input(priv, index, location);
+        g_free(location);
+        break;
+    }
+    case PROP_OUTPUT_CATCH_UP: {
+        g_mutex_lock(&priv->property_lock);
+        gboolean catch_up = priv->output_catch_up;
+        g_mutex_unlock(&priv->property_lock);
+
+        if (priv->store_forward != NULL) { store_forward_set_catch_up(priv->store_forward, catch_up); }
+        break;
+    }
+    case PROP_DVR_MAX_BYTES:
+    case PROP_DVR_MAX_DURATION: update_dvr_limits(priv); break;
+    case PROP_SNAPSHOT_INTERVAL:
+    case PROP_SNAPSHOT_WIDTH:
+    case PROP_SNAPSHOT_FORMAT: update_snapshot_settings(priv); break;
+    case PROP_INPUT_JITTER1:
+    case PROP_INPUT_JITTER2:
+    case PROP_INPUT_JITTER3:
+    case PROP_MIXER_TIMEOUT: update_input_buffering(priv); break;
+    case PROP_PRIORITY_MIXER:
+    case PROP_PRIORITY_ENCODER: {
+        ThreadBranch branch = prop_id == PROP_PRIORITY_MIXER ? THREAD_BRANCH_MIXER : THREAD_BRANCH_ENCODER;
+        g_mutex_lock(&priv->property_lock);
+        gint priority = priv->thread_priorities[branch];
+        g_mutex_unlock(&priv->property_lock);
+
+        thread_policy_set_priority(priv->thread_policy, branch, priority);
+        break;
+    }
+    case PROP_LAYOUT: {
+        VideoPlacement placement[3];
+        g_mutex_lock(&priv->property_lock);
+        compute_layout(priv->layout, priv->output_width, priv->output_height, placement);
+        guint transition = priv->layout_transition;
+        g_mutex_unlock(&priv->property_lock);
+
+        if (priv->video_layout != NULL) { video_layout_set(priv->video_layout, placement, transition * GST_MSECOND); }
+        break;
+    }
+    case PROP_VIDEO_BITRATE: {
+        g_mutex_lock(&priv->property_lock);
+        gchar * encoder = g_strdup(priv->video_encoder);
+        guint   bitrate = priv->video_bitrate;
+        g_mutex_unlock(&priv->property_lock);
+
+        if (priv->gstreamer_data.video_encoder_streaming != NULL) {
+            encoder_backend_set_bitrate(
+                encoder_backend_find(encoder), priv->gstreamer_data.video_encoder_streaming, bitrate);
+        }
+        g_free(encoder);
+        break;
+    }
+    case PROP_TRACE_FILE: {
+        g_mutex_lock(&priv->property_lock);
+        gboolean tracing = priv->trace_file != NULL;
+        g_mutex_unlock(&priv->property_lock);
+
+        if (tracing) { pipeline_trace_start(); }
+        break;
+    }
+    case PROP_AUDIO_VOLUME1:
+    case PROP_AUDIO_VOLUME2:
+    case PROP_AUDIO_VOLUME3:
+    case PROP_AUDIO_MUTE1:
+    case PROP_AUDIO_MUTE2:
+    case PROP_AUDIO_MUTE3: {
+        gdouble  volumes[3];
+        gboolean mutes[3];
+        g_mutex_lock(&priv->property_lock);
+        memcpy(volumes, priv->audio_volumes, sizeof(volumes));
+        memcpy(mutes, priv->audio_mutes, sizeof(mutes));
+        g_mutex_unlock(&priv->property_lock);
+
+        setup_audio_mix(&priv->gstreamer_data, volumes, mutes);
+        break;
+    }
+    default: break;
+    }
+}
+
+static void update_dvr_limits(ThreeVideoStreamPrivate * priv)
+{
+    g_mutex_lock(&priv->property_lock);
+    guint64 max_bytes    = priv->dvr_max_bytes;
+    guint   max_duration = priv->dvr_max_duration;
+    g_mutex_unlock(&priv->property_lock);
+
+    if (priv->dvr_ring != NULL) { dvr_ring_set_limits(priv->dvr_ring, max_bytes, max_duration * GST_SECOND); }
+}
+
+static void update_snapshot_settings(ThreeVideoStreamPrivate * priv)
+{
+    g_mutex_lock(&priv->property_lock);
+    guint   interval = priv->snapshot_interval;
+    gint    width    = priv->snapshot_width;
+    gchar * format   = g_strdup(priv->snapshot_format);
+    g_mutex_unlock(&priv->property_lock);
+
+    if (priv->snapshot != NULL) {
+        snapshot_set_interval(priv->snapshot, interval);
+        snapshot_set_format(priv->snapshot, format, width);
+    }
+    g_free(format);
+}
+
+/* Only once playing, configure_gst_pipeline() sets up the buffering before */
+static void update_input_buffering(ThreeVideoStreamPrivate * priv)
+{
+    g_mutex_lock(&priv->property_lock);
+    gboolean ready_to_play = priv->ready_to_play;
+    guint    mixer_timeout = priv->mixer_timeout;
+    guint    jitter[3];
+    memcpy(jitter, priv->input_jitter, sizeof(jitter));
+    g_mutex_unlock(&priv->property_lock);
+
+    if (ready_to_play) { setup_input_buffering(&priv->gstreamer_data, jitter, mixer_timeout); }
+}
+
+/* The mixer scales the inputs to their placement, ignoring their aspect ratio like the original layout did */
+static void compute_layout(ThreeVideoStreamLayout layout, int width, int height, VideoPlacement placement[3])
+{
+    const VideoPlacement full   = {0, 0, width, height, 1.0, 0};
+    const gint           margin = width / 32;
+
+    switch (layout) {
+    case THREE_VIDEO_STREAM_LAYOUT_COLUMNS:
+        for (guint i = 0; i < 3; i++) {
+            placement[i] = (VideoPlacement){(gint)i * width / 3, height / 3, width / 3, height / 3, 1.0, 0};
+        }
+        break;
+    case THREE_VIDEO_STREAM_LAYOUT_MAIN_AND_INSETS:
+        placement[0] = full;
+        placement[1] = (VideoPlacement){margin, height - height / 4 - margin, width / 4, height / 4, 1.0, 1};
+        placement[2] =
+            (VideoPlacement){width - width / 4 - margin, height - height / 4 - margin, width / 4, height / 4, 1.0, 1};
+        break;
+    case THREE_VIDEO_STREAM_LAYOUT_FULLSCREEN1:
+    case THREE_VIDEO_STREAM_LAYOUT_FULLSCREEN2:
+    case THREE_VIDEO_STREAM_LAYOUT_FULLSCREEN3:
+        /* The hidden inputs stay in place, so switching between them cross-fades over the transition */
+        for (guint i = 0; i < 3; i++) {
+            placement[i]       = full;
+            placement[i].alpha = 0.0;
+        }
+        placement[layout - THREE_VIDEO_STREAM_LAYOUT_FULLSCREEN1].alpha  = 1.0;
+        placement[layout - THREE_VIDEO_STREAM_LAYOUT_FULLSCREEN1].zorder = 1;
+        break;
+    case THREE_VIDEO_STREAM_LAYOUT_LEFT_AND_STACKED:
+    default:
+        placement[0] = (VideoPlacement){0, height / 4, width / 2, height / 2, 1.0, 0};
+        placement[1] = (VideoPlacement){width / 2, 0, width / 2, height / 2, 1.0, 0};
+        placement[2] = (VideoPlacement){width / 2, height / 2, width / 2, height / 2, 1.0, 0};
+        break;
+    }
+}
+
+/* Only once playing, the location is just stored until then */
+static void swap_input(ThreeVideoStreamPrivate * priv, guint index, const gchar * location)
+{
+    if (priv->gstreamer_data.input_recoveries[index] == NULL || location == NULL) { return; }
+
+    gchar * uri = get_input_uri(location);
+    if (uri != NULL) { input_recovery_swap(priv->gstreamer_data.input_recoveries[index], uri); }
+    g_free(uri);
+}
+
+static GstStructure * collect_stats(ThreeVideoStreamPrivate * priv)
+{
+    GstStructure * stats = gst_structure_new_empty("three-video-stream-stats");
+
+    for (guint i = 0; i < 3; i++) {
+        if (priv->gstreamer_data.input_recoveries[i] != NULL) {
+            input_recovery_fill_stats(priv->gstreamer_data.input_recoveries[i], stats);
+        }
+        if (*get_input_decodebin(&priv->gstreamer_data, i) != NULL) {
+            read_ahead_src_fill_stats(*get_input_decodebin(&priv->gstreamer_data, i), i, stats);
+        }
+    }
+    if (priv->store_forward != NULL) { store_forward_fill_stats(priv->store_forward, stats); }
+    if (priv->dvr_ring != NULL) { dvr_ring_fill_stats(priv->dvr_ring, stats); }
+    if (priv->snapshot != NULL) { snapshot_fill_stats(priv->snapshot, stats); }
+    if (priv->frame_timing != NULL) { frame_timing_fill_stats(priv->frame_timing, stats); }
+    if (priv->control_queue != NULL) { control_queue_fill_stats(priv->control_queue, stats); }
+    thread_policy_fill_stats(priv->thread_policy, stats);
+
+    /* Only known once playing, the latency query fails otherwise */
+    GstClockTime min_latency = 0;
+    GstClockTime max_latency = 0;
+    gboolean     live        = FALSE;
+    GstQuery *   query       = gst_query_new_latency();
+    if (priv->ready_to_play && gst_element_query(priv->gstreamer_data.pipeline, query)) {
+        gst_query_parse_latency(query, &live, &min_latency, &max_latency);
+        gst_structure_set(
+            stats, "pipeline-live", G_TYPE_BOOLEAN, live, "pipeline-latency", G_TYPE_UINT64, min_latency, NULL);
+    }
+    gst_query_unref(query);
+
+    return stats;
 }
 
 static void three_video_stream_init(ThreeVideoStream * self)
 {
     self->priv                 = three_video_stream_get_instance_private(self);
     self->priv->gstreamer_data = create_data();
+    g_mutex_init(&self->priv->gstreamer_data.audio_lock);
+    g_mutex_init(&self->priv->property_lock);
     self->priv->ready_to_play  = FALSE;
+    self->priv->thread_policy  = thread_policy_new();
 }
 
 static void _three_video_stream_set_property(GObject * object, guint prop_id, const GValue * value, GParamSpec * pspec)
@@ -74,6 +546,29 @@ static void _three_video_stream_set_property(GObject * object, guint prop_id, co
     ThreeVideoStream * self = THREE_VIDEO_STREAM(object);
     g_return_if_fail(IS_THREE_VIDEO_STREAM(object));
 
+    /* Starting the stream isn't a runtime change, and the elements it adds read the properties themselves */
+    if (prop_id == PROP_READY_TO_PLAY) {
+        gboolean ready_to_play = g_value_get_boolean(value);
+        g_mutex_lock(&self->priv->property_lock);
+        gboolean changed          = (self->priv->ready_to_play != ready_to_play);
+        self->priv->ready_to_play = ready_to_play;
+        g_mutex_unlock(&self->priv->property_lock);
+
+        if (changed) {
+            if (ready_to_play) {
+                g_print("Starting the stream...");
+                configure_gst_pipeline(self);
+            }
+            else {
+                g_print("Stopping the stream...");
+            }
+        }
+        return;
+    }
+    if (!check_property(self->priv, prop_id, value)) { return; }
+
+    /* Only the values are stored under the lock, the pipeline is updated afterwards, see update_pipeline() */
+    g_mutex_lock(&self->priv->property_lock);
     switch (prop_id) {
     case PROP_FILEPATH1:
         g_free(self->priv->file_path1);
@@ -95,28 +590,70 @@ static void _three_video_stream_set_property(GObject * object, guint prop_id, co
         g_free(self->priv->twitch_server);
         self->priv->twitch_server = g_value_dup_string(value);
         break;
-    case PROP_READY_TO_PLAY: {
-        gboolean changed;
-        gboolean ready_to_play = g_value_get_boolean(value);
-        changed                = (self->priv->ready_to_play != ready_to_play);
-
-        self->priv->ready_to_play = ready_to_play;
-        if (changed) {
-            if (ready_to_play) {
-                g_print("Starting the stream...");
-                configure_gst_pipeline(self->priv);
-            }
-            else {
-                g_print("Stopping the stream...");
-            }
-        }
-        break;
-    }
     case PROP_OUTPUT_WIDTH: self->priv->output_width = g_value_get_int(value); break;
     case PROP_OUTPUT_HEIGHT: self->priv->output_height = g_value_get_int(value); break;
     case PROP_GST_PIPELINE: g_printerr("Cannot change gst-pipeline property\n"); break;
+    case PROP_AUDIO_ENABLED: self->priv->audio_enabled = g_value_get_boolean(value); break;
+    case PROP_OUTPUT_BUFFER_MEMORY: self->priv->output_buffer_memory = g_value_get_uint64(value); break;
+    case PROP_OUTPUT_BUFFER_DISK: self->priv->output_buffer_disk = g_value_get_uint64(value); break;
+    case PROP_OUTPUT_CATCH_UP: self->priv->output_catch_up = g_value_get_boolean(value); break;
+    case PROP_DVR_MAX_BYTES: self->priv->dvr_max_bytes = g_value_get_uint64(value); break;
+    case PROP_DVR_MAX_DURATION: self->priv->dvr_max_duration = g_value_get_uint(value); break;
+    case PROP_SNAPSHOT_INTERVAL: self->priv->snapshot_interval = g_value_get_uint(value); break;
+    case PROP_SNAPSHOT_WIDTH: self->priv->snapshot_width = g_value_get_int(value); break;
+    case PROP_SNAPSHOT_FORMAT:
+        g_free(self->priv->snapshot_format);
+        self->priv->snapshot_format = g_value_dup_string(value);
+        break;
+    case PROP_INPUT_JITTER1:
+    case PROP_INPUT_JITTER2:
+    case PROP_INPUT_JITTER3: self->priv->input_jitter[prop_id - PROP_INPUT_JITTER1] = g_value_get_uint(value); break;
+    case PROP_CPUS_INPUT1:
+    case PROP_CPUS_INPUT2:
+    case PROP_CPUS_INPUT3:
+    case PROP_CPUS_MIXER:
+    case PROP_CPUS_ENCODER:
+    case PROP_CPUS_OUTPUT:
+        g_free(self->priv->thread_cpus[prop_id - PROP_CPUS_INPUT1]);
+        self->priv->thread_cpus[prop_id - PROP_CPUS_INPUT1] = g_value_dup_string(value);
+        break;
+    case PROP_PRIORITY_MIXER: self->priv->thread_priorities[THREAD_BRANCH_MIXER] = g_value_get_int(value); break;
+    case PROP_PRIORITY_ENCODER: self->priv->thread_priorities[THREAD_BRANCH_ENCODER] = g_value_get_int(value); break;
+    case PROP_LAYOUT: self->priv->layout = g_value_get_enum(value); break;
+    case PROP_LAYOUT_TRANSITION: self->priv->layout_transition = g_value_get_uint(value); break;
+    case PROP_VIDEO_ENCODER:
+        g_free(self->priv->video_encoder);
+        self->priv->video_encoder = g_value_dup_string(value);
+        break;
+    case PROP_VIDEO_ENCODER_PRESET:
+        g_free(self->priv->video_encoder_preset);
+        self->priv->video_encoder_preset = g_value_dup_string(value);
+        break;
+    case PROP_VIDEO_BITRATE: self->priv->video_bitrate = g_value_get_uint(value); break;
+    case PROP_INPUT_READ_AHEAD: self->priv->input_read_ahead = g_value_get_uint(value); break;
+    case PROP_INPUT_READ_THROTTLE: self->priv->input_read_throttle = g_value_get_uint(value); break;
+    case PROP_CAPS_INPUT1:
+    case PROP_CAPS_INPUT2:
+    case PROP_CAPS_INPUT3:
+        g_free(self->priv->input_caps[prop_id - PROP_CAPS_INPUT1]);
+        self->priv->input_caps[prop_id - PROP_CAPS_INPUT1] = g_value_dup_string(value);
+        break;
+    case PROP_TRACE_FILE:
+        g_free(self->priv->trace_file);
+        self->priv->trace_file = g_value_dup_string(value);
+        break;
+    case PROP_MIXER_TIMEOUT: self->priv->mixer_timeout = g_value_get_uint(value); break;
+    case PROP_AUDIO_VOLUME1:
+    case PROP_AUDIO_VOLUME2:
+    case PROP_AUDIO_VOLUME3: self->priv->audio_volumes[prop_id - PROP_AUDIO_VOLUME1] = g_value_get_double(value); break;
+    case PROP_AUDIO_MUTE1:
+    case PROP_AUDIO_MUTE2:
+    case PROP_AUDIO_MUTE3: self->priv->audio_mutes[prop_id - PROP_AUDIO_MUTE1] = g_value_get_boolean(value); break;
     default: G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec); break;
     }
+    g_mutex_unlock(&self->priv->property_lock);
+
+    update_pipeline(self->priv, prop_id);
 }
 
 static void _three_video_stream_get_property(GObject * object, guint prop_id, GValue * value, GParamSpec * pspec)
@@ -124,6 +661,13 @@ static void _three_video_stream_get_property(GObject * object, guint prop_id, GV
     ThreeVideoStream * self = THREE_VIDEO_STREAM(object);
     g_return_if_fail(IS_THREE_VIDEO_STREAM(object));
 
+    /* Queries the pipeline, which must not wait for a batch being applied */
+    if (prop_id == PROP_STATS) {
+        g_value_take_boxed(value, collect_stats(self->priv));
+        return;
+    }
+
+    g_mutex_lock(&self->priv->property_lock);
     switch (prop_id) {
     case PROP_FILEPATH1: g_value_set_string(value, self->priv->file_path1); break;
     case PROP_FILEPATH2: g_value_set_string(value, self->priv->file_path2); break;
@@ -137,8 +681,47 @@ static void _three_video_stream_get_property(GObject * object, guint prop_id, GV
         g_value_set_object(value, self->priv->gstreamer_data.pipeline);
         break;
     }
+    case PROP_AUDIO_ENABLED: g_value_set_boolean(value, self->priv->audio_enabled); break;
+    case PROP_AUDIO_VOLUME1:
+    case PROP_AUDIO_VOLUME2:
+    case PROP_AUDIO_VOLUME3: g_value_set_double(value, self->priv->audio_volumes[prop_id - PROP_AUDIO_VOLUME1]); break;
+    case PROP_AUDIO_MUTE1:
+    case PROP_AUDIO_MUTE2:
+    case PROP_AUDIO_MUTE3: g_value_set_boolean(value, self->priv->audio_mutes[prop_id - PROP_AUDIO_MUTE1]); break;
+    case PROP_OUTPUT_BUFFER_MEMORY: g_value_set_uint64(value, self->priv->output_buffer_memory); break;
+    case PROP_OUTPUT_BUFFER_DISK: g_value_set_uint64(value, self->priv->output_buffer_disk); break;
+    case PROP_OUTPUT_CATCH_UP: g_value_set_boolean(value, self->priv->output_catch_up); break;
+    case PROP_DVR_MAX_BYTES: g_value_set_uint64(value, self->priv->dvr_max_bytes); break;
+    case PROP_DVR_MAX_DURATION: g_value_set_uint(value, self->priv->dvr_max_duration); break;
+    case PROP_SNAPSHOT_INTERVAL: g_value_set_uint(value, self->priv->snapshot_interval); break;
+    case PROP_SNAPSHOT_WIDTH: g_value_set_int(value, self->priv->snapshot_width); break;
+    case PROP_SNAPSHOT_FORMAT: g_value_set_string(value, self->priv->snapshot_format); break;
+    case PROP_INPUT_JITTER1:
+    case PROP_INPUT_JITTER2:
+    case PROP_INPUT_JITTER3: g_value_set_uint(value, self->priv->input_jitter[prop_id - PROP_INPUT_JITTER1]); break;
+    case PROP_MIXER_TIMEOUT: g_value_set_uint(value, self->priv->mixer_timeout); break;
+    case PROP_TRACE_FILE: g_value_set_string(value, self->priv->trace_file); break;
+    case PROP_LAYOUT: g_value_set_enum(value, self->priv->layout); break;
+    case PROP_LAYOUT_TRANSITION: g_value_set_uint(value, self->priv->layout_transition); break;
+    case PROP_VIDEO_ENCODER: g_value_set_string(value, self->priv->video_encoder); break;
+    case PROP_VIDEO_ENCODER_PRESET: g_value_set_string(value, self->priv->video_encoder_preset); break;
+    case PROP_VIDEO_BITRATE: g_value_set_uint(value, self->priv->video_bitrate); break;
+    case PROP_INPUT_READ_AHEAD: g_value_set_uint(value, self->priv->input_read_ahead); break;
+    case PROP_INPUT_READ_THROTTLE: g_value_set_uint(value, self->priv->input_read_throttle); break;
+    case PROP_CAPS_INPUT1:
+    case PROP_CAPS_INPUT2:
+    case PROP_CAPS_INPUT3: g_value_set_string(value, self->priv->input_caps[prop_id - PROP_CAPS_INPUT1]); break;
+    case PROP_CPUS_INPUT1:
+    case PROP_CPUS_INPUT2:
+    case PROP_CPUS_INPUT3:
+    case PROP_CPUS_MIXER:
+    case PROP_CPUS_ENCODER:
+    case PROP_CPUS_OUTPUT: g_value_set_string(value, self->priv->thread_cpus[prop_id - PROP_CPUS_INPUT1]); break;
+    case PROP_PRIORITY_MIXER: g_value_set_int(value, self->priv->thread_priorities[THREAD_BRANCH_MIXER]); break;
+    case PROP_PRIORITY_ENCODER: g_value_set_int(value, self->priv->thread_priorities[THREAD_BRANCH_ENCODER]); break;
     default: G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec); break;
     }
+    g_mutex_unlock(&self->priv->property_lock);
 }
 
 static void _three_video_stream_dispose(GObject * object)
@@ -151,13 +734,60 @@ static void _three_video_stream_finalize(GObject * object)
 {
     ThreeVideoStream * self = THREE_VIDEO_STREAM(object);
 
-    if (self->priv->gstreamer_data.pipeline != NULL) { g_object_unref(self->priv->gstreamer_data.pipeline); }
+    if (self->priv->gstreamer_data.video_mixer_pad1 != NULL) {
+        gst_object_unref(self->priv->gstreamer_data.video_mixer_pad1);
+        gst_object_unref(self->priv->gstreamer_data.video_mixer_pad2);
+        gst_object_unref(self->priv->gstreamer_data.video_mixer_pad3);
+    }
+    if (self->priv->gstreamer_data.pipeline != NULL) {
+        GstBus * bus = gst_element_get_bus(self->priv->gstreamer_data.pipeline);
+        gst_bus_set_sync_handler(bus, NULL, NULL, NULL);
+        gst_object_unref(bus);
+        /* Stop the streaming threads before the per-input state they use goes away */
+        gst_element_set_state(self->priv->gstreamer_data.pipeline, GST_STATE_NULL);
+        g_object_unref(self->priv->gstreamer_data.pipeline);
+    }
+    for (guint i = 0; i < 3; i++) {
+        if (self->priv->gstreamer_data.audio_mixer_pads[i] != NULL) {
+            gst_object_unref(self->priv->gstreamer_data.audio_mixer_pads[i]);
+        }
+        if (self->priv->gstreamer_data.audio_selector_pads[i] != NULL) {
+            gst_object_unref(self->priv->gstreamer_data.audio_selector_pads[i]);
+        }
+    }
+    if (self->priv->gstreamer_data.audio_selector_mix_pad != NULL) {
+        gst_object_unref(self->priv->gstreamer_data.audio_selector_mix_pad);
+    }
+    g_mutex_clear(&self->priv->gstreamer_data.audio_lock);
+    g_mutex_clear(&self->priv->property_lock);
+    for (guint i = 0; i < 3; i++) {
+        if (self->priv->gstreamer_data.input_recoveries[i] != NULL) {
+            input_recovery_free(self->priv->gstreamer_data.input_recoveries[i]);
+        }
+    }
+    if (self->priv->store_forward != NULL) { store_forward_free(self->priv->store_forward); }
+    if (self->priv->dvr_ring != NULL) { dvr_ring_free(self->priv->dvr_ring); }
+    if (self->priv->snapshot != NULL) { snapshot_free(self->priv->snapshot); }
+    if (self->priv->frame_timing != NULL) { frame_timing_free(self->priv->frame_timing); }
+    if (self->priv->video_layout != NULL) { video_layout_free(self->priv->video_layout); }
+    if (self->priv->control_queue != NULL) { control_queue_free(self->priv->control_queue); }
+    if (self->priv->trace_file != NULL) {
+        pipeline_trace_write(self->priv->trace_file);
+        pipeline_trace_stop();
+    }
+    thread_policy_free(self->priv->thread_policy);
 
     g_free(self->priv->file_path1);
     g_free(self->priv->file_path2);
     g_free(self->priv->file_path3);
     g_free(self->priv->twitch_api_key);
     g_free(self->priv->twitch_server);
+    g_free(self->priv->snapshot_format);
+    g_free(self->priv->trace_file);
+    g_free(self->priv->video_encoder);
+    g_free(self->priv->video_encoder_preset);
+    for (guint i = 0; i < THREAD_BRANCH_COUNT; i++) { g_free(self->priv->thread_cpus[i]); }
+    for (guint i = 0; i < 3; i++) { g_free(self->priv->input_caps[i]); }
 
     /* Chain up : end */
     G_OBJECT_CLASS(three_video_stream_parent_class)->finalize(object);
@@ -176,29 +806,32 @@ static void three_video_stream_class_init(ThreeVideoStreamClass * klass)
                                     PROP_FILEPATH1,
                                     g_param_spec_string("file-path1",
                                                         NULL,
-                                                        "Path to load the first video (for left part of the screen)",
+                                                        "Path or URI of the first video (for left part of the screen)",
                                                         NULL,
-                                                        G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_NAME
+                                                        G_PARAM_READWRITE | G_PARAM_CONSTRUCT
+                                                            | GST_PARAM_MUTABLE_PLAYING | G_PARAM_STATIC_NAME
                                                             | G_PARAM_STATIC_BLURB));
 
     g_object_class_install_property(object_class,
                                     PROP_FILEPATH2,
                                     g_param_spec_string("file-path2",
                                                         NULL,
-                                                        "Path to load the second video (for top-right part of the "
+                                                        "Path or URI of the second video (for top-right part of the "
                                                         "screen)",
                                                         NULL,
-                                                        G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_NAME
+                                                        G_PARAM_READWRITE | G_PARAM_CONSTRUCT
+                                                            | GST_PARAM_MUTABLE_PLAYING | G_PARAM_STATIC_NAME
                                                             | G_PARAM_STATIC_BLURB));
 
     g_object_class_install_property(object_class,
                                     PROP_FILEPATH3,
                                     g_param_spec_string("file-path3",
                                                         NULL,
-                                                        "Path to load the third video (for bottom-right part of the "
+                                                        "Path or URI of the third video (for bottom-right part of the "
                                                         "screen)",
                                                         NULL,
-                                                        G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_NAME
+                                                        G_PARAM_READWRITE | G_PARAM_CONSTRUCT
+                                                            | GST_PARAM_MUTABLE_PLAYING | G_PARAM_STATIC_NAME
                                                             | G_PARAM_STATIC_BLURB));
 
     g_object_class_install_property(object_class,
@@ -258,6 +891,313 @@ static void three_video_stream_class_init(ThreeVideoStreamClass * klass)
                                                         "Underlying GStreamer pipeline",
                                                         GST_TYPE_ELEMENT,
                                                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+    g_object_class_install_property(object_class,
+                                    PROP_STATS,
+                                    g_param_spec_boxed("stats",
+                                                       "stats",
+                                                       "Snapshot of the runtime metrics (e.g. per-input outages)",
+                                                       GST_TYPE_STRUCTURE,
+                                                       G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+    g_object_class_install_property(object_class,
+                                    PROP_OUTPUT_BUFFER_MEMORY,
+                                    g_param_spec_uint64("output-buffer-memory",
+                                                        NULL,
+                                                        "Bytes of encoded output kept in memory during an outage "
+                                                        "of the stream output",
+                                                        0,
+                                                        G_MAXUINT64,
+                                                        64 * 1024 * 1024,
+                                                        G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_NAME
+                                                            | G_PARAM_STATIC_BLURB));
+
+    g_object_class_install_property(object_class,
+                                    PROP_OUTPUT_BUFFER_DISK,
+                                    g_param_spec_uint64("output-buffer-disk",
+                                                        NULL,
+                                                        "Bytes of encoded output spilled to a temporary file once the "
+                                                        "memory buffer is full (0 to disable)",
+                                                        0,
+                                                        G_MAXUINT64,
+                                                        1024 * 1024 * 1024,
+                                                        G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_NAME
+                                                            | G_PARAM_STATIC_BLURB));
+
+    g_object_class_install_property(object_class,
+                                    PROP_OUTPUT_CATCH_UP,
+                                    g_param_spec_boolean("output-catch-up",
+                                                         NULL,
+                                                         "After an outage, send all the buffered output (faster than "
+                                                         "real time) instead of skipping to the latest keyframe",
+                                                         TRUE,
+                                                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT
+                                                             | GST_PARAM_MUTABLE_PLAYING | G_PARAM_STATIC_NAME
+                                                             | G_PARAM_STATIC_BLURB));
+
+    g_object_class_install_property(object_class,
+                                    PROP_DVR_MAX_BYTES,
+                                    g_param_spec_uint64("dvr-max-bytes",
+                                                        NULL,
+                                                        "Upper bound of the encoded video kept for replays, in bytes",
+                                                        0,
+                                                        G_MAXUINT64,
+                                                        256 * 1024 * 1024,
+                                                        G_PARAM_READWRITE | G_PARAM_CONSTRUCT
+                                                            | GST_PARAM_MUTABLE_PLAYING | G_PARAM_STATIC_NAME
+                                                            | G_PARAM_STATIC_BLURB));
+
+    g_object_class_install_property(object_class,
+                                    PROP_DVR_MAX_DURATION,
+                                    g_param_spec_uint("dvr-max-duration",
+                                                      NULL,
+                                                      "Upper bound of the encoded video kept for replays, in seconds",
+                                                      1,
+                                                      3600,
+                                                      120,
+                                                      G_PARAM_READWRITE | G_PARAM_CONSTRUCT | GST_PARAM_MUTABLE_PLAYING
+                                                          | G_PARAM_STATIC_NAME | G_PARAM_STATIC_BLURB));
+
+    g_object_class_install_property(object_class,
+                                    PROP_SNAPSHOT_INTERVAL,
+                                    g_param_spec_uint("snapshot-interval",
+                                                      NULL,
+                                                      "Seconds between snapshots of the mix (0 to only take them on "
+                                                      "request)",
+                                                      0,
+                                                      3600,
+                                                      0,
+                                                      G_PARAM_READWRITE | G_PARAM_CONSTRUCT | GST_PARAM_MUTABLE_PLAYING
+                                                          | G_PARAM_STATIC_NAME | G_PARAM_STATIC_BLURB));
+
+    g_object_class_install_property(object_class,
+                                    PROP_SNAPSHOT_WIDTH,
+                                    g_param_spec_int("snapshot-width",
+                                                     NULL,
+                                                     "Width of the snapshots (the height keeps the aspect ratio)",
+                                                     16,
+                                                     1920,
+                                                     320,
+                                                     G_PARAM_READWRITE | G_PARAM_CONSTRUCT | GST_PARAM_MUTABLE_PLAYING
+                                                         | G_PARAM_STATIC_NAME | G_PARAM_STATIC_BLURB));
+
+    g_object_class_install_property(object_class,
+                                    PROP_SNAPSHOT_FORMAT,
+                                    g_param_spec_string("snapshot-format",
+                                                        NULL,
+                                                        "Image format of the snapshots, 'jpeg' or 'png'",
+                                                        "jpeg",
+                                                        G_PARAM_READWRITE | G_PARAM_CONSTRUCT
+                                                            | GST_PARAM_MUTABLE_PLAYING | G_PARAM_STATIC_NAME
+                                                            | G_PARAM_STATIC_BLURB));
+
+    g_object_class_install_property(object_class,
+                                    PROP_MIXER_TIMEOUT,
+                                    g_param_spec_uint("mixer-timeout",
+                                                      NULL,
+                                                      "How long the mixers wait for late live inputs before using "
+                                                      "their last frame, in ms (can be changed at runtime)",
+                                                      0,
+                                                      10000,
+                                                      0,
+                                                      G_PARAM_READWRITE | G_PARAM_CONSTRUCT | GST_PARAM_MUTABLE_PLAYING
+                                                          | G_PARAM_STATIC_NAME | G_PARAM_STATIC_BLURB));
+
+    g_object_class_install_property(object_class,
+                                    PROP_TRACE_FILE,
+                                    g_param_spec_string("trace-file",
+                                                        NULL,
+                                                        "Trace the pipeline, and write the trace to this file when "
+                                                        "done (or set THREE_VIDEO_STREAM_TRACE in the environment)",
+                                                        NULL,
+                                                        G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_NAME
+                                                            | G_PARAM_STATIC_BLURB));
+
+    const gchar * branch_blurbs[THREAD_BRANCH_COUNT] = {
+        "CPUs to run the threads of the first input on, e.g. '0-3,8' (applies to threads started afterwards)",
+        "CPUs to run the threads of the second input on, e.g. '0-3,8' (applies to threads started afterwards)",
+        "CPUs to run the threads of the third input on, e.g. '0-3,8' (applies to threads started afterwards)",
+        "CPUs to run the mixer threads on, e.g. '0-3,8' (applies to threads started afterwards)",
+        "CPUs to run the encoder threads on, e.g. '0-3,8' (applies to threads started afterwards)",
+        "CPUs to run the remaining (output) threads on, e.g. '0-3,8' (applies to threads started afterwards)",
+    };
+    const gchar * branch_names[THREAD_BRANCH_COUNT] = {
+        "cpus-input1", "cpus-input2", "cpus-input3", "cpus-mixer", "cpus-encoder", "cpus-output"};
+    for (guint i = 0; i < THREAD_BRANCH_COUNT; i++) {
+        g_object_class_install_property(object_class,
+                                        PROP_CPUS_INPUT1 + i,
+                                        g_param_spec_string(branch_names[i],
+                                                            NULL,
+                                                            branch_blurbs[i],
+                                                            NULL,
+                                                            G_PARAM_READWRITE | G_PARAM_CONSTRUCT
+                                                                | GST_PARAM_MUTABLE_PLAYING | G_PARAM_STATIC_STRINGS));
+    }
+
+    g_object_class_install_property(object_class,
+                                    PROP_PRIORITY_MIXER,
+                                    g_param_spec_int("priority-mixer",
+                                                     NULL,
+                                                     "Priority of the mixer threads: 1..99 for SCHED_FIFO, "
+                                                     "-20..-1 for a nice value, 0 to leave it",
+                                                     -20,
+                                                     99,
+                                                     0,
+                                                     G_PARAM_READWRITE | G_PARAM_CONSTRUCT | GST_PARAM_MUTABLE_PLAYING
+                                                         | G_PARAM_STATIC_NAME | G_PARAM_STATIC_BLURB));
+
+    g_object_class_install_property(object_class,
+                                    PROP_PRIORITY_ENCODER,
+                                    g_param_spec_int("priority-encoder",
+                                                     NULL,
+                                                     "Priority of the encoder threads: 1..99 for SCHED_FIFO, "
+                                                     "-20..-1 for a nice value, 0 to leave it",
+                                                     -20,
+                                                     99,
+                                                     0,
+                                                     G_PARAM_READWRITE | G_PARAM_CONSTRUCT | GST_PARAM_MUTABLE_PLAYING
+                                                         | G_PARAM_STATIC_NAME | G_PARAM_STATIC_BLURB));
+
+    g_object_class_install_property(object_class,
+                                    PROP_LAYOUT,
+                                    g_param_spec_enum("layout",
+                                                      NULL,
+                                                      "Arrangement of the inputs (can be changed at runtime)",
+                                                      THREE_VIDEO_STREAM_TYPE_LAYOUT,
+                                                      THREE_VIDEO_STREAM_LAYOUT_LEFT_AND_STACKED,
+                                                      G_PARAM_READWRITE | G_PARAM_CONSTRUCT | GST_PARAM_MUTABLE_PLAYING
+                                                          | G_PARAM_STATIC_NAME | G_PARAM_STATIC_BLURB));
+
+    g_object_class_install_property(object_class,
+                                    PROP_LAYOUT_TRANSITION,
+                                    g_param_spec_uint("layout-transition",
+                                                      NULL,
+                                                      "How long a change of the layout takes, in ms (0 to switch at "
+                                                      "once, on the next frame)",
+                                                      0,
+                                                      10000,
+                                                      0,
+                                                      G_PARAM_READWRITE | G_PARAM_CONSTRUCT | GST_PARAM_MUTABLE_PLAYING
+                                                          | G_PARAM_STATIC_NAME | G_PARAM_STATIC_BLURB));
+
+    g_object_class_install_property(object_class,
+                                    PROP_VIDEO_ENCODER,
+                                    g_param_spec_string("video-encoder",
+                                                        NULL,
+                                                        "Encoder of the stream, 'x264' or 'openh264' (the others "
+                                                        "can't be streamed over RTMP, see EncoderBench)",
+                                                        "x264",
+                                                        G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_NAME
+                                                            | G_PARAM_STATIC_BLURB));
+
+    g_object_class_install_property(object_class,
+                                    PROP_VIDEO_ENCODER_PRESET,
+                                    g_param_spec_string("video-encoder-preset",
+                                                        NULL,
+                                                        "Settings of the encoder, 'low-latency' or 'quality'",
+                                                        "low-latency",
+                                                        G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_NAME
+                                                            | G_PARAM_STATIC_BLURB));
+
+    g_object_class_install_property(object_class,
+                                    PROP_VIDEO_BITRATE,
+                                    g_param_spec_uint("video-bitrate",
+                                                      NULL,
+                                                      "Bitrate of the streamed video, in kbit/s",
+                                                      50,
+                                                      100000,
+                                                      400,
+                                                      G_PARAM_READWRITE | G_PARAM_CONSTRUCT | GST_PARAM_MUTABLE_PLAYING
+                                                          | G_PARAM_STATIC_NAME | G_PARAM_STATIC_BLURB));
+
+    g_object_class_install_property(object_class,
+                                    PROP_INPUT_READ_AHEAD,
+                                    g_param_spec_uint("input-read-ahead",
+                                                      NULL,
+                                                      "How far ahead to read the input files, in MiB, from a "
+                                                      "separate thread (0 to read them on the decoder threads)",
+                                                      0,
+                                                      4096,
+                                                      0,
+                                                      G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_NAME
+                                                          | G_PARAM_STATIC_BLURB));
+
+    g_object_class_install_property(object_class,
+                                    PROP_INPUT_READ_THROTTLE,
+                                    g_param_spec_uint("input-read-throttle",
+                                                      NULL,
+                                                      "Limit the reads of each input file to this many KiB/s, to "
+                                                      "emulate slow storage (0 for no limit)",
+                                                      0,
+                                                      G_MAXUINT,
+                                                      0,
+                                                      G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_NAME
+                                                          | G_PARAM_STATIC_BLURB));
+
+    const gchar * caps_names[3] = {"caps-input1", "caps-input2", "caps-input3"};
+    for (guint i = 0; i < 3; i++) {
+        g_object_class_install_property(object_class,
+                                        PROP_CAPS_INPUT1 + i,
+                                        g_param_spec_string(caps_names[i],
+                                                            NULL,
+                                                            "Caps of a UDP or RTP input which can't be typefound, e.g. "
+                                                            "'application/x-rtp,media=video,encoding-name=H264,"
+                                                            "clock-rate=90000'",
+                                                            NULL,
+                                                            G_PARAM_READWRITE | G_PARAM_CONSTRUCT
+                                                                | G_PARAM_STATIC_STRINGS));
+    }
+
+    g_object_class_install_property(object_class,
+                                    PROP_AUDIO_ENABLED,
+                                    g_param_spec_boolean("audio-enabled",
+                                                         NULL,
+                                                         "Mix the audio of the inputs which have some",
+                                                         TRUE,
+                                                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_NAME
+                                                             | G_PARAM_STATIC_BLURB));
+
+    for (guint i = 0; i < 3; i++) {
+        gchar * volume_name = g_strdup_printf("audio-volume%u", i + 1);
+        gchar * mute_name   = g_strdup_printf("audio-mute%u", i + 1);
+        gchar * jitter_name = g_strdup_printf("input-jitter%u", i + 1);
+
+        g_object_class_install_property(object_class,
+                                        PROP_AUDIO_VOLUME1 + i,
+                                        g_param_spec_double(volume_name,
+                                                            NULL,
+                                                            "Gain applied to the audio of the input (can be changed "
+                                                            "at runtime)",
+                                                            0.0,
+                                                            10.0,
+                                                            1.0,
+                                                            G_PARAM_READWRITE | G_PARAM_CONSTRUCT
+                                                                | GST_PARAM_MUTABLE_PLAYING | G_PARAM_STATIC_BLURB));
+
+        g_object_class_install_property(object_class,
+                                        PROP_AUDIO_MUTE1 + i,
+                                        g_param_spec_boolean(mute_name,
+                                                             NULL,
+                                                             "Mute the audio of the input (can be changed at runtime)",
+                                                             FALSE,
+                                                             G_PARAM_READWRITE | G_PARAM_CONSTRUCT
+                                                                 | GST_PARAM_MUTABLE_PLAYING | G_PARAM_STATIC_BLURB));
+
+        g_object_class_install_property(object_class,
+                                        PROP_INPUT_JITTER1 + i,
+                                        g_param_spec_uint(jitter_name,
+                                                          NULL,
+                                                          "Jitter buffer of the input, in ms (adds to the latency "
+                                                          "of the mix)",
+                                                          0,
+                                                          10000,
+                                                          0,
+                                                          G_PARAM_READWRITE | G_PARAM_CONSTRUCT
+                                                              | GST_PARAM_MUTABLE_PLAYING | G_PARAM_STATIC_BLURB));
+        g_free(volume_name);
+        g_free(mute_name);
+        g_free(jitter_name);
+    }
 }
 
 /* METHODS */
@@ -328,6 +1268,212 @@ void three_video_stream_clear(ThreeVideoStream ** three_video_stream)
     g_clear_object(three_video_stream);
 }
 
+/**
+ * three_video_stream_get_replay_range:
+ * @three_video_stream: a #ThreeVideoStream
+ * @start: (out) (optional): running time of the oldest replayable frame, in nanoseconds
+ * @end: (out) (optional): running time of the latest replayable frame, in nanoseconds
+ *
+ * Get the time range kept in the replay buffer (only while streaming).
+ *
+ * Returns: %FALSE if there is nothing to replay.
+ */
+gboolean three_video_stream_get_replay_range(ThreeVideoStream * three_video_stream, guint64 * start, guint64 * end)
+{
+    g_return_val_if_fail(IS_THREE_VIDEO_STREAM(three_video_stream), FALSE);
+
+    if (three_video_stream->priv->dvr_ring == NULL) { return FALSE; }
+    return dvr_ring_get_range(three_video_stream->priv->dvr_ring, start, end);
+}
+
+/**
+ * three_video_stream_export_replay:
+ * @three_video_stream: a #ThreeVideoStream
+ * @start: running time of the beginning of the clip, in nanoseconds
+ * @end: running time of the end of the clip, in nanoseconds
+ * @path: MP4 file to write
+ *
+ * Export a clip of the already encoded stream, without re-encoding it.
+ * The clip starts at the last keyframe before @start. Blocks the caller until the remux is done
+ * (up to 30 seconds), so it must not be called from the main loop: the stream (e.g. its output
+ * reconnections and input recovery) relies on it. Call it from a worker thread instead.
+ *
+ * Returns: %TRUE if the clip was written.
+ */
+gboolean three_video_stream_export_replay(ThreeVideoStream * three_video_stream,
+                                          guint64            start,
+                                          guint64            end,
+                                          const gchar *      path)
+{
+    g_return_val_if_fail(IS_THREE_VIDEO_STREAM(three_video_stream), FALSE);
+
+    if (three_video_stream->priv->dvr_ring == NULL) {
+        g_printerr("Replays are only available while streaming.\n");
+        return FALSE;
+    }
+    return dvr_ring_export(three_video_stream->priv->dvr_ring, start, end, path);
+}
+
+/**
+ * three_video_stream_request_snapshot:
+ * @three_video_stream: a #ThreeVideoStream
+ *
+ * Take a snapshot of the next frame of the mix, regardless of the snapshot interval.
+ * The image is available through three_video_stream_get_snapshot() once encoded.
+ */
+void three_video_stream_request_snapshot(ThreeVideoStream * three_video_stream)
+{
+    g_return_if_fail(IS_THREE_VIDEO_STREAM(three_video_stream));
+
+    if (three_video_stream->priv->snapshot == NULL) {
+        g_printerr("Snapshots are only available once the stream is started.\n");
+        return;
+    }
+    snapshot_request(three_video_stream->priv->snapshot);
+}
+
+/**
+ * three_video_stream_get_snapshot:
+ * @three_video_stream: a #ThreeVideoStream
+ *
+ * Get the latest snapshot of the mix, encoded as set by the snapshot-format property.
+ *
+ * Returns: (transfer full) (nullable): the image, or %NULL if none was taken yet.
+ */
+GBytes * three_video_stream_get_snapshot(ThreeVideoStream * three_video_stream)
+{
+    g_return_val_if_fail(IS_THREE_VIDEO_STREAM(three_video_stream), NULL);
+
+    if (three_video_stream->priv->snapshot == NULL) { return NULL; }
+    return snapshot_get_latest(three_video_stream->priv->snapshot);
+}
+
+/**
+ * three_video_stream_write_trace:
+ * @three_video_stream: a #ThreeVideoStream
+ * @path: file to write
+ *
+ * Write the pipeline trace recorded so far (see the trace-file property) in the Chrome trace event format,
+ * which can be opened in chrome://tracing or ui.perfetto.dev. Tracing continues afterwards.
+ *
+ * Returns: %TRUE if the trace was written.
+ */
+gboolean three_video_stream_write_trace(ThreeVideoStream * three_video_stream, const gchar * path)
+{
+    g_return_val_if_fail(IS_THREE_VIDEO_STREAM(three_video_stream), FALSE);
+
+    if (!pipeline_trace_is_active()) {
+        g_printerr("Tracing is not enabled, set the trace-file property.\n");
+        return FALSE;
+    }
+    return pipeline_trace_write(path);
+}
+
+/**
+ * three_video_stream_apply:
+ * @three_video_stream: a #ThreeVideoStream
+ * @changes: property names and their new values, e.g. "layout" = "columns" and "video-bitrate" = 2500
+ *
+ * Change several properties at once. Once playing, the whole batch is applied by the mixer thread
+ * between two output frames, so that e.g. a new layout and a new bitrate start on the same frame.
+ * Input swaps (file-path1..3) are the exception: they are only started on that frame, and complete
+ * asynchronously from the main loop, the input showing its last frame until the new one is decoded.
+ * They can't take effect on the frame of other changes, hence are rejected in a batch with any.
+ * Only the properties which can be changed at runtime (flagged with %GST_PARAM_MUTABLE_PLAYING)
+ * are accepted. Values are converted to the type of their property, strings are parsed (e.g. the
+ * nick of an enum value). Doesn't block, safe to call from any thread.
+ *
+ * Returns: %FALSE if any change is invalid, in which case none is applied.
+ */
+gboolean three_video_stream_apply(ThreeVideoStream * three_video_stream, const GstStructure * changes, GError ** error)
+{
+    g_return_val_if_fail(IS_THREE_VIDEO_STREAM(three_video_stream), FALSE);
+    g_return_val_if_fail(changes != NULL, FALSE);
+
+    GstStructure * batch = convert_changes(G_OBJECT(three_video_stream), changes, error);
+    if (batch == NULL) { return FALSE; }
+
+    if (three_video_stream->priv->control_queue != NULL) {
+        control_queue_push(three_video_stream->priv->control_queue, batch);
+    }
+    else {
+        apply_changes(batch, three_video_stream);
+        gst_structure_free(batch);
+    }
+
+    return TRUE;
+}
+
+/**
+ * three_video_stream_get_state:
+ * @three_video_stream: a #ThreeVideoStream
+ *
+ * Get the value of every property, except the Twitch API key, the pipeline and the stats.
+ * Changes submitted with three_video_stream_apply() show once applied.
+ *
+ * Returns: (transfer full): the values, by property name.
+ */
+GstStructure * three_video_stream_get_state(ThreeVideoStream * three_video_stream)
+{
+    g_return_val_if_fail(IS_THREE_VIDEO_STREAM(three_video_stream), NULL);
+
+    GstStructure * state  = gst_structure_new_empty("three-video-stream-state");
+    guint          count  = 0;
+    GParamSpec **  pspecs = g_object_class_list_properties(G_OBJECT_GET_CLASS(three_video_stream), &count);
+
+    for (guint i = 0; i < count; i++) {
+        GValue value = G_VALUE_INIT;
+
+        if (!(pspecs[i]->flags & G_PARAM_READABLE) || G_TYPE_IS_OBJECT(pspecs[i]->value_type)
+            || G_TYPE_IS_BOXED(pspecs[i]->value_type) || g_strcmp0(pspecs[i]->name, "twitch-api-key") == 0) {
+            continue;
+        }
+        g_value_init(&value, pspecs[i]->value_type);
+        g_object_get_property(G_OBJECT(three_video_stream), pspecs[i]->name, &value);
+        gst_structure_take_value(state, pspecs[i]->name, &value);
+    }
+    g_free(pspecs);
+
+    return state;
+}
+
+static GstBusSyncReply cb_bus_sync_message(GstBus * bus, GstMessage * message, gpointer user_data)
+{
+    ThreeVideoStreamPrivate * priv = user_data;
+
+    /* Runs on the thread posting the message, which is what the thread policy relies on */
+    if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_STREAM_STATUS) {
+        thread_policy_handle_message(priv->thread_policy, message);
+        return GST_BUS_PASS;
+    }
+
+    return input_recovery_bus_sync_handler(bus, message, &priv->gstreamer_data);
+}
+
+/* Any element added anywhere in the pipeline, including the sources of re-created decodebins */
+static void cb_deep_element_added(GstBin * bin, GstBin * sub_bin, GstElement * element, ThreeVideoStreamPrivate * priv)
+{
+    gchar * caps[3];
+    guint   jitter[3];
+
+    /* Copied, the element is set up without the lock */
+    g_mutex_lock(&priv->property_lock);
+    for (guint i = 0; i < 3; i++) {
+        caps[i]   = g_strdup(priv->input_caps[i]);
+        jitter[i] = priv->input_jitter[i];
+    }
+    guint64 read_ahead = (guint64)priv->input_read_ahead * 1024 * 1024;
+    guint64 throttle   = (guint64)priv->input_read_throttle * 1024;
+    g_mutex_unlock(&priv->property_lock);
+
+    if (!IS_READ_AHEAD_SRC(element)) { setup_input_source(&priv->gstreamer_data, element, caps, jitter); }
+    else {
+        /* Without read-ahead, still read (one block ahead) through it, to be able to throttle */
+        g_object_set(element, "read-ahead", read_ahead, "throttle", throttle, NULL);
+    }
+    for (guint i = 0; i < 3; i++) { g_free(caps[i]); }
+}
+
 static void cb_pad_added(GstElement * src, GstPad * new_pad, GstreamerData * data)
 {
     GstPad *         sink_pad     = NULL;
@@ -339,29 +1485,51 @@ static void cb_pad_added(GstElement * src, GstPad * new_pad, GstreamerData * dat
 
     g_print("Received new pad '%s' from '%s':\n", new_pad_name, src_name);
 
-    if (GST_IS_PAD(sink_pad) && gst_pad_is_linked(sink_pad)) {
-        g_print("We are already linked. Ignoring.\n");
+    if (g_str_has_prefix(new_pad_name, "audio") && data->audio_mixer == NULL) {
+        g_print(" Found audio pad, ignoring as audio mixing is disabled.\n");
         skip_linking = TRUE;
     }
     else if (g_str_has_prefix(new_pad_name, "audio")) {
-        g_print(" Found audio pad, ignoring as audio is currently unsupported.\n");
-        skip_linking = TRUE;
+        g_print(" Found audio pad. Plugging it into the audiomixer.\n");
+        /* The audio chain of the input, and its mixer pad, only exist once it has audio */
+        if (strcmp(src_name, "decodebin1") == 0) { sink_pad = get_input_audio_sink(data, 0); }
+        else if (strcmp(src_name, "decodebin2") == 0) {
+            sink_pad = get_input_audio_sink(data, 1);
+        }
+        else if (strcmp(src_name, "decodebin3") == 0) {
+            sink_pad = get_input_audio_sink(data, 2);
+        }
+        else {
+            g_printerr("Unexpected element name '%s', ignoring its pad.\n", src_name);
+        }
     }
     else if (g_str_has_prefix(new_pad_name, "video")) {
         g_print(" Found video pad. Plugging it into the videomixer.\n");
-        if (strcmp(src_name, "decodebin1") == 0) { sink_pad = gst_element_get_static_pad(data->videoscale1, "sink"); }
+        if (strcmp(src_name, "decodebin1") == 0) { sink_pad = gst_element_get_static_pad(data->queue_jitter1, "sink"); }
         else if (strcmp(src_name, "decodebin2") == 0) {
-            sink_pad = gst_element_get_static_pad(data->videoscale2, "sink");
+            sink_pad = gst_element_get_static_pad(data->queue_jitter2, "sink");
         }
         else if (strcmp(src_name, "decodebin3") == 0) {
-            sink_pad = gst_element_get_static_pad(data->videoscale3, "sink");
+            sink_pad = gst_element_get_static_pad(data->queue_jitter3, "sink");
         }
         else {
-            g_error("Unexpected element name '%s'.\n", src_name);
+            g_printerr("Unexpected element name '%s', ignoring its pad.\n", src_name);
         }
     }
 
-    if (!skip_linking) {
+    /* e.g. a second video stream of the same input */
+    if (sink_pad != NULL && gst_pad_is_linked(sink_pad)) {
+        g_print("We are already linked. Ignoring.\n");
+        skip_linking = TRUE;
+    }
+
+    if (!skip_linking && sink_pad != NULL) {
+        /* If the input is recovering from a failure, take over from its slate */
+        gint index = src_name[strlen(src_name) - 1] - '1';
+        if (data->input_recoveries[index] != NULL) {
+            gst_pad_set_offset(new_pad, input_recovery_release_slate(data->input_recoveries[index]));
+        }
+
         /* Attempt the link */
         ret = gst_pad_link(new_pad, sink_pad);
         if (GST_PAD_LINK_FAILED(ret)) { g_printerr("Pad link link failed.\n"); }
@@ -375,3 +1543,81 @@ static void cb_pad_added(GstElement * src, GstPad * new_pad, GstreamerData * dat
     g_free(src_name);
     g_free(new_pad_name);
 }
+
+/* Also used before playing, from the calling thread */
+static void apply_changes(const GstStructure * batch, gpointer user_data)
+{
+    GObject * object = user_data;
+
+    /* The notifications of the batch are only emitted once it is applied as a whole */
+    g_object_freeze_notify(object);
+    gst_structure_foreach(batch, cb_apply_change, object);
+    g_object_thaw_notify(object);
+}
+
+static gboolean cb_apply_change(GQuark field_id, const GValue * value, gpointer user_data)
+{
+    g_object_set_property(G_OBJECT(user_data), g_quark_to_string(field_id), value);
+    return TRUE;
+}
+
+/* Validate all the changes up front, so that a batch is either applied as a whole or not at all */
+static GstStructure * convert_changes(GObject * object, const GstStructure * changes, GError ** error)
+{
+    GstStructure * batch = gst_structure_new_empty("three-video-stream-changes");
+
+    for (gint i = 0; i < gst_structure_n_fields(changes); i++) {
+        const gchar *  name      = gst_structure_nth_field_name(changes, i);
+        const GValue * value     = gst_structure_get_value(changes, name);
+        GParamSpec *   pspec     = g_object_class_find_property(G_OBJECT_GET_CLASS(object), name);
+        GValue         converted = G_VALUE_INIT;
+        gboolean       valid     = FALSE;
+
+        if (pspec == NULL || !(pspec->flags & G_PARAM_WRITABLE) || !(pspec->flags & GST_PARAM_MUTABLE_PLAYING)) {
+            g_set_error(error,
+                        THREE_VIDEO_STREAM_ERROR,
+                        THREE_VIDEO_STREAM_ERROR_INVALID_CHANGE,
+                        "'%s' can't be changed at runtime",
+                        name);
+            gst_structure_free(batch);
+            return NULL;
+        }
+
+        g_value_init(&converted, pspec->value_type);
+        if (G_VALUE_HOLDS_STRING(value) && pspec->value_type != G_TYPE_STRING) {
+            valid = g_value_get_string(value) != NULL && gst_value_deserialize(&converted, g_value_get_string(value));
+        }
+        else if (g_value_type_transformable(G_VALUE_TYPE(value), pspec->value_type)) {
+            valid = g_value_transform(value, &converted);
+        }
+        /* Validating modifies out of range values, rather reject them */
+        if (!valid || g_param_value_validate(pspec, &converted)) {
+            gchar * text = gst_value_serialize(value);
+            g_set_error(error,
+                        THREE_VIDEO_STREAM_ERROR,
+                        THREE_VIDEO_STREAM_ERROR_INVALID_CHANGE,
+                        "Invalid value %s for '%s'",
+                        text != NULL ? text : "(unknown)",
+                        name);
+            g_free(text);
+            g_value_unset(&converted);
+            gst_structure_free(batch);
+            return NULL;
+        }
+        gst_structure_take_value(batch, name, &converted);
+    }
+
+    /* A swap only shows once the new input is decoded, i.e. can't take effect on the frame of the rest of the batch */
+    guint swaps = gst_structure_has_field(batch, "file-path1") + gst_structure_has_field(batch, "file-path2")
+                  + gst_structure_has_field(batch, "file-path3");
+    if (swaps > 0 && swaps < (guint)gst_structure_n_fields(batch)) {
+        g_set_error(error,
+                    THREE_VIDEO_STREAM_ERROR,
+                    THREE_VIDEO_STREAM_ERROR_INVALID_CHANGE,
+                    "Input swaps (file-path1..3) can't be batched with other changes");
+        gst_structure_free(batch);
+        return NULL;
+    }
+
+    return batch;
+}
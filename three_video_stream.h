@@ -3,6 +3,7 @@
 
 #include <glib-object.h>
 #include <glib.h>
+#include <gst/gst.h>
 
 G_BEGIN_DECLS
 
@@ -15,6 +16,29 @@ G_BEGIN_DECLS
 #define THREE_VIDEO_STREAM_GET_CLASS(obj) \
     (G_TYPE_INSTANCE_GET_CLASS((obj), THREE_VIDEO_STREAM_TYPE_NAME, ThreeVideoStreamClass))
 
+#define THREE_VIDEO_STREAM_TYPE_LAYOUT (three_video_stream_layout_get_type())
+
+/* Arrangement of the three inputs in the output */
+typedef enum {
+    THREE_VIDEO_STREAM_LAYOUT_LEFT_AND_STACKED, /* 1 on the left, 2 top right, 3 bottom right */
+    THREE_VIDEO_STREAM_LAYOUT_COLUMNS,          /* side by side */
+    THREE_VIDEO_STREAM_LAYOUT_MAIN_AND_INSETS,  /* 1 on the whole screen, 2 & 3 inset in the bottom corners */
+    THREE_VIDEO_STREAM_LAYOUT_FULLSCREEN1,      /* only one input, on the whole screen */
+    THREE_VIDEO_STREAM_LAYOUT_FULLSCREEN2,
+    THREE_VIDEO_STREAM_LAYOUT_FULLSCREEN3,
+} ThreeVideoStreamLayout;
+
+GType three_video_stream_layout_get_type(void) G_GNUC_CONST;
+
+#define THREE_VIDEO_STREAM_ERROR (three_video_stream_error_quark())
+
+typedef enum {
+    /* Unknown property, not changeable at runtime, invalid value, or an input swap batched with other changes */
+    THREE_VIDEO_STREAM_ERROR_INVALID_CHANGE,
+} ThreeVideoStreamError;
+
+GQuark three_video_stream_error_quark(void);
+
 typedef struct _ThreeVideoStreamClass   ThreeVideoStreamClass;
 typedef struct _ThreeVideoStream        ThreeVideoStream;
 typedef struct _ThreeVideoStreamPrivate ThreeVideoStreamPrivate;
@@ -40,6 +64,23 @@ ThreeVideoStream * three_video_stream_ref(ThreeVideoStream * three_video_stream)
 void               three_video_stream_free(ThreeVideoStream * three_video_stream);
 void               three_video_stream_clear(ThreeVideoStream ** three_video_stream);
 
+gboolean three_video_stream_get_replay_range(ThreeVideoStream * three_video_stream, guint64 * start, guint64 * end);
+/* Blocks its caller until the remux is done (up to 30 s), i.e. not to be called from the main loop */
+gboolean three_video_stream_export_replay(ThreeVideoStream * three_video_stream,
+                                          guint64            start,
+                                          guint64            end,
+                                          const gchar *      path);
+
+void     three_video_stream_request_snapshot(ThreeVideoStream * three_video_stream);
+GBytes * three_video_stream_get_snapshot(ThreeVideoStream * three_video_stream);
+
+gboolean three_video_stream_write_trace(ThreeVideoStream * three_video_stream, const gchar * path);
+
+gboolean       three_video_stream_apply(ThreeVideoStream *   three_video_stream,
+                                        const GstStructure * changes,
+                                        GError **            error);
+GstStructure * three_video_stream_get_state(ThreeVideoStream * three_video_stream);
+
 G_END_DECLS
 
 #endif /* _THREE_VIDEO_STREAM__H_ */
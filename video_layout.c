@@ -0,0 +1,130 @@
+#include "video_layout.h"
+
+struct _VideoLayout {
+    GstPad * mixer_src;
+    gulong   probe_id;
+    GstPad * pads[3];
+
+    GMutex         lock;
+    VideoPlacement current[3]; /* as last set on the pads */
+    VideoPlacement from[3];
+    VideoPlacement to[3];
+    GstClockTime   transition;
+    GstClockTime   started; /* timestamp of the first frame of the transition */
+    gboolean       pending;
+};
+
+static GstPadProbeReturn cb_frame_boundary(GstPad * pad, GstPadProbeInfo * info, gpointer user_data);
+static void              interpolate(const VideoPlacement * from,
+                                     const VideoPlacement * to,
+                                     gdouble                progress,
+                                     VideoPlacement *       result);
+static void              apply_placement(GstPad * pad, const VideoPlacement * old, const VideoPlacement * placement);
+
+VideoLayout * video_layout_new(GstElement * mixer, GstPad * pads[3], const VideoPlacement placement[3])
+{
+    g_return_val_if_fail(mixer != NULL && pads != NULL && placement != NULL, NULL);
+
+    VideoLayout * layout = g_new0(VideoLayout, 1);
+    layout->mixer_src    = gst_element_get_static_pad(mixer, "src");
+    g_mutex_init(&layout->lock);
+
+    for (guint i = 0; i < 3; i++) {
+        layout->pads[i]    = gst_object_ref(pads[i]);
+        layout->current[i] = placement[i];
+        apply_placement(pads[i], NULL, &placement[i]);
+    }
+
+    layout->probe_id
+        = gst_pad_add_probe(layout->mixer_src, GST_PAD_PROBE_TYPE_BUFFER, cb_frame_boundary, layout, NULL);
+
+    return layout;
+}
+
+void video_layout_set(VideoLayout * layout, const VideoPlacement placement[3], GstClockTime transition)
+{
+    g_return_if_fail(layout != NULL && placement != NULL);
+
+    g_mutex_lock(&layout->lock);
+    for (guint i = 0; i < 3; i++) {
+        /* A switch during a transition continues from wherever the inputs are */
+        layout->from[i] = layout->current[i];
+        layout->to[i]   = placement[i];
+    }
+    layout->transition = transition;
+    layout->started    = GST_CLOCK_TIME_NONE;
+    layout->pending    = TRUE;
+    g_mutex_unlock(&layout->lock);
+}
+
+void video_layout_free(VideoLayout * layout)
+{
+    g_return_if_fail(layout != NULL);
+
+    gst_pad_remove_probe(layout->mixer_src, layout->probe_id);
+    gst_object_unref(layout->mixer_src);
+    for (guint i = 0; i < 3; i++) { gst_object_unref(layout->pads[i]); }
+    g_mutex_clear(&layout->lock);
+    g_free(layout);
+}
+
+/* private functions' definitions */
+
+/* Runs on the mixer thread once a frame is out, so the new placement applies to the whole next frame */
+static GstPadProbeReturn cb_frame_boundary(GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+    VideoLayout *  layout = user_data;
+    GstClockTime   pts    = GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info));
+    VideoPlacement old[3];
+    VideoPlacement next[3];
+    gdouble        progress = 1.0;
+
+    g_mutex_lock(&layout->lock);
+    if (!layout->pending) {
+        g_mutex_unlock(&layout->lock);
+        return GST_PAD_PROBE_OK;
+    }
+
+    if (!GST_CLOCK_TIME_IS_VALID(layout->started)) { layout->started = pts; }
+    if (layout->transition > 0 && GST_CLOCK_TIME_IS_VALID(pts) && GST_CLOCK_TIME_IS_VALID(layout->started)) {
+        progress = CLAMP((gdouble)GST_CLOCK_DIFF(layout->started, pts) / layout->transition, 0.0, 1.0);
+    }
+    for (guint i = 0; i < 3; i++) {
+        old[i] = layout->current[i];
+        interpolate(&layout->from[i], &layout->to[i], progress, &next[i]);
+        layout->current[i] = next[i];
+    }
+    layout->pending = progress < 1.0;
+    g_mutex_unlock(&layout->lock);
+
+    for (guint i = 0; i < 3; i++) { apply_placement(layout->pads[i], &old[i], &next[i]); }
+
+    return GST_PAD_PROBE_OK;
+}
+
+static void interpolate(const VideoPlacement * from,
+                        const VideoPlacement * to,
+                        gdouble                progress,
+                        VideoPlacement *       result)
+{
+    result->x      = from->x + (gint)((to->x - from->x) * progress);
+    result->y      = from->y + (gint)((to->y - from->y) * progress);
+    result->width  = MAX(1, from->width + (gint)((to->width - from->width) * progress));
+    result->height = MAX(1, from->height + (gint)((to->height - from->height) * progress));
+    result->alpha  = from->alpha + (to->alpha - from->alpha) * progress;
+    /* The stacking order switches at once, for the incoming input to cover the others */
+    result->zorder = to->zorder;
+}
+
+/* Only sets what changed, as a new size makes the mixer set up a new scaler for the pad */
+static void apply_placement(GstPad * pad, const VideoPlacement * old, const VideoPlacement * placement)
+{
+    if (old == NULL || old->x != placement->x || old->y != placement->y) {
+        g_object_set(pad, "xpos", placement->x, "ypos", placement->y, NULL);
+    }
+    if (old == NULL || old->width != placement->width || old->height != placement->height) {
+        g_object_set(pad, "width", placement->width, "height", placement->height, NULL);
+    }
+    if (old == NULL || old->alpha != placement->alpha) { g_object_set(pad, "alpha", placement->alpha, NULL); }
+    if (old == NULL || old->zorder != placement->zorder) { g_object_set(pad, "zorder", placement->zorder, NULL); }
+}
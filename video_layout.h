@@ -0,0 +1,29 @@
+#ifndef _VIDEO_LAYOUT__H_
+#define _VIDEO_LAYOUT__H_
+
+#include <gst/gst.h>
+
+/* Placement of the inputs on the mixer (compositor) pads.                          */
+/* Changes are applied between two output frames, from a probe on the mixer output, */
+/* optionally interpolated over a transition. As the mixer does the scaling, the    */
+/* caps of the inputs and of the mix stay the same, so nothing renegotiates.        */
+typedef struct {
+    gint    x;
+    gint    y;
+    gint    width;
+    gint    height;
+    gdouble alpha;
+    guint   zorder;
+} VideoPlacement;
+
+typedef struct _VideoLayout VideoLayout;
+
+/* @pads are the mixer pads of the inputs. The initial @placement is applied right away. */
+VideoLayout * video_layout_new(GstElement * mixer, GstPad * pads[3], const VideoPlacement placement[3]);
+
+/* Move the inputs to @placement over @transition (0 to switch at once), starting at the next output frame */
+void video_layout_set(VideoLayout * layout, const VideoPlacement placement[3], GstClockTime transition);
+
+void video_layout_free(VideoLayout * layout);
+
+#endif /* _VIDEO_LAYOUT__H_ */